@@ -0,0 +1,384 @@
+// FakeDevice Example CopyRight 2007-2008 John Robinson
+// Drives the video4linux2 backend with an in-process stand-in for
+// /dev/video0 installed through pxCameraSetDeviceOps, so capture can be
+// checked without any hardware.  Streams a few frames in RGB32, which
+// are delivered straight out of the driver's buffers, and in YUY2, which
+// are converted to pxPixel, and checks what the backend asked the device
+// to do along the way.
+
+#include "pxCore.h"
+#include "pxTimer.h"
+#include "pxCamera.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <linux/videodev2.h>
+
+const int gWidth = 640;
+const int gHeight = 480;
+const int gFrames = 20;
+
+// The fake device
+
+#define FAKE_FD         100
+#define FAKE_BUFFERS    4
+#define FAKE_BUFFER_SIZE (gWidth * gHeight * 4)
+
+struct fakeDevice
+{
+    bool open;
+    bool streaming;
+    unsigned int pixelFormat;
+    unsigned int bytesPerLine;
+    unsigned int buffers;           // Allocated by REQBUFS
+    bool queued[FAKE_BUFFERS];
+    int order[FAKE_BUFFERS];        // Queued buffers, filled in this order
+    int queuedCount;
+    int mapped;
+    unsigned int sequence;          // Of the next frame filled in
+
+    // How often the backend made each call
+    int reqbufs;
+    int qbuf;
+    int dqbuf;
+    int streamon;
+    int streamoff;
+};
+
+static fakeDevice gDevice;
+static unsigned char gMemory[FAKE_BUFFERS][FAKE_BUFFER_SIZE];
+
+// Grey level of frame sequence in each format
+static unsigned char frameLevel(unsigned int sequence)
+{
+    return (unsigned char)(16 + (sequence * 8) % 200);
+}
+
+// Fills buffer index with a flat grey frame the way a camera would
+static void fillFrame(int index, unsigned int sequence)
+{
+    unsigned char level = frameLevel(sequence);
+    unsigned char* p = gMemory[index];
+    if (gDevice.pixelFormat == V4L2_PIX_FMT_XBGR32)
+    {
+        pxPixel c;
+        c.r = c.g = c.b = level;
+        c.a = 255;
+        for (int i = 0; i < gWidth * gHeight; i++)
+            ((pxPixel*)p)[i] = c;
+    }
+    else
+    {
+        // YUY2 with no colour
+        for (int i = 0; i < gWidth * gHeight; i++)
+        {
+            p[i*2] = level;
+            p[i*2+1] = 128;
+        }
+    }
+}
+
+static int fakeOpen(const char* path, int flags)
+{
+    if (strcmp(path, "/dev/video0") || gDevice.open)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+    gDevice.open = true;
+    return FAKE_FD;
+}
+
+static int fakeClose(int fd)
+{
+    gDevice.open = false;
+    return 0;
+}
+
+static int fakeIoctl(int fd, unsigned long request, void* arg)
+{
+    switch (request)
+    {
+    case VIDIOC_QUERYCAP:
+        {
+            v4l2_capability* cap = (v4l2_capability*)arg;
+            strcpy((char*)cap->card, "Fake Camera");
+            cap->capabilities = V4L2_CAP_VIDEO_CAPTURE|V4L2_CAP_STREAMING;
+            return 0;
+        }
+    case VIDIOC_ENUM_FMT:
+        {
+            v4l2_fmtdesc* desc = (v4l2_fmtdesc*)arg;
+            if (desc->index > 1)
+                break;
+            desc->pixelformat = desc->index?V4L2_PIX_FMT_YUYV:V4L2_PIX_FMT_XBGR32;
+            return 0;
+        }
+    case VIDIOC_ENUM_FRAMESIZES:
+        {
+            v4l2_frmsizeenum* size = (v4l2_frmsizeenum*)arg;
+            if (size->index > 0)
+                break;
+            size->type = V4L2_FRMSIZE_TYPE_DISCRETE;
+            size->discrete.width = gWidth;
+            size->discrete.height = gHeight;
+            return 0;
+        }
+    case VIDIOC_ENUM_FRAMEINTERVALS:
+        {
+            v4l2_frmivalenum* ival = (v4l2_frmivalenum*)arg;
+            if (ival->index > 0)
+                break;
+            ival->type = V4L2_FRMIVAL_TYPE_DISCRETE;
+            ival->discrete.numerator = 1;
+            ival->discrete.denominator = 30;
+            return 0;
+        }
+    case VIDIOC_S_FMT:
+        {
+            v4l2_format* fmt = (v4l2_format*)arg;
+            if (gDevice.buffers)
+            {
+                errno = EBUSY;
+                return -1;
+            }
+            gDevice.pixelFormat = fmt->fmt.pix.pixelformat;
+            gDevice.bytesPerLine = gWidth *
+                ((gDevice.pixelFormat == V4L2_PIX_FMT_YUYV)?2:4);
+            fmt->fmt.pix.width = gWidth;
+            fmt->fmt.pix.height = gHeight;
+            fmt->fmt.pix.bytesperline = gDevice.bytesPerLine;
+            return 0;
+        }
+    case VIDIOC_S_PARM:
+        return 0;
+    case VIDIOC_REQBUFS:
+        {
+            v4l2_requestbuffers* req = (v4l2_requestbuffers*)arg;
+            gDevice.reqbufs++;
+            if (req->count && gDevice.buffers)
+            {
+                errno = EBUSY;
+                return -1;
+            }
+            if (req->count > FAKE_BUFFERS)
+                req->count = FAKE_BUFFERS;
+            gDevice.buffers = req->count;
+            for (int i = 0; i < FAKE_BUFFERS; i++)
+                gDevice.queued[i] = false;
+            gDevice.queuedCount = 0;
+            return 0;
+        }
+    case VIDIOC_QUERYBUF:
+        {
+            v4l2_buffer* buf = (v4l2_buffer*)arg;
+            if (buf->index >= gDevice.buffers)
+                break;
+            buf->length = FAKE_BUFFER_SIZE;
+            buf->m.offset = buf->index * FAKE_BUFFER_SIZE;
+            return 0;
+        }
+    case VIDIOC_QBUF:
+        {
+            v4l2_buffer* buf = (v4l2_buffer*)arg;
+            if (buf->index >= gDevice.buffers || gDevice.queued[buf->index])
+                break;
+            gDevice.qbuf++;
+            gDevice.queued[buf->index] = true;
+            gDevice.order[gDevice.queuedCount++] = buf->index;
+            return 0;
+        }
+    case VIDIOC_DQBUF:
+        {
+            // Buffers are filled in the order they were queued
+            v4l2_buffer* buf = (v4l2_buffer*)arg;
+            if (!gDevice.streaming || !gDevice.queuedCount)
+            {
+                errno = EAGAIN;
+                return -1;
+            }
+            int index = gDevice.order[0];
+            gDevice.queuedCount--;
+            memmove(gDevice.order, gDevice.order + 1,
+                    gDevice.queuedCount * sizeof(int));
+            gDevice.dqbuf++;
+            gDevice.queued[index] = false;
+            fillFrame(index, gDevice.sequence);
+
+            double now = pxMilliseconds();
+            buf->index = index;
+            buf->bytesused = gDevice.bytesPerLine * gHeight;
+            buf->sequence = gDevice.sequence++;
+            buf->timestamp.tv_sec = (time_t)(now / 1000);
+            buf->timestamp.tv_usec = (suseconds_t)((now - buf->timestamp.tv_sec * 1000.0) * 1000);
+            return 0;
+        }
+    case VIDIOC_STREAMON:
+        gDevice.streamon++;
+        gDevice.streaming = true;
+        return 0;
+    case VIDIOC_STREAMOFF:
+        gDevice.streamoff++;
+        gDevice.streaming = false;
+        for (int i = 0; i < FAKE_BUFFERS; i++)
+            gDevice.queued[i] = false;
+        gDevice.queuedCount = 0;
+        return 0;
+    }
+
+    errno = EINVAL;
+    return -1;
+}
+
+static void* fakeMmap(void* addr, size_t length, int prot, int flags, int fd,
+                      off_t offset)
+{
+    if (offset % FAKE_BUFFER_SIZE || offset / FAKE_BUFFER_SIZE >= FAKE_BUFFERS)
+        return MAP_FAILED;
+    gDevice.mapped++;
+    return gMemory[offset / FAKE_BUFFER_SIZE];
+}
+
+static int fakeMunmap(void* addr, size_t length)
+{
+    gDevice.mapped--;
+    return 0;
+}
+
+// A frame is ready every few milliseconds while anything is queued
+static int fakePoll(struct pollfd* fds, nfds_t nfds, int timeout)
+{
+    pxSleepMS(5);
+    if (gDevice.streaming && gDevice.queuedCount)
+    {
+        fds[0].revents = POLLIN;
+        return 1;
+    }
+    return 0;
+}
+
+static const pxCameraDeviceOps gFakeOps =
+{
+    fakeOpen, fakeClose, fakeIoctl, fakeMmap, fakeMunmap, fakePoll
+};
+
+// Checking the frames
+
+class frameChecker: public pxICameraCapture
+{
+public:
+    frameChecker(): mFrames(0), mErrors(0) {}
+
+    void onCameraFrame(pxCameraFrame* frame)
+    {
+        mFrames++;
+
+        // The first frame is kept until after the capture has stopped
+        if (!mKept)
+            mKept = frame;
+
+        unsigned char* base = (unsigned char*)frame->base();
+        bool inDevice = base >= gMemory[0] && base < gMemory[FAKE_BUFFERS];
+        if (frame->format() != PX_CAMERA_FORMAT_RGB32 ||
+            frame->width() != gWidth || frame->height() != gHeight ||
+            inDevice != mZeroCopy)
+            mErrors++;
+
+        // Every pixel should be the same grey, exactly so unless it went
+        // through a conversion
+        pxPixel* p = frame->scanline(gHeight/2) + gWidth/2;
+        int level = frameLevel(frame->sequence());
+        if (p->r != p->g || p->g != p->b ||
+            (mZeroCopy && p->r != level) ||
+            (!mZeroCopy && pxAbs(p->r - (level-16) * 255 / 219) > 2))
+            mErrors++;
+    }
+
+    volatile int mFrames;
+    volatile int mErrors;
+    bool mZeroCopy;
+    pxCameraFrameRef mKept;
+};
+
+bool check(const char* what, bool ok)
+{
+    printf("  %-48s %s\n", what, ok?"ok":"FAILED");
+    return ok;
+}
+
+bool stream(pxCamera& camera, pxCameraFormat format, const char* name)
+{
+    printf("%s\n", name);
+
+    pxCameraModeRequest request;
+    request.addFormat(format);
+    pxCameraMode chosen;
+    bool converting;
+    bool ok = check("negotiate",
+                    camera.negotiate(request, chosen, converting) == PX_OK &&
+                    chosen.format == format &&
+                    converting == (format != PX_CAMERA_FORMAT_RGB32));
+
+    memset(&gDevice, 0, sizeof(gDevice));
+    gDevice.open = true;
+
+    frameChecker checker;
+    checker.mZeroCopy = !converting;
+    ok = check("startCapture", camera.startCapture(&checker) == PX_OK) && ok;
+
+    double deadline = pxMilliseconds() + 5000;
+    while (checker.mFrames < gFrames && pxMilliseconds() < deadline)
+        pxSleepMS(10);
+    camera.stopCapture();
+
+    char line[64];
+    sprintf(line, "%d frames with the right pixels", checker.mFrames);
+    ok = check(line, checker.mFrames >= gFrames && !checker.mErrors) && ok;
+    ok = check("REQBUFS asked for buffers",
+               gDevice.reqbufs == 1 && gDevice.buffers == FAKE_BUFFERS) && ok;
+    // Every buffer is queued once to start with and again each time its
+    // frame is released while streaming, which the held frame isn't
+    ok = check("released frames queued again with QBUF",
+               gDevice.dqbuf == checker.mFrames &&
+               gDevice.qbuf >= gDevice.dqbuf &&
+               gDevice.qbuf < FAKE_BUFFERS + gDevice.dqbuf) && ok;
+    ok = check("STREAMON then STREAMOFF",
+               gDevice.streamon == 1 && gDevice.streamoff == 1) && ok;
+
+    // The held frame keeps the buffers mapped
+    ok = check("buffers mapped while a frame is held",
+               gDevice.mapped == FAKE_BUFFERS && checker.mKept) && ok;
+    checker.mKept = NULL;
+    ok = check("buffers unmapped once it is released", gDevice.mapped == 0) && ok;
+
+    // Once they are unmapped the driver lets them be allocated again
+    gDevice.buffers = 0;
+    return ok;
+}
+
+int pxMain()
+{
+    pxCameraSetDeviceOps(&gFakeOps);
+
+    pxCameras cameras;
+    cameras.init();
+    pxCamera camera;
+    if (!cameras.next(camera) || strcmp(camera.id(), "/dev/video0"))
+    {
+        printf("The fake device wasn't found\n");
+        return 1;
+    }
+    printf("Found %s at %s\n\n", camera.name(), camera.id());
+
+    bool ok = stream(camera, PX_CAMERA_FORMAT_RGB32, "RGB32, zero copy");
+    ok = stream(camera, PX_CAMERA_FORMAT_YUY2, "YUY2, converted") && ok;
+
+    camera.term();
+    pxCameraSetDeviceOps(NULL);
+
+    printf("\n%s\n", ok?"The backend drove the fake device correctly":
+           "FAILED");
+    return ok?0:1;
+}
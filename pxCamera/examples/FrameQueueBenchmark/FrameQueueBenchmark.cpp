@@ -0,0 +1,164 @@
+// FrameQueueBenchmark Example CopyRight 2007-2008 John Robinson
+// Pushes frames through a pxCameraFrameQueue as fast as one capture
+// thread can while several consumers pull them out, for each drop
+// policy.  Checks that every frame is accounted for in the stats
+// (consumed + dropped == captured) and that every frame is released.
+
+#include "pxCore.h"
+#include "pxTimer.h"
+#include "pxCameraFrameQueue.h"
+
+#include <stdio.h>
+#include <pthread.h>
+
+const int gFrames = 2000000;
+const int gFramesAfterClose = 1000;
+const int gConsumers = 3;
+const int gDepth = 64;
+
+// Frames still referenced by somebody
+volatile long gLive = 0;
+
+class testFrame: public pxCameraFrame
+{
+public:
+    testFrame()
+    {
+        pxAtomicIncrement(&gLive);
+    }
+
+protected:
+    void recycle()
+    {
+        pxAtomicDecrement(&gLive);
+        delete this;
+    }
+};
+
+// Hands a new frame to the queue the way a camera does, holding its own
+// reference only for the duration of the callback
+void capture(pxCameraFrameQueue& q)
+{
+    testFrame* f = new testFrame;
+    f->AddRef();
+    q.onCameraFrame(f);
+    f->Release();
+}
+
+struct consumer
+{
+    pxCameraFrameQueue* queue;
+    long popped;
+};
+
+void* consume(void* p)
+{
+    consumer* c = (consumer*)p;
+    pxCameraFrameRef f;
+    while (c->queue->pop(f))
+    {
+        c->popped++;
+        f = NULL;
+    }
+    return NULL;
+}
+
+bool check(const char* name, const pxCameraFrameQueueStats& s, long popped,
+           double ms)
+{
+    unsigned long accounted = s.consumed + s.droppedOldest + s.droppedNewest +
+        s.droppedClosed;
+    bool ok = accounted == s.captured && (long)s.consumed == popped &&
+        gLive == 0;
+
+    printf("%-8s %10.0f %8lu %8lu %8lu %8lu %8lu %8lu %6s\n", name,
+           ms > 0?s.captured / ms * 1000:0, s.captured, s.consumed,
+           s.droppedOldest, s.droppedNewest, s.droppedClosed, s.blocked,
+           ok?"yes":"NO");
+    return ok;
+}
+
+bool run(const char* name, pxCameraDropPolicy policy)
+{
+    pxCameraFrameQueue q;
+    q.init(gDepth, policy);
+
+    consumer c[gConsumers];
+    pthread_t threads[gConsumers];
+    for (int i = 0; i < gConsumers; i++)
+    {
+        c[i].queue = &q;
+        c[i].popped = 0;
+        pthread_create(&threads[i], NULL, consume, &c[i]);
+    }
+
+    double start = pxMilliseconds();
+    for (int i = 0; i < gFrames; i++)
+        capture(q);
+    double ms = pxMilliseconds() - start;
+
+    // Frames arriving after close are dropped, the consumers still drain
+    // what was queued before
+    q.close();
+    for (int i = 0; i < gFramesAfterClose; i++)
+        capture(q);
+
+    long popped = 0;
+    for (int i = 0; i < gConsumers; i++)
+    {
+        pthread_join(threads[i], NULL);
+        popped += c[i].popped;
+    }
+
+    q.term();
+
+    pxCameraFrameQueueStats s;
+    q.stats(s);
+    return check(name, s, popped, ms);
+}
+
+void* captureThree(void* p)
+{
+    pxCameraFrameQueue* q = (pxCameraFrameQueue*)p;
+    for (int i = 0; i < 3; i++)
+        capture(*q);
+    return NULL;
+}
+
+// With nobody consuming, the third frame into a queue two deep blocks
+// the capture thread until close gives up on it, and term drops the two
+// that were queued
+bool runBlockedClose()
+{
+    pxCameraFrameQueue q;
+    q.init(2, PX_BLOCK);
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, captureThree, &q);
+    pxSleepMS(200);
+    q.close();
+    pthread_join(thread, NULL);
+    q.term();
+
+    pxCameraFrameQueueStats s;
+    q.stats(s);
+    return check("closed", s, 0, 0) && s.captured == 3 && s.droppedClosed == 3;
+}
+
+int pxMain()
+{
+    printf("%d frames through a %d deep queue to %d consumers, then %d more\n"
+           "after close\n\n", gFrames, gDepth, gConsumers, gFramesAfterClose);
+    printf("%-8s %10s %8s %8s %8s %8s %8s %8s %6s\n", "", "frames/s",
+           "captured", "consumed", "oldest", "newest", "closed", "blocked",
+           "adds up");
+
+    bool ok = run("oldest", PX_DROP_OLDEST);
+    ok = run("newest", PX_DROP_NEWEST) && ok;
+    ok = run("block", PX_BLOCK) && ok;
+    ok = runBlockedClose() && ok;
+
+    printf("\n%s\n", ok?"Every frame was accounted for and released":
+           "FAILED: frames went missing");
+    return ok?0:1;
+}
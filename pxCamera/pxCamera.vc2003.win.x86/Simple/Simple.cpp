@@ -12,6 +12,7 @@
 #include "pxCamera.h"
 
 #include <stdio.h>
+#include <string.h>
 
 pxEventLoop eventLoop;
 
@@ -114,21 +115,39 @@ private:
         mTexture.blit(s);
     }
 
-    void onCameraCapture(pxBuffer& frame)
+    void onCameraFrame(pxCameraFrame* frame)
     {
         // Please beware that this method is called back on another thread
-        // Synchronizing with the main thread if necessary is left as an excercise for the
-        // you
+        // so keep the frame and post it to the window's thread.  Waiting
+        // for it to be drawn would deadlock when the window's thread is
+        // stopping the capture.  A frame that hasn't been drawn yet is
+        // replaced by the newer one.
+        frame->AddRef();
+        postMessage("drawFrame", frame, 1, releaseFrame);
+    }
 
-        mVideoWidth = frame.width();
-        mVideoHeight = frame.height();
+    static void releaseFrame(char* messageName, void* p1)
+    {
+        ((pxCameraFrame*)p1)->Release();
+    }
 
-        // Draw it directly to the window bypassing the paint loop
-        pxSurfaceNative s;
-        if (beginNativeDrawing(s) == PX_OK)
+    void onSynchronizedMessage(char* messageName, void* p1)
+    {
+        if (!strcmp(messageName, "drawFrame"))
         {
-            frame.blit(s);
-            endNativeDrawing(s);
+            pxCameraFrame* frame = (pxCameraFrame*)p1;
+
+            mVideoWidth = frame->width();
+            mVideoHeight = frame->height();
+
+            // Draw it directly to the window bypassing the paint loop
+            pxSurfaceNative s;
+            if (beginNativeDrawing(s) == PX_OK)
+            {
+                frame->blit(s);
+                endNativeDrawing(s);
+            }
+            frame->Release();
         }
     }
 
@@ -1,18 +1,141 @@
 // pxCamera Copyright 2007-2008 John Robinson
 // pxCamera.h
 
+#ifndef PX_CAMERA_H
+#define PX_CAMERA_H
+
 #include "pxCore.h"
 #include "pxBuffer.h"
 #include "pxOffscreen.h"
-
-#if defined(PX_PLATFORM_WIN)
-#include "win/pxCameraNative.h"
-#endif
+#include "pxAtomic.h"
+#include "rtRefPtr.h"
 
 class pxCameras;
 class pxCamera;
 class pxICameraCapture;
 
+// Pixel formats a camera can capture in
+enum pxCameraFormat
+{
+    PX_CAMERA_FORMAT_NONE,
+    PX_CAMERA_FORMAT_RGB32,     // Same layout as pxPixel
+    PX_CAMERA_FORMAT_RGB24,     // b, g, r
+    PX_CAMERA_FORMAT_YUY2,      // y0, u, y1, v
+    PX_CAMERA_FORMAT_UYVY,      // u, y0, v, y1
+    PX_CAMERA_FORMAT_NV12,      // y plane followed by interleaved uv plane
+    PX_CAMERA_FORMAT_I420,      // y plane followed by u and v planes
+    PX_CAMERA_FORMAT_MJPEG      // Compressed, one jpeg per frame
+};
+
+// A combination of size, frame rate and format a camera can capture
+typedef struct
+{
+    int width;
+    int height;
+    double fps;                 // 0 if the driver doesn't say
+    pxCameraFormat format;
+} pxCameraMode;
+
+#define PX_CAMERA_MAX_REQUEST_FORMATS 8
+
+// Describes the mode a caller would like to capture in.  See
+// pxCamera::negotiate.
+class pxCameraModeRequest
+{
+public:
+    pxCameraModeRequest();
+
+    // Appends a format the caller can consume.  Formats added first are
+    // preferred.
+    void addFormat(pxCameraFormat format);
+
+    // Smallest acceptable size.  0 accepts any size.
+    int width;
+    int height;
+
+    // Lowest acceptable frame rate.  0 picks the highest rate available.
+    double fps;
+
+    // Formats in order of preference.  If empty any format that can be
+    // converted to pxPixel is accepted, cheapest conversion first.
+    pxCameraFormat formats[PX_CAMERA_MAX_REQUEST_FORMATS];
+    int formatCount;
+
+    // If true (the default) frames are converted to pxPixel.  If false
+    // frames are delivered in the camera's format (see
+    // pxCameraFrame::format) and no conversion ever runs.
+    bool convert;
+};
+
+// Used by the native implementations of pxCamera::negotiate.  Returns the
+// index of the mode that best fits the request or -1 if none is
+// acceptable.  convertible lists the formats the implementation can turn
+// into pxPixel, cheapest first.
+int pxCameraChooseMode(const pxCameraMode* modes, int modeCount,
+                       const pxCameraModeRequest& request,
+                       const pxCameraFormat* convertible, int convertibleCount);
+
+// A captured frame that can be kept after onCameraFrame returns.
+// Frames are refcounted (see rtRefPtr.h) and can be handed to other
+// threads.  The memory behind the frame belongs to the capture driver and
+// is given back to it when the last reference is released, so holding on
+// to many frames will eventually make the camera drop frames.
+class pxCameraFrame: public pxBuffer
+{
+public:
+    pxCameraFrame(): mRefCount(0), mTimestamp(0), mSequence(0),
+        mFormat(PX_CAMERA_FORMAT_RGB32), mSize(0) {}
+    virtual ~pxCameraFrame() {}
+
+    unsigned long AddRef()
+    {
+        return pxAtomicIncrement(&mRefCount);
+    }
+
+    unsigned long Release()
+    {
+        long r = pxAtomicDecrement(&mRefCount);
+        if (r == 0)
+            recycle();
+        return r;
+    }
+
+    // Capture time in milliseconds.  Only the difference between
+    // the timestamps of two frames is meaningful.
+    double timestamp() const { return mTimestamp; }
+
+    // Increases by one for every frame the driver captured.  Gaps
+    // mean that frames were dropped.
+    unsigned int sequence() const { return mSequence; }
+
+    // PX_CAMERA_FORMAT_RGB32 unless conversion was turned off with
+    // pxCamera::negotiate.  For other formats base points at the
+    // camera's data, width and height are in pixels and stride is the
+    // stride of the first plane.
+    pxCameraFormat format() const { return mFormat; }
+
+    // Number of bytes of frame data.  Mostly useful for MJPEG.
+    unsigned int size() const { return mSize; }
+
+protected:
+    // Called when the last reference goes away
+    virtual void recycle() = 0;
+
+    volatile long mRefCount;
+    double mTimestamp;
+    unsigned int mSequence;
+    pxCameraFormat mFormat;
+    unsigned int mSize;
+};
+
+typedef rtRefPtr<pxCameraFrame> pxCameraFrameRef;
+
+#if defined(PX_PLATFORM_WIN)
+#include "win/pxCameraNative.h"
+#elif defined(PX_PLATFORM_X11)
+#include "x11/pxCameraNative.h"
+#endif
+
 // Use this class to enumerate all available video cameras
 class pxCameras: public pxCamerasNative
 {
@@ -56,6 +179,20 @@ public:
     // NOTE: THE callback method onCameraCapture will be invoked on another thread
     pxError startCapture(pxICameraCapture* callback);
     pxError stopCapture();
+
+    // Fills in up to maxModes of the modes the camera can capture in and
+    // returns how many there are in total
+    int modes(pxCameraMode* modes, int maxModes);
+
+    // Picks the mode that best fits request and uses it for the following
+    // calls to startCapture.  Sizes and rates that meet the request come
+    // first, then the preferred format, then the smallest size and then
+    // the highest frame rate.  converting is set if frames will go through
+    // a conversion to pxPixel.  Without a call to negotiate the camera
+    // captures in the mode picked for a default pxCameraModeRequest,
+    // which asks for 640x480 or larger.
+    pxError negotiate(const pxCameraModeRequest& request, pxCameraMode& chosen,
+                      bool& converting);
 };
 
 // Callback Interface
@@ -65,6 +202,16 @@ public:
     // Gets called for every frame captured by the camera
     // NOTE: This will get called on a different thread
     // NOTE: The frame data will not survive past the duration of this call.
-    virtual void onCameraCapture(pxBuffer& frame) = (0);
+    virtual void onCameraCapture(pxBuffer& frame) {}
+
+    // Gets called for every frame captured by the camera.  The default
+    // implementation forwards to onCameraCapture.  Override this instead to
+    // keep the frame around by holding a reference (eg. a pxCameraFrameRef).
+    // NOTE: This will get called on a different thread
+    virtual void onCameraFrame(pxCameraFrame* frame)
+    {
+        onCameraCapture(*frame);
+    }
 };
 
+#endif
@@ -0,0 +1,343 @@
+// pxCamera Copyright 2007-2008 John Robinson
+// pxCameraFrameQueue.cpp
+
+#include "pxCameraFrameQueue.h"
+#include "pxTimer.h"
+
+#if !defined(PX_PLATFORM_WIN)
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#endif
+
+// Lets a thread sleep until another thread has made progress.  Every
+// notify bumps a generation count; wait returns as soon as the generation
+// differs from the one the caller sampled before it checked the queue, so
+// a notify can't be lost between checking the queue and going to sleep.
+// notify doesn't touch the lock unless somebody is actually waiting.
+class pxCameraQueueSignal
+{
+public:
+    pxCameraQueueSignal(): mGeneration(0), mWaiters(0)
+    {
+#if defined(PX_PLATFORM_WIN)
+        mEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+#else
+        pthread_mutex_init(&mMutex, NULL);
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&mCond, &attr);
+        pthread_condattr_destroy(&attr);
+#endif
+    }
+
+    ~pxCameraQueueSignal()
+    {
+#if defined(PX_PLATFORM_WIN)
+        CloseHandle(mEvent);
+#else
+        pthread_cond_destroy(&mCond);
+        pthread_mutex_destroy(&mMutex);
+#endif
+    }
+
+    long generation() const { return mGeneration; }
+
+    void notify()
+    {
+        pxAtomicIncrement(&mGeneration);
+        if (mWaiters)
+        {
+#if defined(PX_PLATFORM_WIN)
+            SetEvent(mEvent);
+#else
+            pthread_mutex_lock(&mMutex);
+            pthread_cond_broadcast(&mCond);
+            pthread_mutex_unlock(&mMutex);
+#endif
+        }
+    }
+
+    // Sleeps while the generation is still generation or until
+    // timeoutMS passes (forever if negative)
+    void wait(long generation, int timeoutMS)
+    {
+        pxAtomicIncrement(&mWaiters);
+#if defined(PX_PLATFORM_WIN)
+        if (mGeneration == generation)
+            WaitForSingleObject(mEvent, (timeoutMS < 0)?INFINITE:timeoutMS);
+        // The event only wakes one thread so pass it on
+        if (mWaiters > 1 && mGeneration != generation)
+            SetEvent(mEvent);
+#else
+        struct timespec deadline;
+        if (timeoutMS >= 0)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_sec += timeoutMS / 1000;
+            deadline.tv_nsec += (timeoutMS % 1000) * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L)
+            {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+        }
+
+        pthread_mutex_lock(&mMutex);
+        while (mGeneration == generation)
+        {
+            if (timeoutMS < 0)
+                pthread_cond_wait(&mCond, &mMutex);
+            else if (pthread_cond_timedwait(&mCond, &mMutex, &deadline) == ETIMEDOUT)
+                break;
+        }
+        pthread_mutex_unlock(&mMutex);
+#endif
+        pxAtomicDecrement(&mWaiters);
+    }
+
+private:
+    volatile long mGeneration;
+    volatile long mWaiters;
+#if defined(PX_PLATFORM_WIN)
+    HANDLE mEvent;
+#else
+    pthread_mutex_t mMutex;
+    pthread_cond_t mCond;
+#endif
+};
+
+pxCameraFrameQueue::pxCameraFrameQueue()
+{
+    mCells = NULL;
+    mMask = 0;
+    mPolicy = PX_DROP_OLDEST;
+    mEnqueuePos = mDequeuePos = 0;
+    mClosed = true;
+    mFrameSignal = NULL;
+    mSpaceSignal = NULL;
+    mCaptured = mConsumed = mDroppedOldest = mDroppedNewest = mDroppedClosed = 0;
+    mBlocked = 0;
+}
+
+pxCameraFrameQueue::~pxCameraFrameQueue()
+{
+    term();
+}
+
+pxError pxCameraFrameQueue::init(int depth, pxCameraDropPolicy policy)
+{
+    term();
+
+    long size = 2;
+    while (size < depth)
+        size *= 2;
+
+    mCells = new cell[size];
+    for (long i = 0; i < size; i++)
+    {
+        mCells[i].sequence = i;
+        mCells[i].frame = NULL;
+    }
+    mMask = size-1;
+    mPolicy = policy;
+    mEnqueuePos = mDequeuePos = 0;
+    mCaptured = mConsumed = mDroppedOldest = mDroppedNewest = mDroppedClosed = 0;
+    mBlocked = 0;
+
+    mFrameSignal = new pxCameraQueueSignal;
+    mSpaceSignal = new pxCameraQueueSignal;
+
+    pxMemoryBarrier();
+    mClosed = false;
+
+    return PX_OK;
+}
+
+pxError pxCameraFrameQueue::term()
+{
+    if (mCells)
+    {
+        close();
+
+        pxCameraFrame* f;
+        while (dequeue(f))
+        {
+            pxAtomicIncrement(&mDroppedClosed);
+            f->Release();
+        }
+
+        delete [] mCells;
+        mCells = NULL;
+
+        delete mFrameSignal;
+        mFrameSignal = NULL;
+        delete mSpaceSignal;
+        mSpaceSignal = NULL;
+    }
+    return PX_OK;
+}
+
+void pxCameraFrameQueue::close()
+{
+    if (mCells)
+    {
+        mClosed = true;
+        mFrameSignal->notify();
+        mSpaceSignal->notify();
+    }
+}
+
+void pxCameraFrameQueue::stats(pxCameraFrameQueueStats& s) const
+{
+    s.captured = mCaptured;
+    s.consumed = mConsumed;
+    s.droppedOldest = mDroppedOldest;
+    s.droppedNewest = mDroppedNewest;
+    s.droppedClosed = mDroppedClosed;
+    s.blocked = mBlocked;
+}
+
+// Bounded queue after Dmitry Vyukov.  Each cell carries a sequence number
+// that tells producers and consumers whether it is theirs to fill or empty.
+bool pxCameraFrameQueue::enqueue(pxCameraFrame* frame)
+{
+    cell* c;
+    long pos = mEnqueuePos;
+    for (;;)
+    {
+        c = &mCells[pos & mMask];
+        long dif = c->sequence - pos;
+        if (dif == 0)
+        {
+            if (pxAtomicCompareAndSwap(&mEnqueuePos, pos, pos+1))
+                break;
+        }
+        else if (dif < 0)
+            return false;  // full
+        pos = mEnqueuePos;
+    }
+
+    c->frame = frame;
+    pxMemoryBarrier();
+    c->sequence = pos+1;
+    return true;
+}
+
+bool pxCameraFrameQueue::dequeue(pxCameraFrame*& frame)
+{
+    cell* c;
+    long pos = mDequeuePos;
+    for (;;)
+    {
+        c = &mCells[pos & mMask];
+        long dif = c->sequence - (pos+1);
+        if (dif == 0)
+        {
+            if (pxAtomicCompareAndSwap(&mDequeuePos, pos, pos+1))
+                break;
+        }
+        else if (dif < 0)
+            return false;  // empty
+        pos = mDequeuePos;
+    }
+
+    frame = c->frame;
+    pxMemoryBarrier();
+    c->sequence = pos+mMask+1;
+    return true;
+}
+
+bool pxCameraFrameQueue::pop(pxCameraFrameRef& frame, int timeoutMS)
+{
+    if (!mCells)
+        return false;
+
+    double deadline = pxMilliseconds() + timeoutMS;
+    for (;;)
+    {
+        long generation = mFrameSignal->generation();
+
+        pxCameraFrame* f;
+        if (dequeue(f))
+        {
+            // The queue's reference is handed over to the caller
+            *frame.ref() = f;
+            pxAtomicIncrement(&mConsumed);
+            mSpaceSignal->notify();
+            return true;
+        }
+
+        if (mClosed)
+            return false;
+
+        int remaining = -1;
+        if (timeoutMS >= 0)
+        {
+            remaining = (int)(deadline - pxMilliseconds());
+            if (remaining <= 0)
+                return false;
+        }
+
+        mFrameSignal->wait(generation, remaining);
+    }
+}
+
+void pxCameraFrameQueue::onCameraFrame(pxCameraFrame* frame)
+{
+    pxAtomicIncrement(&mCaptured);
+
+    if (mClosed)
+    {
+        pxAtomicIncrement(&mDroppedClosed);
+        return;
+    }
+
+    frame->AddRef();
+
+    bool blocked = false;
+    while (!enqueue(frame))
+    {
+        if (mPolicy == PX_DROP_NEWEST)
+        {
+            pxAtomicIncrement(&mDroppedNewest);
+            frame->Release();
+            return;
+        }
+        else if (mPolicy == PX_DROP_OLDEST)
+        {
+            // Races with the consumers for the oldest frame, which is
+            // fine since either way a slot becomes free
+            pxCameraFrame* oldest;
+            if (dequeue(oldest))
+            {
+                pxAtomicIncrement(&mDroppedOldest);
+                oldest->Release();
+            }
+        }
+        else
+        {
+            long generation = mSpaceSignal->generation();
+            if (enqueue(frame))
+                break;
+
+            if (!blocked)
+            {
+                pxAtomicIncrement(&mBlocked);
+                blocked = true;
+            }
+
+            if (mClosed)
+            {
+                pxAtomicIncrement(&mDroppedClosed);
+                frame->Release();
+                return;
+            }
+
+            mSpaceSignal->wait(generation, 100);
+        }
+    }
+
+    mFrameSignal->notify();
+}
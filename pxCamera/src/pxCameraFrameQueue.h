@@ -0,0 +1,89 @@
+// pxCamera Copyright 2007-2008 John Robinson
+// pxCameraFrameQueue.h
+
+#ifndef PX_CAMERA_FRAME_QUEUE_H
+#define PX_CAMERA_FRAME_QUEUE_H
+
+#include "pxCamera.h"
+
+// What to do with a newly captured frame when the queue is full
+enum pxCameraDropPolicy
+{
+    PX_DROP_OLDEST,     // Discard the oldest queued frame to make room
+    PX_DROP_NEWEST,     // Discard the new frame
+    PX_BLOCK            // Stall the capture thread until a consumer catches up
+};
+
+// Once the camera has stopped and the queue has been closed and emptied
+// every captured frame has been either consumed or dropped
+// (captured == consumed + droppedOldest + droppedNewest + droppedClosed)
+struct pxCameraFrameQueueStats
+{
+    unsigned long captured;         // Frames handed to the queue by the camera
+    unsigned long consumed;         // Frames returned by pop
+    unsigned long droppedOldest;    // Queued frames discarded by PX_DROP_OLDEST
+    unsigned long droppedNewest;    // New frames discarded by PX_DROP_NEWEST
+    unsigned long droppedClosed;    // Frames pushed after close or left queued by term
+    unsigned long blocked;          // Times PX_BLOCK stalled the capture thread
+};
+
+class pxCameraQueueSignal;
+
+// A bounded queue that sits between the capture thread and any number of
+// consumer threads so that the cost of processing a frame doesn't affect
+// the capture cadence.  Pass the queue to pxCamera::startCapture and pull
+// frames out of it with pop.  Pushing and popping frames is lock free;
+// a lock is only taken to put an idle thread to sleep or wake it up.
+class pxCameraFrameQueue: public pxICameraCapture
+{
+public:
+    pxCameraFrameQueue();
+    virtual ~pxCameraFrameQueue();
+
+    // depth is rounded up to a power of two
+    pxError init(int depth, pxCameraDropPolicy policy = PX_DROP_OLDEST);
+    pxError term();
+
+    // Waits up to timeoutMS (forever if negative) for a frame.  Returns
+    // false if no frame arrived in time or the queue has been closed.
+    bool pop(pxCameraFrameRef& frame, int timeoutMS = -1);
+
+    // Wakes up every waiting consumer and makes pop fail once the queue
+    // is empty.  Frames pushed after this are dropped.
+    void close();
+
+    void stats(pxCameraFrameQueueStats& s) const;
+
+    // pxICameraCapture
+    void onCameraFrame(pxCameraFrame* frame);
+
+private:
+    bool enqueue(pxCameraFrame* frame);
+    bool dequeue(pxCameraFrame*& frame);
+
+    typedef struct
+    {
+        volatile long sequence;
+        pxCameraFrame* frame;
+    } cell;
+
+    cell* mCells;
+    long mMask;
+    pxCameraDropPolicy mPolicy;
+
+    volatile long mEnqueuePos;
+    volatile long mDequeuePos;
+    volatile bool mClosed;
+
+    pxCameraQueueSignal* mFrameSignal;
+    pxCameraQueueSignal* mSpaceSignal;
+
+    volatile long mCaptured;
+    volatile long mConsumed;
+    volatile long mDroppedOldest;
+    volatile long mDroppedNewest;
+    volatile long mDroppedClosed;
+    volatile long mBlocked;
+};
+
+#endif
@@ -0,0 +1,100 @@
+// pxCamera Copyright 2007-2008 John Robinson
+// pxCameraMode.cpp
+
+#include "pxCamera.h"
+
+pxCameraModeRequest::pxCameraModeRequest()
+{
+    width = 640;
+    height = 480;
+    fps = 0;
+    formatCount = 0;
+    convert = true;
+}
+
+void pxCameraModeRequest::addFormat(pxCameraFormat format)
+{
+    if (formatCount < PX_CAMERA_MAX_REQUEST_FORMATS)
+        formats[formatCount++] = format;
+}
+
+// Position of format in list or -1
+static int formatRank(const pxCameraFormat* list, int count, pxCameraFormat format)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (list[i] == format)
+            return i;
+    }
+    return -1;
+}
+
+// Modes are compared on each of these in turn, smaller is better
+typedef struct
+{
+    int sizeMisses;     // The mode is smaller than requested
+    int fpsMisses;      // The mode is slower than requested
+    int formatRank;
+    double area;        // Smallest that fits, or largest that doesn't
+    double fps;         // Negated so that the fastest wins
+} modeScore;
+
+static bool better(const modeScore& a, const modeScore& b)
+{
+    if (a.sizeMisses != b.sizeMisses)
+        return a.sizeMisses < b.sizeMisses;
+    if (a.fpsMisses != b.fpsMisses)
+        return a.fpsMisses < b.fpsMisses;
+    if (a.formatRank != b.formatRank)
+        return a.formatRank < b.formatRank;
+    if (a.area != b.area)
+        return a.area < b.area;
+    return a.fps < b.fps;
+}
+
+int pxCameraChooseMode(const pxCameraMode* modes, int modeCount,
+                       const pxCameraModeRequest& request,
+                       const pxCameraFormat* convertible, int convertibleCount)
+{
+    int best = -1;
+    modeScore bestScore;
+
+    for (int i = 0; i < modeCount; i++)
+    {
+        const pxCameraMode& m = modes[i];
+
+        int rank;
+        if (request.formatCount)
+        {
+            rank = formatRank(request.formats, request.formatCount, m.format);
+            // A preferred format is still no good if it has to be
+            // converted and can't be
+            if (rank >= 0 && request.convert &&
+                formatRank(convertible, convertibleCount, m.format) < 0)
+                rank = -1;
+        }
+        else
+            rank = formatRank(convertible, convertibleCount, m.format);
+
+        if (rank < 0)
+            continue;
+
+        modeScore s;
+        s.sizeMisses = (m.width < request.width || m.height < request.height)?1:0;
+        // Allow for rates like 29.97 when asking for 30
+        s.fpsMisses = (request.fps > 0 && m.fps < request.fps * 0.99)?1:0;
+        s.formatRank = rank;
+        s.area = (double)m.width * m.height;
+        if (s.sizeMisses)
+            s.area = -s.area;
+        s.fps = -m.fps;
+
+        if (best < 0 || better(s, bestScore))
+        {
+            best = i;
+            bestScore = s;
+        }
+    }
+
+    return best;
+}
@@ -41,36 +41,133 @@ void WINAPI DeleteMediaType(AM_MEDIA_TYPE *pmt)
 }
 
 
-HRESULT getBestMediaType(IPin* pPin, AM_MEDIA_TYPE** t)
+// Subtypes for fourcc formats that older SDKs don't define
+static GUID fourccSubtype(DWORD fourcc)
 {
-    HRESULT hr = E_FAIL;
+    GUID g = MEDIASUBTYPE_YUY2;
+    g.Data1 = fourcc;
+    return g;
+}
+
+static pxCameraFormat toCameraFormat(const GUID& subtype)
+{
+    if (subtype == MEDIASUBTYPE_RGB32)
+        return PX_CAMERA_FORMAT_RGB32;
+    if (subtype == MEDIASUBTYPE_RGB24)
+        return PX_CAMERA_FORMAT_RGB24;
+    if (subtype == MEDIASUBTYPE_YUY2)
+        return PX_CAMERA_FORMAT_YUY2;
+    if (subtype == MEDIASUBTYPE_UYVY)
+        return PX_CAMERA_FORMAT_UYVY;
+    if (subtype == fourccSubtype(MAKEFOURCC('N','V','1','2')))
+        return PX_CAMERA_FORMAT_NV12;
+    if (subtype == MEDIASUBTYPE_IYUV || subtype == fourccSubtype(MAKEFOURCC('I','4','2','0')))
+        return PX_CAMERA_FORMAT_I420;
+    if (subtype == MEDIASUBTYPE_MJPG)
+        return PX_CAMERA_FORMAT_MJPEG;
+    return PX_CAMERA_FORMAT_NONE;
+}
+
+static GUID toSubtype(pxCameraFormat format)
+{
+    switch(format)
+    {
+    case PX_CAMERA_FORMAT_RGB24:    return MEDIASUBTYPE_RGB24;
+    case PX_CAMERA_FORMAT_YUY2:     return MEDIASUBTYPE_YUY2;
+    case PX_CAMERA_FORMAT_UYVY:     return MEDIASUBTYPE_UYVY;
+    case PX_CAMERA_FORMAT_NV12:     return fourccSubtype(MAKEFOURCC('N','V','1','2'));
+    case PX_CAMERA_FORMAT_I420:     return MEDIASUBTYPE_IYUV;
+    case PX_CAMERA_FORMAT_MJPEG:    return MEDIASUBTYPE_MJPG;
+    }
+    return MEDIASUBTYPE_RGB32;
+}
+
+// DirectShow can put a converter or decoder in front of the grabber for
+// anything the camera produces, cheapest first
+static const pxCameraFormat gConvertible[] =
+{
+    PX_CAMERA_FORMAT_RGB32,
+    PX_CAMERA_FORMAT_RGB24,
+    PX_CAMERA_FORMAT_YUY2,
+    PX_CAMERA_FORMAT_UYVY,
+    PX_CAMERA_FORMAT_NV12,
+    PX_CAMERA_FORMAT_I420,
+    PX_CAMERA_FORMAT_MJPEG,
+};
+
+// Fills in the mode described by capability i of config.  Returns false if
+// it isn't a video format we know.  If t is non NULL it receives the media
+// type which must be freed with DeleteMediaType.
+static bool getMode(IAMStreamConfig* config, int i, pxCameraMode& m,
+                    AM_MEDIA_TYPE** t)
+{
+    VIDEO_STREAM_CONFIG_CAPS caps;
+    AM_MEDIA_TYPE* pt;
+    if (FAILED(config->GetStreamCaps(i, &pt, (BYTE*)&caps)))
+        return false;
 
-    rtRefPtr<IEnumMediaTypes> e;
-    if (SUCCEEDED(pPin->EnumMediaTypes(e.ref())))
+    bool found = false;
+    if (pt->majortype == MEDIATYPE_Video && pt->formattype == FORMAT_VideoInfo &&
+        pt->cbFormat >= sizeof(VIDEOINFOHEADER))
     {
-        ULONG fetched;
-        AM_MEDIA_TYPE *pt;
-        int curBitCount = 0;
-        int curWidth = 0;
-        e->Reset();
-        while (S_OK == (e->Next(1, &pt, &fetched)))
+        VIDEOINFOHEADER *vih = (VIDEOINFOHEADER *)pt->pbFormat;
+        m.format = toCameraFormat(pt->subtype);
+        m.width = vih->bmiHeader.biWidth;
+        m.height = abs(vih->bmiHeader.biHeight);
+
+        // Intervals are in 100ns units
+        REFERENCE_TIME interval = caps.MinFrameInterval?
+            caps.MinFrameInterval:vih->AvgTimePerFrame;
+        m.fps = interval?10000000.0/interval:0;
+
+        if (m.format != PX_CAMERA_FORMAT_NONE)
         {
-            if( pt->formattype == FORMAT_VideoInfo && pt->majortype == MEDIATYPE_Video && pt->subtype == MEDIASUBTYPE_RGB24)
+            if (t)
             {
-                VIDEOINFOHEADER *vih = (VIDEOINFOHEADER *)pt->pbFormat;
-                if (vih->bmiHeader.biWidth >= 640 && vih->bmiHeader.biBitCount >= 24)
-                {
-                    // Good Enough
-                    *t = pt;
-                    hr = S_OK;
-                    break;
-                }
+                // Ask for the fastest rate the capability allows
+                if (caps.MinFrameInterval)
+                    vih->AvgTimePerFrame = caps.MinFrameInterval;
+                *t = pt;
+                pt = NULL;
+            }
+            found = true;
+        }
+    }
+    if (pt)
+        DeleteMediaType(pt);
+    return found;
+}
+
+static int getModeCount(IAMStreamConfig* config)
+{
+    int count = 0, size = 0;
+    if (FAILED(config->GetNumberOfCapabilities(&count, &size)) ||
+        size != sizeof(VIDEO_STREAM_CONFIG_CAPS))
+        return 0;
+    return count;
+}
 
+// Finds the capability that matches a mode picked by pxCamera::negotiate
+HRESULT getBestMediaType(IAMStreamConfig* config, const pxCameraMode& mode,
+                         AM_MEDIA_TYPE** t)
+{
+    int count = getModeCount(config);
+    for (int i = 0; i < count; i++)
+    {
+        pxCameraMode m;
+        AM_MEDIA_TYPE* pt;
+        if (getMode(config, i, m, &pt))
+        {
+            if (m.format == mode.format && m.width == mode.width &&
+                m.height == mode.height && m.fps == mode.fps)
+            {
+                *t = pt;
+                return S_OK;
             }
             DeleteMediaType(pt);
         }
     }
-    return hr;
+    return E_FAIL;
 }
 
 HRESULT getPin(IBaseFilter * pFilter, PIN_DIRECTION dirrequired, IPin **ppPin)
@@ -126,16 +223,72 @@ void getOutPin( IBaseFilter * pFilter, IPin **pin )
 }
 
 
+// Wraps a media sample so that it can be held past the callback.  The
+// sample goes back to the allocator when the last reference is released.
+class sampleFrame: public pxCameraFrame
+{
+public:
+    sampleFrame(IMediaSample* sample, BYTE* data, int width, int height,
+                int stride, pxCameraFormat format, double timestamp,
+                unsigned int sequence)
+    {
+        mSample = sample;
+        setBase(data);
+        setWidth(width);
+        setHeight(height);
+        setStride(stride);
+        // Only RGB comes bottom up
+        setUpsideDown(format == PX_CAMERA_FORMAT_RGB32 || format == PX_CAMERA_FORMAT_RGB24);
+        mTimestamp = timestamp;
+        mSequence = sequence;
+        mFormat = format;
+        mSize = sample->GetActualDataLength();
+    }
+
+protected:
+    void recycle()
+    {
+        delete this;
+    }
+
+    rtRefPtr<IMediaSample> mSample;
+};
+
 class grabberCB : public ISampleGrabberCB 
 {
 public:
 
-    grabberCB(pxICameraCapture* capture, int width, int height)
+    grabberCB(pxICameraCapture* capture, int width, int height,
+              pxCameraFormat format)
     {
         mRefCount = 0;
         mCapture = capture;
         mWidth = width;
         mHeight = height;
+        mFormat = format;
+        mSequence = 0;
+
+        switch(format)
+        {
+        case PX_CAMERA_FORMAT_RGB24:
+            // DIB rows are dword aligned
+            mStride = (width*3 + 3) & ~3;
+            break;
+        case PX_CAMERA_FORMAT_YUY2:
+        case PX_CAMERA_FORMAT_UYVY:
+            mStride = width*2;
+            break;
+        case PX_CAMERA_FORMAT_NV12:
+        case PX_CAMERA_FORMAT_I420:
+            mStride = width;
+            break;
+        case PX_CAMERA_FORMAT_MJPEG:
+            mStride = 0;
+            break;
+        default:
+            mStride = width*4;
+            break;
+        }
     }
 
     STDMETHODIMP_(ULONG) AddRef() 
@@ -171,26 +324,28 @@ public:
 
     STDMETHODIMP SampleCB( double SampleTime, IMediaSample * pSample )
     {
-        return 0;
+        BYTE* data;
+        if (FAILED(pSample->GetPointer(&data)))
+            return S_OK;
+
+        rtRefPtr<pxCameraFrame> f = new sampleFrame(pSample, data, mWidth, 
+            mHeight, mStride, mFormat, SampleTime*1000, mSequence++);
+        mCapture->onCameraFrame(f);
+
+        return S_OK;
     }
 
 	STDMETHODIMP BufferCB( double dblSampleTime, BYTE * pBuffer, long lBufferSize )
     {
-        pxBuffer b;
-        b.setBase(pBuffer);
-        b.setWidth(mWidth);
-        b.setHeight(mHeight);
-        b.setStride(mWidth*4);
-        b.setUpsideDown(true);
-        
-        mCapture->onCameraCapture(b);
-
-        return S_OK;
+        return 0;
     }
 
 public:
     int mWidth;
     int mHeight;
+    int mStride;
+    pxCameraFormat mFormat;
+    unsigned int mSequence;
     ULONG mRefCount;
     pxICameraCapture* mCapture;
 };
@@ -279,6 +434,8 @@ pxCamera::pxCamera()
 {
     mName = NULL;
     mId = NULL;
+    mNegotiated = false;
+    mConvert = true;
 }
 
 pxCamera::~pxCamera()
@@ -331,6 +488,7 @@ pxError pxCamera::init(char* id)
 pxError pxCamera::term()
 {
     stopCapture();
+    mNegotiated = false;
     if (mName)
     {
         free(mName);
@@ -374,6 +532,16 @@ pxError pxCamera::startCapture(pxICameraCapture* callback)
     {
         stopCapture();
 
+        // negotiate refuses once there is a graph so the default mode is
+        // picked before building it
+        if (!mNegotiated)
+        {
+            pxCameraModeRequest request;
+            pxCameraMode chosen;
+            bool converting;
+            negotiate(request, chosen, converting);
+        }
+
         rtRefPtr<ISampleGrabber> grabber;
         rtRefPtr<IBaseFilter> grabberBase;
 
@@ -405,22 +573,29 @@ pxError pxCamera::startCapture(pxICameraCapture* callback)
             return PX_FAIL;
         }
 
+        // Without a negotiated mode the camera's default is converted
+        pxCameraFormat format = PX_CAMERA_FORMAT_RGB32;
+
         rtRefPtr<IAMStreamConfig> config;
-        if (SUCCEEDED(sourcePin->QueryInterface( IID_IAMStreamConfig, (void **) config.ref() )))
+        if (mNegotiated &&
+            SUCCEEDED(sourcePin->QueryInterface( IID_IAMStreamConfig, (void **) config.ref() )))
         {
             AM_MEDIA_TYPE *mt;
-            if (SUCCEEDED(getBestMediaType(sourcePin, &mt)))
+            if (SUCCEEDED(getBestMediaType(config, mMode, &mt)))
             {
-                mt->subtype = MEDIASUBTYPE_RGB24;
                 hr=config->SetFormat( mt );
                 DeleteMediaType(mt);
+                if (SUCCEEDED(hr) && !mConvert)
+                    format = mMode.format;
             }
         }
 
+        // Asking the grabber for anything other than what the camera
+        // produces makes the graph insert a converter
         AM_MEDIA_TYPE mt;
         ZeroMemory(&mt, sizeof(AM_MEDIA_TYPE));
         mt.majortype = MEDIATYPE_Video;
-        mt.subtype = MEDIASUBTYPE_RGB32;  
+        mt.subtype = toSubtype(format);
         hr = grabber->SetMediaType(&mt);    
         FreeMediaType(mt);
 
@@ -438,7 +613,7 @@ pxError pxCamera::startCapture(pxICameraCapture* callback)
             {
                 VIDEOINFOHEADER * vih = (VIDEOINFOHEADER*) mt.pbFormat;
                 vWidth  = vih->bmiHeader.biWidth;
-                vHeight = vih->bmiHeader.biHeight;
+                vHeight = abs(vih->bmiHeader.biHeight);
                 FreeMediaType( mt );
 
             }
@@ -446,10 +621,11 @@ pxError pxCamera::startCapture(pxICameraCapture* callback)
                 return PX_FAIL;
         }
 
-        rtRefPtr<grabberCB> cb = new grabberCB(callback, vWidth, vHeight);
+        rtRefPtr<grabberCB> cb = new grabberCB(callback, vWidth, vHeight, format);
         if (cb)
         {
-            if (FAILED(grabber->SetCallback( cb, 1 )))
+            // 0 selects SampleCB which lets frames hold on to the sample
+            if (FAILED(grabber->SetCallback( cb, 0 )))
                 return PX_FAIL;
         }
 
@@ -489,3 +665,59 @@ pxError pxCamera::stopCapture()
     }
     return PX_OK;
 }
+
+int pxCamera::modes(pxCameraMode* modes, int maxModes)
+{
+    if (!mCamera)
+        return 0;
+
+    rtRefPtr<IPin> pin;
+    rtRefPtr<IAMStreamConfig> config;
+    getOutPin(mCamera, pin.ref());
+    if (!pin || FAILED(pin->QueryInterface(IID_IAMStreamConfig, (void**)config.ref())))
+        return 0;
+
+    int n = 0;
+    int count = getModeCount(config);
+    for (int i = 0; i < count; i++)
+    {
+        pxCameraMode m;
+        if (getMode(config, i, m, NULL))
+        {
+            if (n < maxModes)
+                modes[n] = m;
+            n++;
+        }
+    }
+    return n;
+}
+
+pxError pxCamera::negotiate(const pxCameraModeRequest& request, pxCameraMode& chosen,
+                            bool& converting)
+{
+    // The format can't change while the graph is running
+    if (graph)
+        return PX_FAIL;
+
+    int count = modes(NULL, 0);
+    if (!count)
+        return PX_FAIL;
+
+    pxCameraMode* m = new pxCameraMode[count];
+    count = modes(m, count);
+
+    int best = pxCameraChooseMode(m, count, request, gConvertible,
+                                  sizeof(gConvertible)/sizeof(gConvertible[0]));
+    if (best >= 0)
+    {
+        mMode = m[best];
+        mConvert = request.convert;
+        mNegotiated = true;
+
+        chosen = mMode;
+        converting = mConvert && mMode.format != PX_CAMERA_FORMAT_RGB32;
+    }
+    delete [] m;
+
+    return (best >= 0)?PX_OK:PX_FAIL;
+}
@@ -21,4 +21,9 @@ protected:
     char* mName;
     rtRefPtr<IBaseFilter> mCamera;
     rtRefPtr<IGraphBuilder>  graph;
+
+    // Mode picked by negotiate
+    bool mNegotiated;
+    pxCameraMode mMode;
+    bool mConvert;
 };
\ No newline at end of file
@@ -0,0 +1,824 @@
+// pxCamera Copyright 2007-2008 John Robinson
+// pxCameraNative.cpp
+
+#include "pxCamera.h"
+#include "pxColorConvert.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/videodev2.h>
+
+#include <vector>
+
+// Highest /dev/videoN probed by pxCameras::next
+#define PX_MAX_VIDEO_DEVICES    64
+
+// Number of streaming buffers requested from the driver
+#define PX_CAPTURE_BUFFERS      4
+
+// Default device ops that go straight to the kernel
+
+static int sysOpen(const char* path, int flags)
+{
+    return ::open(path, flags);
+}
+
+static int sysIoctl(int fd, unsigned long request, void* arg)
+{
+    return ::ioctl(fd, request, arg);
+}
+
+static const pxCameraDeviceOps gSystemOps =
+{
+    sysOpen, ::close, sysIoctl, ::mmap, ::munmap, ::poll
+};
+
+static const pxCameraDeviceOps* gOps = &gSystemOps;
+
+void pxCameraSetDeviceOps(const pxCameraDeviceOps* ops)
+{
+    gOps = ops?ops:&gSystemOps;
+}
+
+static int xioctl(int fd, unsigned long request, void* arg)
+{
+    int r;
+    do
+    {
+        r = gOps->ioctl(fd, request, arg);
+    } while (r < 0 && errno == EINTR);
+    return r;
+}
+
+// Formats this backend can convert to pxPixel, cheapest first
+static const pxCameraFormat gConvertible[] =
+{
+    PX_CAMERA_FORMAT_RGB32,
+    PX_CAMERA_FORMAT_YUY2,
+    PX_CAMERA_FORMAT_UYVY,
+    PX_CAMERA_FORMAT_NV12,
+    PX_CAMERA_FORMAT_I420,
+};
+
+static pxCameraFormat toCameraFormat(unsigned int pixelFormat)
+{
+    switch(pixelFormat)
+    {
+    // Laid out in memory exactly like pxPixel
+    case V4L2_PIX_FMT_XBGR32:
+    case V4L2_PIX_FMT_ABGR32:
+    case V4L2_PIX_FMT_BGR32:    return PX_CAMERA_FORMAT_RGB32;
+    case V4L2_PIX_FMT_BGR24:    return PX_CAMERA_FORMAT_RGB24;
+    case V4L2_PIX_FMT_YUYV:     return PX_CAMERA_FORMAT_YUY2;
+    case V4L2_PIX_FMT_UYVY:     return PX_CAMERA_FORMAT_UYVY;
+    case V4L2_PIX_FMT_NV12:     return PX_CAMERA_FORMAT_NV12;
+    case V4L2_PIX_FMT_YUV420:   return PX_CAMERA_FORMAT_I420;
+    case V4L2_PIX_FMT_MJPEG:
+    case V4L2_PIX_FMT_JPEG:     return PX_CAMERA_FORMAT_MJPEG;
+    }
+    return PX_CAMERA_FORMAT_NONE;
+}
+
+// A mode along with what it takes to select it on the device
+typedef struct
+{
+    pxCameraMode mode;
+    unsigned int pixelFormat;
+    v4l2_fract interval;        // 0/0 if the device doesn't report rates
+} deviceMode;
+
+static void addRates(int fd, unsigned int pixelFormat, int width, int height,
+                     std::vector<deviceMode>& modes)
+{
+    deviceMode m;
+    m.mode.width = width;
+    m.mode.height = height;
+    m.mode.fps = 0;
+    m.mode.format = toCameraFormat(pixelFormat);
+    m.pixelFormat = pixelFormat;
+    m.interval.numerator = m.interval.denominator = 0;
+
+    v4l2_frmivalenum ival;
+    memset(&ival, 0, sizeof(ival));
+    ival.pixel_format = pixelFormat;
+    ival.width = width;
+    ival.height = height;
+
+    bool found = false;
+    while (xioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &ival) == 0)
+    {
+        // Continuous and stepwise ranges are reported by their fastest rate
+        v4l2_fract f = (ival.type == V4L2_FRMIVAL_TYPE_DISCRETE)?
+            ival.discrete:ival.stepwise.min;
+        if (f.numerator && f.denominator)
+        {
+            m.interval = f;
+            m.mode.fps = (double)f.denominator / f.numerator;
+            modes.push_back(m);
+            found = true;
+        }
+        if (ival.type != V4L2_FRMIVAL_TYPE_DISCRETE)
+            break;
+        ival.index++;
+    }
+
+    if (!found)
+        modes.push_back(m);
+}
+
+// Lists every size, rate and format the device supports.  Devices that
+// support a range of sizes are listed by the largest and smallest size
+// and the size closest to hint.
+static void enumModes(int fd, const pxCameraModeRequest* hint,
+                      std::vector<deviceMode>& modes)
+{
+    v4l2_fmtdesc desc;
+    memset(&desc, 0, sizeof(desc));
+    desc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    for (; xioctl(fd, VIDIOC_ENUM_FMT, &desc) == 0; desc.index++)
+    {
+        if (toCameraFormat(desc.pixelformat) == PX_CAMERA_FORMAT_NONE)
+            continue;
+
+        v4l2_frmsizeenum size;
+        memset(&size, 0, sizeof(size));
+        size.pixel_format = desc.pixelformat;
+
+        if (xioctl(fd, VIDIOC_ENUM_FRAMESIZES, &size) < 0)
+        {
+            // Ask the driver what it would do with the hint
+            v4l2_format fmt;
+            memset(&fmt, 0, sizeof(fmt));
+            fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            fmt.fmt.pix.width = (hint && hint->width)?hint->width:640;
+            fmt.fmt.pix.height = (hint && hint->height)?hint->height:480;
+            fmt.fmt.pix.pixelformat = desc.pixelformat;
+            fmt.fmt.pix.field = V4L2_FIELD_NONE;
+            if (xioctl(fd, VIDIOC_TRY_FMT, &fmt) == 0 &&
+                fmt.fmt.pix.pixelformat == desc.pixelformat)
+                addRates(fd, desc.pixelformat, fmt.fmt.pix.width,
+                         fmt.fmt.pix.height, modes);
+        }
+        else if (size.type == V4L2_FRMSIZE_TYPE_DISCRETE)
+        {
+            do
+            {
+                addRates(fd, desc.pixelformat, size.discrete.width,
+                         size.discrete.height, modes);
+                size.index++;
+            } while (xioctl(fd, VIDIOC_ENUM_FRAMESIZES, &size) == 0);
+        }
+        else
+        {
+            v4l2_frmsize_stepwise& r = size.stepwise;
+            addRates(fd, desc.pixelformat, r.max_width, r.max_height, modes);
+            addRates(fd, desc.pixelformat, r.min_width, r.min_height, modes);
+            if (hint && hint->width && hint->height)
+            {
+                // Round up to the next supported size
+                unsigned int w = pxClamp<unsigned int>(hint->width, r.min_width, r.max_width);
+                unsigned int h = pxClamp<unsigned int>(hint->height, r.min_height, r.max_height);
+                if (r.step_width > 1)
+                    w = pxMin<unsigned int>(r.min_width + (w - r.min_width + r.step_width - 1)
+                                            / r.step_width * r.step_width, r.max_width);
+                if (r.step_height > 1)
+                    h = pxMin<unsigned int>(r.min_height + (h - r.min_height + r.step_height - 1)
+                                            / r.step_height * r.step_height, r.max_height);
+                addRates(fd, desc.pixelformat, w, h, modes);
+            }
+        }
+    }
+}
+
+pxCameras::pxCameras()
+{
+    mIndex = 0;
+}
+
+pxCameras::~pxCameras()
+{
+    term();
+}
+
+pxError pxCameras::init()
+{
+    return reset();
+}
+
+pxError pxCameras::term()
+{
+    return PX_OK;
+}
+
+pxError pxCameras::reset()
+{
+    mIndex = 0;
+    return PX_OK;
+}
+
+bool pxCameras::next(pxCamera& camera)
+{
+    while (mIndex < PX_MAX_VIDEO_DEVICES)
+    {
+        char path[32];
+        sprintf(path, "/dev/video%d", mIndex++);
+        if (PX_OK == camera.init(path))
+            return true;
+    }
+
+    // Virtual cameras are enumerated after all of the devices
+    std::string id;
+    while (pxCameraVirtualSource(mIndex - PX_MAX_VIDEO_DEVICES, id))
+    {
+        mIndex++;
+        if (PX_OK == camera.init((char*)id.c_str()))
+            return true;
+    }
+    return false;
+}
+
+pxCamera::pxCamera()
+{
+    mName = NULL;
+    mId = NULL;
+    mFd = -1;
+    mNegotiated = false;
+    mConvert = true;
+    mPixelFormat = 0;
+    mIntervalNumerator = mIntervalDenominator = 0;
+    mWidth = mHeight = mStride = 0;
+    mBuffers = NULL;
+    mCapturing = false;
+    mCallback = NULL;
+    mVirtual = NULL;
+}
+
+pxCamera::~pxCamera()
+{
+    term();
+}
+
+pxError pxCamera::init(char* id)
+{
+    term();
+
+    if (pxCameraVirtual::isVirtualId(id))
+    {
+        mVirtual = new pxCameraVirtual;
+        if (mVirtual->init(id) != PX_OK)
+        {
+            delete mVirtual;
+            mVirtual = NULL;
+            return PX_FAIL;
+        }
+        mName = strdup(mVirtual->name());
+        mId = strdup(id);
+        return PX_OK;
+    }
+
+    int fd = gOps->open(id, O_RDWR|O_NONBLOCK);
+    if (fd < 0)
+        return PX_FAIL;
+
+    v4l2_capability cap;
+    memset(&cap, 0, sizeof(cap));
+    if (xioctl(fd, VIDIOC_QUERYCAP, &cap) < 0)
+    {
+        gOps->close(fd);
+        return PX_FAIL;
+    }
+
+    unsigned int caps = (cap.capabilities & V4L2_CAP_DEVICE_CAPS)?
+        cap.device_caps:cap.capabilities;
+
+    // Metadata and output nodes show up as /dev/video* too
+    if (!(caps & V4L2_CAP_VIDEO_CAPTURE) || !(caps & V4L2_CAP_STREAMING))
+    {
+        gOps->close(fd);
+        return PX_FAIL;
+    }
+
+    mFd = fd;
+    mName = strdup((char*)cap.card);
+    mId = strdup(id);
+
+    return PX_OK;
+}
+
+pxError pxCamera::term()
+{
+    stopCapture();
+    mNegotiated = false;
+    if (mVirtual)
+    {
+        delete mVirtual;
+        mVirtual = NULL;
+    }
+    if (mFd >= 0)
+    {
+        gOps->close(mFd);
+        mFd = -1;
+    }
+    if (mName)
+    {
+        free(mName);
+        mName = NULL;
+    }
+    if (mId)
+    {
+        free(mId);
+        mId = NULL;
+    }
+
+    return PX_OK;
+}
+
+pxCamera::operator bool()
+{
+    return mFd >= 0 || mVirtual;
+}
+
+// Returns an opaque unique identifier for a camera
+char* pxCamera::id()
+{
+    return mId;
+}
+
+// Returns a human readable name for the camera
+char* pxCamera::name()
+{
+    return mName;
+}
+
+// pxCameraFrameNative
+
+void pxCameraFrameNative::useConverted()
+{
+    setFormat(PX_CAMERA_FORMAT_RGB32, mConverted.stride() * mConverted.height());
+    setBase(mConverted.base());
+    setWidth(mConverted.width());
+    setHeight(mConverted.height());
+    setStride(mConverted.stride());
+    setUpsideDown(mConverted.upsideDown());
+}
+
+void pxCameraFrameNative::deliver(pxICameraCapture* callback, double timestamp,
+                                  unsigned int sequence)
+{
+    mTimestamp = timestamp;
+    mSequence = sequence;
+
+    // Released again in recycle
+    mSource->AddRef();
+
+    AddRef();
+    callback->onCameraFrame(this);
+    Release();
+}
+
+void pxCameraFrameNative::recycle()
+{
+    // Releasing the source can destroy this frame
+    pxCameraFrameSource* source = mSource;
+    source->recycle(mIndex);
+    source->Release();
+}
+
+// pxCameraFrameSource
+
+pxCameraFrameSource::pxCameraFrameSource(int frameCount)
+{
+    mRefCount = 1;
+    mFrameCount = frameCount;
+    mFrames = new pxCameraFrameNative[frameCount];
+    for (int i = 0; i < frameCount; i++)
+    {
+        mFrames[i].mSource = this;
+        mFrames[i].mIndex = i;
+    }
+}
+
+pxCameraFrameSource::~pxCameraFrameSource()
+{
+    delete [] mFrames;
+}
+
+unsigned long pxCameraFrameSource::AddRef()
+{
+    return pxAtomicIncrement(&mRefCount);
+}
+
+unsigned long pxCameraFrameSource::Release()
+{
+    long r = pxAtomicDecrement(&mRefCount);
+    if (r == 0)
+        delete this;
+    return r;
+}
+
+pxCameraFrameNative* pxCameraFrameSource::freeFrame()
+{
+    // Only the capture thread hands out frames so a frame that
+    // isn't referenced can't become referenced behind our back
+    for (int i = 0; i < mFrameCount; i++)
+    {
+        if (!mFrames[i].inUse())
+            return &mFrames[i];
+    }
+    return NULL;
+}
+
+// The driver's streaming buffers.  A buffer is queued back to the driver
+// when the frame wrapping it is released, for as long as the camera is
+// still streaming.
+class pxCameraBufferSet: public pxCameraFrameSource
+{
+public:
+    pxCameraBufferSet(int fd, int count): pxCameraFrameSource(count)
+    {
+        mFd = fd;
+        mStreaming = false;
+        mMappings = (mapping*)calloc(count, sizeof(mapping));
+        pthread_mutex_init(&mMutex, NULL);
+    }
+
+    virtual ~pxCameraBufferSet()
+    {
+        for (int i = 0; i < mFrameCount; i++)
+        {
+            if (mMappings[i].start)
+                gOps->munmap(mMappings[i].start, mMappings[i].length);
+        }
+        free(mMappings);
+        pthread_mutex_destroy(&mMutex);
+    }
+
+    pxError map(int index, size_t length, off_t offset)
+    {
+        void* p = gOps->mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_SHARED,
+                             mFd, offset);
+        if (p == MAP_FAILED)
+            return PX_FAIL;
+        mMappings[index].start = p;
+        mMappings[index].length = length;
+        return PX_OK;
+    }
+
+    void* start(int index) { return mMappings[index].start; }
+
+    void setStreaming(bool streaming)
+    {
+        pthread_mutex_lock(&mMutex);
+        mStreaming = streaming;
+        pthread_mutex_unlock(&mMutex);
+    }
+
+    pxError queue(int index)
+    {
+        v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = index;
+        return (xioctl(mFd, VIDIOC_QBUF, &buf) < 0)?PX_FAIL:PX_OK;
+    }
+
+protected:
+    void recycle(int index)
+    {
+        // Frames can be released on any thread and after the camera
+        // has stopped (and possibly closed the device)
+        pthread_mutex_lock(&mMutex);
+        if (mStreaming)
+            queue(index);
+        pthread_mutex_unlock(&mMutex);
+    }
+
+    typedef struct
+    {
+        void* start;
+        size_t length;
+    } mapping;
+
+    int mFd;
+    bool mStreaming;
+    mapping* mMappings;
+    pthread_mutex_t mMutex;
+};
+
+pxError pxCameraNative::mapBuffers()
+{
+    v4l2_requestbuffers req;
+    memset(&req, 0, sizeof(req));
+    req.count = PX_CAPTURE_BUFFERS;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+
+    // Fails with EBUSY if frames from a previous capture are still held
+    if (xioctl(mFd, VIDIOC_REQBUFS, &req) < 0 || req.count < 2)
+        return PX_FAIL;
+
+    mBuffers = new pxCameraBufferSet(mFd, req.count);
+
+    for (int i = 0; i < (int)req.count; i++)
+    {
+        v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+
+        if (xioctl(mFd, VIDIOC_QUERYBUF, &buf) < 0)
+            return PX_FAIL;
+
+        if (mBuffers->map(i, buf.length, buf.m.offset) != PX_OK)
+            return PX_FAIL;
+
+        pxCameraFrameNative* f = mBuffers->frame(i);
+        if (!mConvert || mMode.format == PX_CAMERA_FORMAT_RGB32)
+        {
+            // Frames point straight into the driver's buffer
+            f->setFormat(mMode.format, mStride * mHeight);
+            f->setBase(mBuffers->start(i));
+            f->setWidth(mWidth);
+            f->setHeight(mHeight);
+            f->setStride(mStride);
+            f->setUpsideDown(false);
+        }
+        else
+        {
+            if (f->converted().init(mWidth, mHeight) != PX_OK)
+                return PX_FAIL;
+            f->useConverted();
+        }
+
+        if (mBuffers->queue(i) != PX_OK)
+            return PX_FAIL;
+    }
+
+    mBuffers->setStreaming(true);
+
+    return PX_OK;
+}
+
+void pxCameraNative::unmapBuffers()
+{
+    if (!mBuffers)
+        return;
+
+    // Frames released from now on are not queued again
+    mBuffers->setStreaming(false);
+
+    int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    xioctl(mFd, VIDIOC_STREAMOFF, &type);
+
+    // Outstanding frames keep the buffers mapped until they are released
+    if (mBuffers->Release() == 0)
+    {
+        // Hand the buffers back to the driver
+        v4l2_requestbuffers req;
+        memset(&req, 0, sizeof(req));
+        req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        req.memory = V4L2_MEMORY_MMAP;
+        xioctl(mFd, VIDIOC_REQBUFS, &req);
+    }
+    mBuffers = NULL;
+}
+
+void pxCameraNative::convertFrame(const unsigned char* src, pxBuffer& dst)
+{
+    // Planar formats have their planes back to back, the chroma planes
+    // of I420 have half the stride of the y plane
+    const unsigned char* chroma = src + mStride * mHeight;
+    int chromaStride = mStride/2;
+
+    switch(mMode.format)
+    {
+    case PX_CAMERA_FORMAT_YUY2:
+        pxConvertYUY2(src, mStride, dst);
+        break;
+    case PX_CAMERA_FORMAT_UYVY:
+        pxConvertUYVY(src, mStride, dst);
+        break;
+    case PX_CAMERA_FORMAT_NV12:
+        pxConvertNV12(src, mStride, chroma, mStride, dst);
+        break;
+    case PX_CAMERA_FORMAT_I420:
+        pxConvertI420(src, mStride, chroma, chromaStride,
+                      chroma + chromaStride * ((mHeight+1)/2), chromaStride, dst);
+        break;
+    default:
+        break;
+    }
+}
+
+void pxCameraNative::captureLoop()
+{
+    while (mCapturing)
+    {
+        struct pollfd fd;
+        fd.fd = mFd;
+        fd.events = POLLIN;
+        fd.revents = 0;
+
+        // Time out periodically so that stopCapture is noticed
+        int r = gOps->poll(&fd, 1, 100);
+        if (r < 0 && errno != EINTR)
+            break;
+        if (r <= 0)
+            continue;
+
+        v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+
+        if (xioctl(mFd, VIDIOC_DQBUF, &buf) < 0)
+        {
+            if (errno == EAGAIN)
+                continue;
+            break;
+        }
+
+        if ((int)buf.index >= mBuffers->frameCount())
+            continue;
+
+        pxCameraFrameNative* f = mBuffers->frame(buf.index);
+        if (!mConvert || mMode.format == PX_CAMERA_FORMAT_RGB32)
+            f->setFormat(mMode.format, buf.bytesused);
+        else
+            convertFrame((const unsigned char*)mBuffers->start(buf.index), f->converted());
+
+        double timestamp = buf.timestamp.tv_sec * 1000.0 + 
+            buf.timestamp.tv_usec / 1000.0;
+
+        // The buffer is queued again when the last reference to
+        // the frame is released
+        f->deliver(mCallback, timestamp, buf.sequence);
+    }
+}
+
+void* pxCameraNative::captureThread(void* p)
+{
+    ((pxCameraNative*)p)->captureLoop();
+    return NULL;
+}
+
+// This method will start capturing and callback the
+// provided callback object for each frame
+pxError pxCamera::startCapture(pxICameraCapture* callback)
+{
+    if (mVirtual)
+        return mVirtual->startCapture(callback);
+
+    if (mFd < 0 || !callback)
+        return PX_FAIL;
+
+    stopCapture();
+
+    if (!mNegotiated)
+    {
+        pxCameraModeRequest request;
+        pxCameraMode chosen;
+        bool converting;
+        if (negotiate(request, chosen, converting) != PX_OK)
+            return PX_FAIL;
+    }
+
+    v4l2_format fmt;
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    fmt.fmt.pix.width = mMode.width;
+    fmt.fmt.pix.height = mMode.height;
+    fmt.fmt.pix.pixelformat = mPixelFormat;
+    fmt.fmt.pix.field = V4L2_FIELD_NONE;
+
+    // The driver adjusts the size to the closest one it supports
+    if (xioctl(mFd, VIDIOC_S_FMT, &fmt) < 0 || fmt.fmt.pix.pixelformat != mPixelFormat)
+        return PX_FAIL;
+
+    mWidth = fmt.fmt.pix.width;
+    mHeight = fmt.fmt.pix.height;
+    mStride = fmt.fmt.pix.bytesperline;
+    if (!mStride && mMode.format == PX_CAMERA_FORMAT_RGB32)
+        mStride = mWidth * 4;
+    else if (!mStride && mMode.format != PX_CAMERA_FORMAT_MJPEG)
+        mStride = mWidth * ((mMode.format == PX_CAMERA_FORMAT_RGB24)?3:
+                            (mMode.format == PX_CAMERA_FORMAT_YUY2 ||
+                             mMode.format == PX_CAMERA_FORMAT_UYVY)?2:1);
+
+    if (mIntervalNumerator && mIntervalDenominator)
+    {
+        // Not every driver lets the rate be set
+        v4l2_streamparm parm;
+        memset(&parm, 0, sizeof(parm));
+        parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        parm.parm.capture.timeperframe.numerator = mIntervalNumerator;
+        parm.parm.capture.timeperframe.denominator = mIntervalDenominator;
+        xioctl(mFd, VIDIOC_S_PARM, &parm);
+    }
+
+    if (mapBuffers() != PX_OK)
+    {
+        unmapBuffers();
+        return PX_FAIL;
+    }
+
+    int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(mFd, VIDIOC_STREAMON, &type) < 0)
+    {
+        unmapBuffers();
+        return PX_FAIL;
+    }
+
+    mCallback = callback;
+    mCapturing = true;
+    if (pthread_create(&mThread, NULL, captureThread, (pxCameraNative*)this))
+    {
+        mCapturing = false;
+        unmapBuffers();
+        return PX_FAIL;
+    }
+
+    return PX_OK;
+}
+
+pxError pxCamera::stopCapture()
+{
+    if (mVirtual)
+        return mVirtual->stopCapture();
+
+    if (mCapturing)
+    {
+        mCapturing = false;
+        pthread_join(mThread, NULL);
+
+        unmapBuffers();
+        mCallback = NULL;
+    }
+    return PX_OK;
+}
+
+int pxCamera::modes(pxCameraMode* modes, int maxModes)
+{
+    if (mVirtual)
+    {
+        if (maxModes > 0)
+            mVirtual->mode(modes[0]);
+        return 1;
+    }
+
+    if (mFd < 0)
+        return 0;
+
+    std::vector<deviceMode> m;
+    enumModes(mFd, NULL, m);
+    for (int i = 0; i < maxModes && i < (int)m.size(); i++)
+        modes[i] = m[i].mode;
+    return m.size();
+}
+
+pxError pxCamera::negotiate(const pxCameraModeRequest& request, pxCameraMode& chosen,
+                            bool& converting)
+{
+    if (mVirtual)
+        return mVirtual->negotiate(request, chosen, converting);
+
+    if (mFd < 0)
+        return PX_FAIL;
+
+    // The format can't change while buffers are allocated
+    if (mCapturing)
+        return PX_FAIL;
+
+    std::vector<deviceMode> m;
+    enumModes(mFd, &request, m);
+
+    std::vector<pxCameraMode> candidates;
+    for (unsigned int i = 0; i < m.size(); i++)
+        candidates.push_back(m[i].mode);
+
+    int best = candidates.empty()?-1:pxCameraChooseMode(&candidates[0],
+        candidates.size(), request, gConvertible,
+        sizeof(gConvertible)/sizeof(gConvertible[0]));
+    if (best < 0)
+        return PX_FAIL;
+
+    mMode = m[best].mode;
+    mPixelFormat = m[best].pixelFormat;
+    mIntervalNumerator = m[best].interval.numerator;
+    mIntervalDenominator = m[best].interval.denominator;
+    mConvert = request.convert;
+    mNegotiated = true;
+
+    chosen = mMode;
+    converting = mConvert && mMode.format != PX_CAMERA_FORMAT_RGB32;
+
+    return PX_OK;
+}
@@ -0,0 +1,141 @@
+// pxCamera Copyright 2007-2008 John Robinson
+// pxCameraNative.h
+
+#include <pthread.h>
+#include <poll.h>
+#include <sys/types.h>
+
+#include "pxOffscreen.h"
+
+class pxICameraCapture;
+class pxCameraFrameSource;
+
+// A frame slot owned by a pxCameraFrameSource
+class pxCameraFrameNative: public pxCameraFrame
+{
+public:
+    pxCameraFrameNative(): mSource(NULL), mIndex(0) {}
+
+    bool inUse() const { return mRefCount != 0; }
+
+    // Offscreen for frames that need to be converted to pxPixel
+    pxOffscreen& converted() { return mConverted; }
+
+    // Points the frame at the converted offscreen
+    void useConverted();
+
+    void setFormat(pxCameraFormat format, unsigned int size)
+    {
+        mFormat = format;
+        mSize = size;
+    }
+
+    // Hands the frame to the callback and drops the capture
+    // thread's reference
+    void deliver(pxICameraCapture* callback, double timestamp,
+                 unsigned int sequence);
+
+protected:
+    friend class pxCameraFrameSource;
+
+    void recycle();
+
+    pxCameraFrameSource* mSource;
+    int mIndex;
+    pxOffscreen mConverted;
+};
+
+// Owns the memory that delivered frames point into.  The camera and every
+// outstanding frame hold a reference so the memory stays valid until the
+// last frame is released, even after capture has been stopped.
+class pxCameraFrameSource
+{
+public:
+    pxCameraFrameSource(int frameCount);
+    virtual ~pxCameraFrameSource();
+
+    unsigned long AddRef();
+    unsigned long Release();
+
+    int frameCount() const { return mFrameCount; }
+    pxCameraFrameNative* frame(int index) { return &mFrames[index]; }
+
+    // Returns a frame that nobody holds a reference to or NULL
+    pxCameraFrameNative* freeFrame();
+
+protected:
+    friend class pxCameraFrameNative;
+
+    // Called when the last reference to a frame goes away
+    virtual void recycle(int index) {}
+
+    volatile long mRefCount;
+    pxCameraFrameNative* mFrames;
+    int mFrameCount;
+};
+
+#include "pxCameraVirtual.h"
+
+// The video4linux2 backend talks to the device exclusively through this
+// table.  Installing a different table with pxCameraSetDeviceOps lets
+// the backend be driven by an in-process stand-in for a /dev/video node
+// so that it can be exercised without any capture hardware.
+typedef struct
+{
+    int (*open)(const char* path, int flags);
+    int (*close)(int fd);
+    int (*ioctl)(int fd, unsigned long request, void* arg);
+    void* (*mmap)(void* addr, size_t length, int prot, int flags, int fd,
+                  off_t offset);
+    int (*munmap)(void* addr, size_t length);
+    int (*poll)(struct pollfd* fds, nfds_t nfds, int timeout);
+} pxCameraDeviceOps;
+
+// Passing NULL restores the default table which uses the real system calls
+void pxCameraSetDeviceOps(const pxCameraDeviceOps* ops);
+
+class pxCamerasNative
+{
+protected:
+    int mIndex;
+};
+
+class pxCameraBufferSet;
+
+class pxCameraNative
+{
+protected:
+    static void* captureThread(void* p);
+    void captureLoop();
+    void convertFrame(const unsigned char* src, pxBuffer& dst);
+
+    pxError mapBuffers();
+    void unmapBuffers();
+
+    char* mId;
+    char* mName;
+    int mFd;
+
+    // Mode picked by negotiate
+    bool mNegotiated;
+    pxCameraMode mMode;
+    bool mConvert;
+    unsigned int mPixelFormat;
+    unsigned int mIntervalNumerator;
+    unsigned int mIntervalDenominator;
+
+    // Format the driver settled on in startCapture
+    int mWidth;
+    int mHeight;
+    int mStride;
+
+    // The driver's streaming buffers
+    pxCameraBufferSet* mBuffers;
+
+    pthread_t mThread;
+    volatile bool mCapturing;
+    pxICameraCapture* mCallback;
+
+    // Non NULL if this camera is a synthetic or replay source
+    pxCameraVirtual* mVirtual;
+};
@@ -0,0 +1,552 @@
+// pxCamera Copyright 2007-2008 John Robinson
+// pxCameraVirtual.cpp
+
+#include "pxCamera.h"
+#include "pxCameraVirtual.h"
+#include "pxColorConvert.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+// Number of frames that can be held by consumers at once
+#define PX_VIRTUAL_FRAMES   4
+
+// The memory frames point into.  Outlives the camera if
+// frames are still being held.
+class pxCameraVirtualData: public pxCameraFrameSource
+{
+public:
+    pxCameraVirtualData(): pxCameraFrameSource(PX_VIRTUAL_FRAMES)
+    {
+        file = NULL;
+        fileSize = 0;
+    }
+
+    virtual ~pxCameraVirtualData()
+    {
+        if (file)
+            munmap(file, fileSize);
+    }
+
+    // Replay sources
+    unsigned char* file;
+    size_t fileSize;
+
+    // Synthetic sources render a pattern twice as wide as the frame
+    // once and scroll a window across it
+    pxOffscreen pattern;
+};
+
+// Sources registered with pxCameraAddVirtualSource
+static std::vector<std::string> gSources;
+static bool gSourcesInitialized = false;
+static pthread_mutex_t gSourcesMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void initSources()
+{
+    if (gSourcesInitialized)
+        return;
+    gSourcesInitialized = true;
+
+    const char* env = getenv("PX_VIRTUAL_CAMERAS");
+    while (env && *env)
+    {
+        const char* end = strchr(env, ';');
+        size_t len = end?(size_t)(end-env):strlen(env);
+        if (len)
+            gSources.push_back(std::string(env, len));
+        env = end?end+1:NULL;
+    }
+}
+
+void pxCameraAddVirtualSource(const char* id)
+{
+    pthread_mutex_lock(&gSourcesMutex);
+    initSources();
+    gSources.push_back(id);
+    pthread_mutex_unlock(&gSourcesMutex);
+}
+
+// Returns false once index runs past the registered sources
+bool pxCameraVirtualSource(int index, std::string& id)
+{
+    bool found = false;
+    pthread_mutex_lock(&gSourcesMutex);
+    initSources();
+    if (index >= 0 && index < (int)gSources.size())
+    {
+        id = gSources[index];
+        found = true;
+    }
+    pthread_mutex_unlock(&gSourcesMutex);
+    return found;
+}
+
+pxCameraVirtual::pxCameraVirtual()
+{
+    mType = synthetic;
+    mFormat = bgra;
+    mConvert = true;
+    mWidth = mHeight = 0;
+    mFPS = 0;
+    mName[0] = 0;
+    mData = NULL;
+    mFrameOffsets = NULL;
+    mFrameCount = 0;
+    mCapturing = false;
+    mCallback = NULL;
+}
+
+pxCameraVirtual::~pxCameraVirtual()
+{
+    term();
+}
+
+bool pxCameraVirtual::isVirtualId(const char* id)
+{
+    return id && (!strncmp(id, "synthetic:", 10) || !strncmp(id, "y4m:", 4) ||
+                  !strncmp(id, "raw:", 4));
+}
+
+// Parses WIDTHxHEIGHT@FPS
+pxError pxCameraVirtual::parseSize(const char* s, const char** end)
+{
+    char* e;
+    mWidth = strtol(s, &e, 10);
+    if (*e != 'x')
+        return PX_FAIL;
+    mHeight = strtol(e+1, &e, 10);
+    if (*e != '@')
+        return PX_FAIL;
+    mFPS = strtod(e+1, &e);
+    if (end)
+        *end = e;
+
+    // 4:2:x formats need even sizes
+    if (mWidth <= 0 || mHeight <= 0 || (mWidth & 1) || (mHeight & 1) ||
+        mFPS <= 0)
+        return PX_FAIL;
+    return PX_OK;
+}
+
+pxError pxCameraVirtual::init(const char* id)
+{
+    term();
+
+    pxError e = PX_FAIL;
+
+    mData = new pxCameraVirtualData;
+
+    if (!strncmp(id, "synthetic:", 10))
+    {
+        mType = synthetic;
+        mFormat = bgra;
+        const char* end;
+        if (parseSize(id+10, &end) == PX_OK && *end == 0)
+        {
+            initPattern();
+            snprintf(mName, sizeof(mName), "Synthetic %dx%d@%g", mWidth,
+                     mHeight, mFPS);
+            e = PX_OK;
+        }
+    }
+    else if (!strncmp(id, "y4m:", 4))
+    {
+        mType = y4m;
+        mFormat = i420;
+        if (mapFile(id+4) == PX_OK && initY4M() == PX_OK)
+        {
+            snprintf(mName, sizeof(mName), "Replay %s", id+4);
+            e = PX_OK;
+        }
+    }
+    else if (!strncmp(id, "raw:", 4))
+    {
+        mType = raw;
+        e = initRaw(id+4);
+    }
+
+    if (e != PX_OK)
+        term();
+
+    return e;
+}
+
+pxError pxCameraVirtual::term()
+{
+    stopCapture();
+
+    // Frames that are still held keep the data alive
+    if (mData)
+    {
+        mData->Release();
+        mData = NULL;
+    }
+
+    delete [] mFrameOffsets;
+    mFrameOffsets = NULL;
+    mFrameCount = 0;
+    mConvert = true;
+
+    mName[0] = 0;
+
+    return PX_OK;
+}
+
+pxError pxCameraVirtual::mapFile(const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return PX_FAIL;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0)
+    {
+        close(fd);
+        return PX_FAIL;
+    }
+
+    void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (p == MAP_FAILED)
+        return PX_FAIL;
+
+    // Frames are read front to back
+    madvise(p, st.st_size, MADV_SEQUENTIAL);
+
+    mData->file = (unsigned char*)p;
+    mData->fileSize = st.st_size;
+
+    return PX_OK;
+}
+
+// Finds the end of the line starting at offset or returns 0
+static size_t lineEnd(const unsigned char* p, size_t size, size_t offset)
+{
+    const void* nl = memchr(p+offset, '\n', size-offset);
+    return nl?(const unsigned char*)nl-p:0;
+}
+
+pxError pxCameraVirtual::initY4M()
+{
+    size_t end = lineEnd(mData->file, mData->fileSize, 0);
+    if (!end || mData->fileSize < 10 || memcmp(mData->file, "YUV4MPEG2 ", 10))
+        return PX_FAIL;
+
+    std::string header((const char*)mData->file, end);
+
+    int fpsNum = 30, fpsDen = 1;
+    size_t pos = 9;
+    while (pos < header.size())
+    {
+        size_t next = header.find(' ', pos+1);
+        if (next == std::string::npos)
+            next = header.size();
+        std::string tag = header.substr(pos+1, next-pos-1);
+        if (!tag.empty())
+        {
+            switch(tag[0])
+            {
+            case 'W': mWidth = atoi(tag.c_str()+1);
+                break;
+            case 'H': mHeight = atoi(tag.c_str()+1);
+                break;
+            case 'F': sscanf(tag.c_str()+1, "%d:%d", &fpsNum, &fpsDen);
+                break;
+            case 'C':
+                // Only 4:2:0 is supported
+                if (tag.compare(1, 3, "420"))
+                    return PX_FAIL;
+                break;
+            }
+        }
+        pos = next;
+    }
+
+    if (mWidth <= 0 || mHeight <= 0 || (mWidth & 1) || (mHeight & 1) ||
+        fpsNum <= 0 || fpsDen <= 0)
+        return PX_FAIL;
+
+    mFPS = (double)fpsNum/fpsDen;
+
+    size_t frameSize = (size_t)mWidth * mHeight * 3 / 2;
+
+    // Every frame has its own (possibly parameterized) FRAME header
+    std::vector<size_t> offsets;
+    size_t offset = end+1;
+    while (offset + 5 < mData->fileSize && !memcmp(mData->file+offset, "FRAME", 5))
+    {
+        size_t headerEnd = lineEnd(mData->file, mData->fileSize, offset);
+        if (!headerEnd || headerEnd+1+frameSize > mData->fileSize)
+            break;
+        offsets.push_back(headerEnd+1);
+        offset = headerEnd+1+frameSize;
+    }
+
+    if (offsets.empty())
+        return PX_FAIL;
+
+    mFrameCount = offsets.size();
+    mFrameOffsets = new size_t[mFrameCount];
+    for (unsigned int i = 0; i < mFrameCount; i++)
+        mFrameOffsets[i] = offsets[i];
+
+    return PX_OK;
+}
+
+pxError pxCameraVirtual::initRaw(const char* s)
+{
+    const char* p;
+    if (parseSize(s, &p) != PX_OK || *p != ':')
+        return PX_FAIL;
+    p++;
+
+    size_t frameSize;
+    if (!strncmp(p, "bgra:", 5))
+    {
+        mFormat = bgra;
+        frameSize = (size_t)mWidth * mHeight * 4;
+    }
+    else if (!strncmp(p, "yuyv:", 5))
+    {
+        mFormat = yuyv;
+        frameSize = (size_t)mWidth * mHeight * 2;
+    }
+    else if (!strncmp(p, "i420:", 5))
+    {
+        mFormat = i420;
+        frameSize = (size_t)mWidth * mHeight * 3 / 2;
+    }
+    else
+        return PX_FAIL;
+
+    const char* path = p+5;
+    if (mapFile(path) != PX_OK)
+        return PX_FAIL;
+
+    mFrameCount = mData->fileSize / frameSize;
+    if (!mFrameCount)
+        return PX_FAIL;
+
+    mFrameOffsets = new size_t[mFrameCount];
+    for (unsigned int i = 0; i < mFrameCount; i++)
+        mFrameOffsets[i] = i * frameSize;
+
+    snprintf(mName, sizeof(mName), "Replay %s", path);
+
+    return PX_OK;
+}
+
+void pxCameraVirtual::mode(pxCameraMode& m) const
+{
+    static const pxCameraFormat formats[] =
+    {
+        PX_CAMERA_FORMAT_RGB32, PX_CAMERA_FORMAT_YUY2, PX_CAMERA_FORMAT_I420
+    };
+
+    m.width = mWidth;
+    m.height = mHeight;
+    m.fps = mFPS;
+    m.format = formats[mFormat];
+}
+
+pxError pxCameraVirtual::negotiate(const pxCameraModeRequest& request,
+                                   pxCameraMode& chosen, bool& converting)
+{
+    // Every format a virtual camera replays can be converted
+    static const pxCameraFormat convertible[] =
+    {
+        PX_CAMERA_FORMAT_RGB32, PX_CAMERA_FORMAT_YUY2, PX_CAMERA_FORMAT_I420
+    };
+
+    if (!mName[0] || mCapturing)
+        return PX_FAIL;
+
+    pxCameraMode m;
+    mode(m);
+    if (pxCameraChooseMode(&m, 1, request, convertible,
+                           sizeof(convertible)/sizeof(convertible[0])) < 0)
+        return PX_FAIL;
+
+    mConvert = request.convert;
+    chosen = m;
+    converting = mConvert && mFormat != bgra;
+
+    return PX_OK;
+}
+
+void pxCameraVirtual::initPattern()
+{
+    // Vertical color bars with a horizontal gradient, repeated so that
+    // any window of mWidth columns is a seamless frame
+    static const pxColor bars[] =
+    {
+        pxColor(192, 192, 192), pxColor(192, 192, 0), pxColor(0, 192, 192),
+        pxColor(0, 192, 0), pxColor(192, 0, 192), pxColor(192, 0, 0),
+        pxColor(0, 0, 192), pxColor(16, 16, 16)
+    };
+    const int barCount = sizeof(bars)/sizeof(bars[0]);
+
+    pxOffscreen& pattern = mData->pattern;
+    pattern.init(mWidth*2, mHeight);
+    for (int y = 0; y < mHeight; y++)
+    {
+        pxPixel* p = pattern.scanline(y);
+        int shade = (y * 255) / mHeight;
+        for (int x = 0; x < mWidth*2; x++)
+        {
+            const pxColor& c = bars[((x % mWidth) * barCount) / mWidth];
+            p->r = (c.r * (255-shade) + shade * 255) / 255;
+            p->g = c.g;
+            p->b = (c.b * shade) / 255;
+            p->a = 255;
+            p++;
+        }
+    }
+}
+
+void pxCameraVirtual::deliverFrame(unsigned int frame, double timestamp)
+{
+    // Drop the frame if the consumers are holding on to all of them
+    pxCameraFrameNative* f = mData->freeFrame();
+    if (!f)
+        return;
+
+    if (mType == synthetic)
+    {
+        // Scroll across the pattern a few pixels every frame
+        int offset = (frame * 4) % mWidth;
+
+        f->setFormat(PX_CAMERA_FORMAT_RGB32, mData->pattern.stride() * mHeight);
+        f->setBase(mData->pattern.pixel(offset, 0));
+        f->setWidth(mWidth);
+        f->setHeight(mHeight);
+        f->setStride(mData->pattern.stride());
+        f->setUpsideDown(false);
+    }
+    else
+    {
+        const unsigned char* data = mData->file + mFrameOffsets[frame % mFrameCount];
+
+        if (mFormat == bgra || !mConvert)
+        {
+            // Straight out of the mapping
+            pxCameraMode m;
+            mode(m);
+            int stride = (mFormat == bgra)?mWidth*4:(mFormat == yuyv)?mWidth*2:mWidth;
+            f->setFormat(m.format, (mFormat == i420)?mWidth*mHeight*3/2:stride*mHeight);
+            f->setBase((void*)data);
+            f->setWidth(mWidth);
+            f->setHeight(mHeight);
+            f->setStride(stride);
+            f->setUpsideDown(false);
+        }
+        else switch(mFormat)
+        {
+        case bgra:
+            break;
+
+        case yuyv:
+            pxConvertYUY2(data, mWidth*2, f->converted());
+            f->useConverted();
+            break;
+
+        case i420:
+            pxConvertI420(data, mWidth, data + mWidth*mHeight, mWidth/2,
+                          data + mWidth*mHeight*5/4, mWidth/2, f->converted());
+            f->useConverted();
+            break;
+        }
+    }
+
+    f->deliver(mCallback, timestamp, frame);
+}
+
+void pxCameraVirtual::captureLoop()
+{
+    long long period = (long long)(1000000000.0 / mFPS);
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    unsigned int frame = 0;
+    while (mCapturing)
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        deliverFrame(frame++, now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0);
+
+        long long next = deadline.tv_sec * 1000000000LL + deadline.tv_nsec + period;
+
+        // If the consumer is slower than the frame rate don't try to
+        // catch up, just like a camera that drops frames
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long long nowNS = now.tv_sec * 1000000000LL + now.tv_nsec;
+        if (next < nowNS)
+            next = nowNS;
+
+        deadline.tv_sec = next / 1000000000LL;
+        deadline.tv_nsec = next % 1000000000LL;
+
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+        {
+        }
+    }
+}
+
+void* pxCameraVirtual::captureThread(void* p)
+{
+    ((pxCameraVirtual*)p)->captureLoop();
+    return NULL;
+}
+
+pxError pxCameraVirtual::startCapture(pxICameraCapture* callback)
+{
+    if (!mName[0] || !callback)
+        return PX_FAIL;
+
+    stopCapture();
+
+    if (mFormat != bgra && mConvert)
+    {
+        for (int i = 0; i < mData->frameCount(); i++)
+        {
+            pxOffscreen& converted = mData->frame(i)->converted();
+            if (converted.width() != mWidth || converted.height() != mHeight)
+                converted.init(mWidth, mHeight);
+        }
+    }
+
+    mCallback = callback;
+    mCapturing = true;
+    if (pthread_create(&mThread, NULL, captureThread, this))
+    {
+        mCapturing = false;
+        mCallback = NULL;
+        return PX_FAIL;
+    }
+
+    return PX_OK;
+}
+
+pxError pxCameraVirtual::stopCapture()
+{
+    if (mCapturing)
+    {
+        mCapturing = false;
+        pthread_join(mThread, NULL);
+        mCallback = NULL;
+    }
+    return PX_OK;
+}
@@ -0,0 +1,93 @@
+// pxCamera Copyright 2007-2008 John Robinson
+// pxCameraVirtual.h
+
+#ifndef PX_CAMERA_VIRTUAL_H
+#define PX_CAMERA_VIRTUAL_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include <string>
+
+#include "pxOffscreen.h"
+
+class pxICameraCapture;
+class pxCameraVirtualData;
+
+// A camera that doesn't need any hardware.  It either generates a test
+// pattern or replays a file that is mapped into memory.  Frames are
+// delivered on a capture thread at a fixed rate just like a real camera.
+//
+// Virtual cameras are identified by ids of the following forms
+//
+//   synthetic:1280x720@30             generated pattern
+//   y4m:/path/to/clip.y4m             4:2:0 YUV4MPEG2 file
+//   raw:1920x1080@60:yuyv:/path/file  headerless frames in bgra, yuyv
+//                                     or i420 format
+//
+// They can be passed to pxCamera::init directly or registered with
+// pxCameraAddVirtualSource (or the PX_VIRTUAL_CAMERAS environment variable,
+// a ';' separated list of ids) so that pxCameras::next enumerates them
+// after the physical devices.
+class pxCameraVirtual
+{
+public:
+    pxCameraVirtual();
+    ~pxCameraVirtual();
+
+    static bool isVirtualId(const char* id);
+
+    pxError init(const char* id);
+    pxError term();
+
+    const char* name() const { return mName; }
+
+    // Virtual cameras only have the one mode
+    void mode(pxCameraMode& m) const;
+    pxError negotiate(const pxCameraModeRequest& request, pxCameraMode& chosen,
+                      bool& converting);
+
+    pxError startCapture(pxICameraCapture* callback);
+    pxError stopCapture();
+
+private:
+    enum sourceType { synthetic, raw, y4m };
+    enum frameFormat { bgra, yuyv, i420 };
+
+    pxError parseSize(const char* s, const char** end);
+    pxError mapFile(const char* path);
+    pxError initY4M();
+    pxError initRaw(const char* s);
+    void initPattern();
+
+    static void* captureThread(void* p);
+    void captureLoop();
+    void deliverFrame(unsigned int frame, double timestamp);
+
+    sourceType mType;
+    frameFormat mFormat;
+    bool mConvert;
+    int mWidth;
+    int mHeight;
+    double mFPS;
+    char mName[256];
+
+    // Pattern or file mapping and the frames that point into them
+    pxCameraVirtualData* mData;
+
+    // Replay sources
+    size_t* mFrameOffsets;
+    unsigned int mFrameCount;
+
+    pthread_t mThread;
+    volatile bool mCapturing;
+    pxICameraCapture* mCallback;
+};
+
+// Makes a virtual camera visible to pxCameras::next
+void pxCameraAddVirtualSource(const char* id);
+
+// Used by pxCameras::next to walk the registered sources
+bool pxCameraVirtualSource(int index, std::string& id);
+
+#endif
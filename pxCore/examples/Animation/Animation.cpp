@@ -63,7 +63,7 @@ private:
         // When ever the window resizes we (re)allocate a buffer 
         // big enough for the entire client area and draw our 
         // pattern into it
-        mTexture.init(w, h);
+        mTexture.init(w, h, PX_OFFSCREEN_SHARED);
 
         // recalculate how far to step each frame
         gStep = (int)((pxMin<int>(w, h) / (double)gFPS) / (double)gDuration);
@@ -80,6 +80,7 @@ private:
     {
 	    // The background changes each time we call drawBackground
 	    // so just call it whenever the animation time goes off.
+        mTexture.waitForBlits();
         drawBackground(mTexture);
         invalidateRect();
     }
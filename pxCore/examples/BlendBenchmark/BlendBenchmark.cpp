@@ -0,0 +1,227 @@
+// BlendBenchmark Example CopyRight 2007 John Robinson
+// Checks the SIMD compositing kernels against the scalar ones and
+// measures overlaying a 1080p frame
+
+#include "pxCore.h"
+#include "pxOffscreen.h"
+#include "pxCpu.h"
+#include "pxTimer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct
+{
+    const char* name;
+    unsigned int mask;
+} kernel;
+
+const kernel gKernels[] =
+{
+    { "scalar", 0 },
+    { "SSE2", PX_CPU_SSE2 },
+    { "AVX2", PX_CPU_SSE2|PX_CPU_AVX2 },
+};
+const int gKernelCount = sizeof(gKernels)/sizeof(gKernels[0]);
+
+bool available(const kernel& k)
+{
+    pxCpuSetFeatureMask(~0U);
+    return (pxCpuFeatures() & k.mask) == k.mask;
+}
+
+// Random pixels with runs of transparent and opaque ones so that the
+// fast paths get exercised next to pixels that need blending
+void randomize(pxBuffer& b, bool premultiplied)
+{
+    for (int y = 0; y < b.height(); y++)
+    {
+        pxPixel* p = b.scanline(y);
+        for (int x = 0; x < b.width(); x++)
+        {
+            int kind = (x / 5 + y) % 3;
+            unsigned int a = kind == 0?0:(kind == 1?255:rand() & 0xff);
+            p[x].r = rand();
+            p[x].g = rand();
+            p[x].b = rand();
+            p[x].a = a;
+            if (premultiplied)
+            {
+                p[x].r = p[x].r * a / 255;
+                p[x].g = p[x].g * a / 255;
+                p[x].b = p[x].b * a / 255;
+                if (kind == 0 && (rand() & 1))
+                    p[x].u = 0;
+            }
+        }
+    }
+}
+
+bool sameBuffers(pxBuffer& a, pxBuffer& b)
+{
+    for (int y = 0; y < a.height(); y++)
+    {
+        for (int x = 0; x < a.width(); x++)
+        {
+            if (a.pixel(x, y)->u != b.pixel(x, y)->u)
+                return false;
+        }
+    }
+    return true;
+}
+
+bool checkValues()
+{
+    // Half transparent white over opaque black
+    pxOffscreen s, d;
+    s.initWithColor(1, 1, pxColor(255, 255, 255, 128));
+    d.initWithColor(1, 1, pxColor(0, 0, 0, 255));
+    s.blend(d, 0, 0, 1, 1, 0, 0);
+    pxPixel* p = d.pixel(0, 0);
+    bool ok = p->r == 128 && p->g == 128 && p->b == 128 && p->a == 255;
+
+    // Half transparent premultiplied white over opaque red at half again
+    s.fill(pxColor(128, 128, 128, 128));
+    d.fill(pxColor(255, 0, 0, 255));
+    s.blendPremultiplied(d, 0, 0, 1, 1, 0, 0, 128);
+    // s becomes 64 and d is scaled by 1-64/255
+    ok = ok && p->r == 255 && p->g == 64 && p->b == 64 && p->a == 255;
+
+    return ok;
+}
+
+bool checkKernels()
+{
+    bool ok = true;
+    srand(1);
+
+    for (int test = 0; test < 400; test++)
+    {
+        bool premultiplied = (test & 1) != 0;
+        int w = 1 + rand() % 70;
+        int h = 1 + rand() % 6;
+        unsigned char alpha = (test & 2)?255:rand();
+
+        pxOffscreen src, dst, reference;
+        src.init(w, h);
+        dst.init(w + 3, h + 2);
+        reference.init(w + 3, h + 2);
+        randomize(src, premultiplied);
+        randomize(dst, premultiplied);
+        dst.blit(reference);
+
+        int dx = rand() % 5 - 1;
+        int dy = rand() % 4 - 1;
+
+        pxCpuSetFeatureMask(0);
+        if (premultiplied)
+            src.blendPremultiplied(reference, dx, dy, w, h, 0, 0, alpha);
+        else
+            src.blend(reference, dx, dy, w, h, 0, 0, alpha);
+
+        for (int k = 1; k < gKernelCount; k++)
+        {
+            if (!available(gKernels[k]))
+                continue;
+            pxCpuSetFeatureMask(gKernels[k].mask);
+
+            pxOffscreen b;
+            b.init(w + 3, h + 2);
+            dst.blit(b);
+
+            if (premultiplied)
+                src.blendPremultiplied(b, dx, dy, w, h, 0, 0, alpha);
+            else
+                src.blend(b, dx, dy, w, h, 0, 0, alpha);
+
+            if (!sameBuffers(b, reference))
+            {
+                printf("FAIL %s %s %dx%d alpha %d\n", gKernels[k].name,
+                       premultiplied?"premultiplied":"straight", w, h, alpha);
+                ok = false;
+            }
+        }
+    }
+
+    pxCpuSetFeatureMask(~0U);
+    return ok;
+}
+
+// Returns blends per second
+double run(pxBuffer& src, pxBuffer& dst, bool premultiplied, unsigned char alpha)
+{
+    int count = 0;
+    double start = pxMilliseconds();
+    double end;
+    do
+    {
+        if (premultiplied)
+            src.blendPremultiplied(dst, 0, 0, src.width(), src.height(), 0, 0, alpha);
+        else
+            src.blend(dst, 0, 0, src.width(), src.height(), 0, 0, alpha);
+        count++;
+        end = pxMilliseconds();
+    } while (end - start < 300);
+
+    return count * 1000.0 / (end - start);
+}
+
+void benchmark(const char* name, pxBuffer& src, pxBuffer& dst, 
+               bool premultiplied, unsigned char alpha)
+{
+    printf("%-32s", name);
+    for (int k = 0; k < gKernelCount; k++)
+    {
+        if (!available(gKernels[k]))
+        {
+            printf("%12s", "n/a");
+            continue;
+        }
+        pxCpuSetFeatureMask(gKernels[k].mask);
+        double rate = run(src, dst, premultiplied, alpha);
+        printf("%8.2f ms", 1000.0 / rate);
+    }
+    printf("\n");
+    pxCpuSetFeatureMask(~0U);
+}
+
+int pxMain()
+{
+    bool ok = checkValues();
+    printf("Known values: %s\n", ok?"ok":"FAIL");
+    bool kernels = checkKernels();
+    printf("SIMD kernels match the scalar kernels: %s\n\n", kernels?"yes":"NO");
+    ok = ok && kernels;
+
+    printf("1920x1080 overlay, time per frame\n");
+    printf("%-32s", "");
+    for (int k = 0; k < gKernelCount; k++)
+        printf("%12s", gKernels[k].name);
+    printf("\n");
+
+    pxOffscreen video;
+    video.initWithColor(1920, 1080, pxGray);
+
+    // Analytics style overlay, mostly empty with some boxes and labels
+    pxOffscreen overlay;
+    overlay.initWithColor(1920, 1080, pxColor(0, 0, 0, 0));
+    for (int i = 0; i < 20; i++)
+    {
+        int x = (i * 397) % 1700, y = (i * 211) % 900;
+        overlay.fill(pxRect(x, y, x+200, y+150), pxColor(0, 255, 0, 96));
+        overlay.fill(pxRect(x, y, x+200, y+20), pxColor(0, 0, 0, 255));
+    }
+    benchmark("mostly transparent", overlay, video, false, 255);
+    benchmark("mostly transparent, alpha 128", overlay, video, false, 128);
+
+    pxOffscreen translucent;
+    translucent.initWithColor(1920, 1080, pxColor(255, 0, 0, 100));
+    benchmark("all translucent", translucent, video, false, 255);
+    benchmark("all translucent, premultiplied", translucent, video, true, 255);
+
+    pxOffscreen opaque;
+    opaque.initWithColor(1920, 1080, pxColor(0, 0, 255, 255));
+    benchmark("all opaque", opaque, video, false, 255);
+
+    return ok?0:1;
+}
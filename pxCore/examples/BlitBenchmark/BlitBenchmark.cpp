@@ -0,0 +1,141 @@
+// BlitBenchmark Example CopyRight 2007 John Robinson
+// Measures the cost of blitting a 1080p pxBuffer to an X11 drawable
+// using each of the paths available in pxBuffer::blit, then reads
+// the drawable back to check the bottom-up path flipped every row
+
+// Run it with PX_NO_SHM set to compare against the non shared
+// memory path
+
+#include "pxCore.h"
+#include "pxOffscreen.h"
+#include "pxTimer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+const int gWidth = 1920;
+const int gHeight = 1080;
+const int gFrames = 100;
+
+// This is what pxBuffer::blit used to do for bottom-up buffers.
+// Allocate a temporary, flip the pixels into it and send that.
+void legacyFlippedBlit(pxBuffer& b, pxSurfaceNative s)
+{
+    pxOffscreen flipped;
+    flipped.init(b.width(), b.height());
+
+    for (int y = 0; y < flipped.height(); y++)
+        memcpy((void*)flipped.scanline(y), b.scanline(y), b.width()*4);
+
+    flipped.blit(s);
+}
+
+// Each row of the bottom-up frame gets its own color so a band sent in
+// the wrong place or order shows up
+unsigned int rowColor(int y)
+{
+    return ((y * 2654435761u) >> 8) & 0xffff00;
+}
+
+// Reads back what the last blit of b left in the drawable
+bool checkFlipped(pxBuffer& b, pxSurfaceNative s)
+{
+    XImage* image = XGetImage(s->display, s->drawable, 0, 0, b.width(),
+                              b.height(), AllPlanes, ZPixmap);
+    if (!image)
+        return false;
+
+    bool ok = true;
+    for (int y = 0; y < b.height() && ok; y++)
+        for (int x = 0; x < b.width() && ok; x++)
+            ok = (XGetPixel(image, x, y) & 0xffffff) ==
+                (*(unsigned int*)b.pixel(x, y) & 0xffffff);
+
+    XDestroyImage(image);
+    return ok;
+}
+
+void report(const char* name, double start, double end)
+{
+    double ms = (end-start)/gFrames;
+    printf("%-28s %8.3fms/frame %8.1f fps\n", name, ms, 1000.0/ms);
+}
+
+int pxMain()
+{
+    displayRef d;
+    Display* display = d.getDisplay();
+    if (!display)
+    {
+        printf("Can't open the X display, nothing was measured\n");
+        return 1;
+    }
+
+    int scr = DefaultScreen(display);
+    Pixmap pixmap = XCreatePixmap(display, RootWindow(display, scr), 
+                                  gWidth, gHeight, 24);
+
+    pxSurfaceNativeDesc s;
+    s.display = display;
+    s.drawable = pixmap;
+    s.gc = XCreateGC(display, pixmap, 0, NULL);
+
+    // Allocated after the display is open so that it can use MIT-SHM
+    pxOffscreen offscreen;
+    offscreen.initWithColor(gWidth, gHeight, pxGray, PX_OFFSCREEN_SHARED);
+
+    // A bottom-up frame like the ones delivered by pxCamera
+    unsigned char* frameData = new unsigned char[gWidth*gHeight*4];
+    for (int y = 0; y < gHeight; y++)
+        for (int x = 0; x < gWidth; x++)
+            ((unsigned int*)frameData)[y*gWidth+x] = rowColor(y) ^ x;
+    pxBuffer frame;
+    frame.setBase(frameData);
+    frame.setWidth(gWidth);
+    frame.setHeight(gHeight);
+    frame.setStride(gWidth*4);
+    frame.setUpsideDown(true);
+
+    printf("%dx%d, %d frames, MIT-SHM offscreen: %s\n\n", gWidth, gHeight, 
+           gFrames, offscreen.shared()?"yes":"no");
+
+    double start, end;
+
+    start = pxMilliseconds();
+    for (int i = 0; i < gFrames; i++)
+    {
+        offscreen.blit(&s);
+        XSync(display, False);
+    }
+    end = pxMilliseconds();
+    report("offscreen blit", start, end);
+
+    start = pxMilliseconds();
+    for (int i = 0; i < gFrames; i++)
+    {
+        legacyFlippedBlit(frame, &s);
+        XSync(display, False);
+    }
+    end = pxMilliseconds();
+    report("upside down (flip copy)", start, end);
+
+    start = pxMilliseconds();
+    for (int i = 0; i < gFrames; i++)
+    {
+        frame.blit(&s);
+        XSync(display, False);
+    }
+    end = pxMilliseconds();
+    report("upside down (bands)", start, end);
+
+    bool ok = checkFlipped(frame, &s);
+    printf("\nBottom-up blit %s\n", ok?"matches the buffer":
+           "FAILED: pixels differ from the buffer");
+
+    offscreen.term();
+    delete [] frameData;
+    XFreeGC(display, s.gc);
+    XFreePixmap(display, pixmap);
+
+    return ok?0:1;
+}
@@ -0,0 +1,236 @@
+// BufferBlitBenchmark Example CopyRight 2007 John Robinson
+// Checks pxBuffer to pxBuffer blits against a pixel at a time reference
+// for every placement of small buffers and measures typical copies
+
+#include "pxCore.h"
+#include "pxOffscreen.h"
+#include "pxTimer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// This is what pxBuffer::blit(pxBuffer&...) used to do.  It ignores the
+// left edge of both rectangles.
+void legacyBlit(pxBuffer& src, pxBuffer& b, int dstLeft, int dstTop, 
+                int dstWidth, int dstHeight, int srcLeft, int srcTop)
+{
+    pxRect srcBounds = src.bounds();
+    pxRect dstBounds = b.bounds();
+
+    pxRect srcRect(srcLeft, srcTop, srcLeft+dstWidth, srcTop+dstHeight);
+    pxRect dstRect(dstLeft, dstTop, dstLeft+dstWidth, dstTop+dstHeight);
+
+    srcBounds.intersect(srcRect);
+    dstBounds.intersect(dstRect);
+
+    int w = pxMin<int>(srcBounds.width(), dstBounds.width());
+    int h = pxMin<int>(srcBounds.height(), dstBounds.height());
+
+    for (int y = 0; y < h; y++)
+    {
+        pxPixel *s = src.scanline(y+srcBounds.top());
+        pxPixel *se = s + w;
+        pxPixel *d = b.scanline(y+dstBounds.top());
+        while(s < se)
+        {
+            *d++ = *s++;
+        }
+    }
+}
+
+// Pixel (srcLeft+x, srcTop+y) goes to (dstLeft+x, dstTop+y) whenever
+// both are inside their buffers
+void referenceBlit(pxBuffer& src, pxBuffer& b, int dstLeft, int dstTop, 
+                   int dstWidth, int dstHeight, int srcLeft, int srcTop)
+{
+    for (int y = 0; y < dstHeight; y++)
+    {
+        for (int x = 0; x < dstWidth; x++)
+        {
+            int sx = srcLeft + x, sy = srcTop + y;
+            int dx = dstLeft + x, dy = dstTop + y;
+            if (sx >= 0 && sy >= 0 && sx < src.width() && sy < src.height() &&
+                dx >= 0 && dy >= 0 && dx < b.width() && dy < b.height())
+                *b.pixel(dx, dy) = *src.pixel(sx, sy);
+        }
+    }
+}
+
+// A small buffer inside a larger allocation so that writes past its
+// edges show up
+const int gMaxPixels = 64;
+
+class testBuffer: public pxBuffer
+{
+public:
+    void init(int width, int height, int pad, bool upsideDown, unsigned int seed)
+    {
+        for (int i = 0; i < gMaxPixels; i++)
+            mData[i].u = (seed + i) * 2654435761U;
+        setBase(mData + width + pad + 1);
+        setWidth(width);
+        setHeight(height);
+        setStride((width+pad)*4);
+        setUpsideDown(upsideDown);
+    }
+
+    bool same(const testBuffer& b) const
+    {
+        return memcmp(mData, b.mData, sizeof(mData)) == 0;
+    }
+
+private:
+    pxPixel mData[gMaxPixels];
+};
+
+const int gRange = 4;
+const int gMaxSize = 6;
+
+bool checkClipping()
+{
+    int blits = 0;
+    int failures = 0;
+
+    // Every combination of orientation, with and without row padding.
+    // Full width blits between unpadded buffers take the single copy path.
+    for (int config = 0; config < 16; config++)
+    {
+        bool srcUpsideDown = (config & 1) != 0;
+        bool dstUpsideDown = (config & 2) != 0;
+        int srcPad = (config & 4)?2:0;
+        int dstPad = (config & 8)?1:0;
+
+        testBuffer src, dst, expected;
+        src.init(4, 3, srcPad, srcUpsideDown, 1000);
+
+        for (int srcTop = -gRange; srcTop <= gRange; srcTop++)
+        for (int srcLeft = -gRange; srcLeft <= gRange; srcLeft++)
+        for (int dstTop = -gRange; dstTop <= gRange; dstTop++)
+        for (int dstLeft = -gRange; dstLeft <= gRange; dstLeft++)
+        for (int h = 0; h <= gMaxSize; h++)
+        for (int w = 0; w <= gMaxSize; w++)
+        {
+            dst.init(4, 3, dstPad, dstUpsideDown, 0);
+            expected.init(4, 3, dstPad, dstUpsideDown, 0);
+
+            src.blit(dst, dstLeft, dstTop, w, h, srcLeft, srcTop);
+            referenceBlit(src, expected, dstLeft, dstTop, w, h, srcLeft, srcTop);
+            blits++;
+
+            if (!dst.same(expected))
+            {
+                if (failures++ < 10)
+                    printf("FAIL config %d: %dx%d from %d,%d to %d,%d\n", 
+                           config, w, h, srcLeft, srcTop, dstLeft, dstTop);
+            }
+        }
+    }
+
+    // Scrolling within a buffer, where the rows overlap
+    for (int config = 0; config < 4; config++)
+    {
+        bool upsideDown = (config & 1) != 0;
+        int pad = (config & 2)?1:0;
+
+        for (int dy = -3; dy <= 3; dy++)
+        for (int dx = -3; dx <= 3; dx++)
+        {
+            testBuffer buffer, copy, expected;
+            buffer.init(5, 4, pad, upsideDown, 7);
+            copy.init(5, 4, pad, upsideDown, 7);
+            expected.init(5, 4, pad, upsideDown, 7);
+
+            buffer.blit(buffer, dx, dy, 5, 4, 0, 0);
+            referenceBlit(copy, expected, dx, dy, 5, 4, 0, 0);
+            blits++;
+
+            if (!buffer.same(expected))
+            {
+                if (failures++ < 10)
+                    printf("FAIL scroll by %d,%d%s%s\n", dx, dy,
+                           upsideDown?" upside down":"", pad?" padded":"");
+            }
+        }
+    }
+
+    printf("%d blits checked, %d failures\n", blits, failures);
+    return failures == 0;
+}
+
+// Returns blits per second
+double run(pxBuffer& src, pxBuffer& dst, const pxRect& r, int dstLeft, 
+           int dstTop, bool legacy)
+{
+    int count = 0;
+    double start = pxMilliseconds();
+    double end;
+    do
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            if (legacy)
+                legacyBlit(src, dst, dstLeft, dstTop, r.width(), r.height(), 
+                           r.left(), r.top());
+            else
+                src.blit(dst, dstLeft, dstTop, r.width(), r.height(), 
+                         r.left(), r.top());
+        }
+        count += 16;
+        end = pxMilliseconds();
+    } while (end - start < 300);
+
+    return count * 1000.0 / (end - start);
+}
+
+void benchmark(const char* name, pxBuffer& src, pxBuffer& dst, 
+               const pxRect& r, int dstLeft, int dstTop)
+{
+    double bytes = (double)r.width() * r.height() * 4;
+    double legacy = run(src, dst, r, dstLeft, dstTop, true);
+    double blit = run(src, dst, r, dstLeft, dstTop, false);
+    printf("%-32s %9.2f GB/s %9.2f GB/s %7.1fx\n", name, 
+           legacy * bytes / 1e9, blit * bytes / 1e9, blit / legacy);
+}
+
+int pxMain()
+{
+    bool ok = checkClipping();
+    printf("\n%-32s %14s %14s\n", "", "legacy", "blit");
+
+    pxOffscreen hd, hd2;
+    hd.initWithColor(1920, 1080, pxGray);
+    hd2.init(1920, 1080);
+
+    // A padded destination so every row is copied on its own
+    pxBuffer padded;
+    unsigned char* paddedData = new unsigned char[2048*1080*4];
+    padded.setBase(paddedData);
+    padded.setWidth(1920);
+    padded.setHeight(1080);
+    padded.setStride(2048*4);
+    padded.setUpsideDown(false);
+
+    // A bottom-up frame like the ones delivered by pxCamera
+    pxBuffer frame;
+    unsigned char* frameData = new unsigned char[1920*1080*4];
+    memset(frameData, 0x80, 1920*1080*4);
+    frame.setBase(frameData);
+    frame.setWidth(1920);
+    frame.setHeight(1080);
+    frame.setStride(1920*4);
+    frame.setUpsideDown(true);
+
+    pxOffscreen sprite;
+    sprite.initWithColor(64, 64, pxRed);
+
+    benchmark("1920x1080 same layout", hd, hd2, hd.bounds(), 0, 0);
+    benchmark("1920x1080 to padded", hd, padded, hd.bounds(), 0, 0);
+    benchmark("1920x1080 bottom-up frame", frame, hd2, frame.bounds(), 0, 0);
+    benchmark("256x256 rect", hd, hd2, pxRect(100, 100, 356, 356), 300, 200);
+    benchmark("64x64 sprite", sprite, hd2, sprite.bounds(), 501, 301);
+
+    delete [] paddedData;
+    delete [] frameData;
+
+    return ok?0:1;
+}
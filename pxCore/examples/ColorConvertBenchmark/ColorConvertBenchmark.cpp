@@ -0,0 +1,272 @@
+// ColorConvertBenchmark Example CopyRight 2007 John Robinson
+// Checks the SIMD YUV to pxPixel kernels against the scalar ones and
+// measures the throughput of each of them
+
+#include "pxCore.h"
+#include "pxOffscreen.h"
+#include "pxColorConvert.h"
+#include "pxCpu.h"
+#include "pxTimer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum format { yuy2, uyvy, nv12, i420, formatCount };
+
+const char* gFormatNames[] = { "YUY2", "UYVY", "NV12", "I420" };
+
+typedef struct
+{
+    const char* name;
+    unsigned int mask;
+} kernel;
+
+const kernel gKernels[] =
+{
+    { "scalar", 0 },
+    { "SSE2", PX_CPU_SSE2 },
+    { "AVX2", PX_CPU_SSE2|PX_CPU_AVX2 },
+};
+const int gKernelCount = sizeof(gKernels)/sizeof(gKernels[0]);
+
+// A source frame with some padding at the end of each row
+class yuvFrame
+{
+public:
+    yuvFrame(format f, int width, int height): mFormat(f)
+    {
+        int cw = (width+1)/2;
+        int ch = (height+1)/2;
+        int pad = 24;
+
+        if (f == yuy2 || f == uyvy)
+        {
+            mStrides[0] = cw*4 + pad;
+            mSizes[0] = mStrides[0] * height;
+            mSizes[1] = mSizes[2] = 0;
+        }
+        else
+        {
+            mStrides[0] = width + pad;
+            mSizes[0] = mStrides[0] * height;
+            mStrides[1] = (f == nv12)?cw*2 + pad:cw + pad;
+            mSizes[1] = mStrides[1] * ch;
+            mStrides[2] = cw + pad;
+            mSizes[2] = (f == i420)?mStrides[2] * ch:0;
+        }
+
+        mData = new unsigned char[mSizes[0] + mSizes[1] + mSizes[2]];
+        for (int i = 0; i < mSizes[0] + mSizes[1] + mSizes[2]; i++)
+            mData[i] = rand();
+
+        mPlanes[0] = mData;
+        mPlanes[1] = mData + mSizes[0];
+        mPlanes[2] = mPlanes[1] + mSizes[1];
+    }
+
+    ~yuvFrame()
+    {
+        delete [] mData;
+    }
+
+    // Bytes of actual pixel data
+    double bytes(int width, int height) const
+    {
+        if (mFormat == yuy2 || mFormat == uyvy)
+            return (double)width * height * 2;
+        return (double)width * height * 1.5;
+    }
+
+    void convert(pxBuffer& dst) const
+    {
+        switch(mFormat)
+        {
+        case yuy2:
+            pxConvertYUY2(mPlanes[0], mStrides[0], dst);
+            break;
+        case uyvy:
+            pxConvertUYVY(mPlanes[0], mStrides[0], dst);
+            break;
+        case nv12:
+            pxConvertNV12(mPlanes[0], mStrides[0], mPlanes[1], mStrides[1], dst);
+            break;
+        default:
+            pxConvertI420(mPlanes[0], mStrides[0], mPlanes[1], mStrides[1],
+                          mPlanes[2], mStrides[2], dst);
+            break;
+        }
+    }
+
+private:
+    format mFormat;
+    unsigned char* mData;
+    unsigned char* mPlanes[3];
+    int mStrides[3];
+    int mSizes[3];
+};
+
+// A destination with a stride wider than its width and a canary
+// column just past the right edge
+class paddedBuffer: public pxBuffer
+{
+public:
+    paddedBuffer(int width, int height, bool upsideDown)
+    {
+        mData = new pxPixel[(width+3) * height];
+        for (int i = 0; i < (width+3) * height; i++)
+            mData[i].u = 0x12345678;
+        setBase(mData);
+        setWidth(width);
+        setHeight(height);
+        setStride((width+3)*4);
+        setUpsideDown(upsideDown);
+    }
+
+    ~paddedBuffer()
+    {
+        delete [] mData;
+    }
+
+    bool canariesIntact()
+    {
+        for (int y = 0; y < height(); y++)
+        {
+            for (int x = width(); x < width()+3; x++)
+            {
+                if (scanline(y)[x].u != 0x12345678)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // Compares in memory order so that orientation mistakes show up
+    int differences(paddedBuffer& b)
+    {
+        int count = 0;
+        for (int y = 0; y < height(); y++)
+        {
+            for (int x = 0; x < width(); x++)
+            {
+                if (scanline(y)[x].u != b.scanline(y)[x].u)
+                    count++;
+            }
+        }
+        return count;
+    }
+
+private:
+    pxPixel* mData;
+};
+
+bool checkKernels()
+{
+    static const int sizes[][2] =
+    {
+        { 1, 1 }, { 2, 2 }, { 7, 3 }, { 15, 5 }, { 16, 4 }, { 33, 17 },
+        { 637, 479 }, { 1920, 1080 },
+    };
+    bool ok = true;
+
+    for (int f = 0; f < formatCount; f++)
+    {
+        for (unsigned int s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++)
+        {
+            int w = sizes[s][0];
+            int h = sizes[s][1];
+            yuvFrame frame((format)f, w, h);
+
+            for (int upsideDown = 0; upsideDown < 2; upsideDown++)
+            {
+                paddedBuffer reference(w, h, upsideDown != 0);
+                pxCpuSetFeatureMask(0);
+                frame.convert(reference);
+
+                for (int k = 1; k < gKernelCount; k++)
+                {
+                    pxCpuSetFeatureMask(gKernels[k].mask);
+                    if ((pxCpuFeatures() & gKernels[k].mask) != gKernels[k].mask)
+                        continue;
+
+                    paddedBuffer b(w, h, upsideDown != 0);
+                    frame.convert(b);
+
+                    int d = b.differences(reference);
+                    if (d || !b.canariesIntact())
+                    {
+                        printf("FAIL %s %s %dx%d%s: %d pixels differ%s\n",
+                               gFormatNames[f], gKernels[k].name, w, h,
+                               upsideDown?" upside down":"", d,
+                               b.canariesIntact()?"":", wrote past the edge");
+                        ok = false;
+                    }
+                }
+            }
+        }
+    }
+
+    pxCpuSetFeatureMask(~0U);
+    return ok;
+}
+
+void benchmark(int width, int height)
+{
+    printf("\n%dx%d          ", width, height);
+    for (int k = 0; k < gKernelCount; k++)
+        printf("%18s", gKernels[k].name);
+    printf("\n");
+
+    pxOffscreen dst;
+    dst.init(width, height);
+
+    for (int f = 0; f < formatCount; f++)
+    {
+        yuvFrame frame((format)f, width, height);
+        printf("%-6s (MB/s in) ", gFormatNames[f]);
+
+        for (int k = 0; k < gKernelCount; k++)
+        {
+            pxCpuSetFeatureMask(gKernels[k].mask);
+            if ((pxCpuFeatures() & gKernels[k].mask) != gKernels[k].mask)
+            {
+                printf("%18s", "n/a");
+                continue;
+            }
+
+            // Warm up then run for about half a second
+            frame.convert(dst);
+            int frames = 0;
+            double start = pxMilliseconds();
+            double end;
+            do
+            {
+                frame.convert(dst);
+                frames++;
+                end = pxMilliseconds();
+            } while (end - start < 500);
+
+            double mbs = frame.bytes(width, height) * frames / ((end-start) / 1000) / 1e6;
+            printf("%12.1f %4.0ffps", mbs, frames * 1000 / (end-start));
+        }
+        printf("\n");
+    }
+
+    pxCpuSetFeatureMask(~0U);
+}
+
+int pxMain()
+{
+    unsigned int features = pxCpuFeatures();
+    printf("CPU supports:%s%s\n", (features & PX_CPU_SSE2)?" SSE2":"",
+           (features & PX_CPU_AVX2)?" AVX2":"");
+
+    bool ok = checkKernels();
+    printf("SIMD kernels match the scalar kernels: %s\n", ok?"yes":"NO");
+
+    benchmark(640, 480);
+    benchmark(1920, 1080);
+    benchmark(3840, 2160);
+
+    return ok?0:1;
+}
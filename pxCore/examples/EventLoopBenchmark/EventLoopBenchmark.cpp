@@ -0,0 +1,152 @@
+// EventLoopBenchmark Example CopyRight 2007 John Robinson
+// Measures how often the X11 event loop wakes up while idle and
+// how long it takes for an event to reach a pxWindow callback.
+// Needs an X server.
+
+#include "pxCore.h"
+#include "pxEventLoop.h"
+#include "pxWindow.h"
+#include "pxTimer.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+pxEventLoop eventLoop;
+
+const int gIdleSeconds = 2;
+const int gEvents = 100;
+
+volatile double gSendTime = 0;
+double gTotalLatency = 0;
+double gMaxLatency = 0;
+int gReceived = 0;
+
+// pxWindow takes message names and titles as char*
+static char gCountSleeps[] = "countSleeps";
+static char gTitle[] = "EventLoopBenchmark";
+
+class myWindow: public pxWindow
+{
+public:
+    myWindow(): sleeps(0) {}
+
+    Window window() { return win; }
+
+    // Times the event loop's thread has gone to sleep
+    long sleeps;
+
+private:
+    void onSynchronizedMessage(char* messageName, void* p1)
+    {
+        if (!strcmp(messageName, gCountSleeps))
+        {
+            // Only the calling thread's own usage can be read
+            struct rusage usage;
+            getrusage(RUSAGE_THREAD, &usage);
+            sleeps = usage.ru_nvcsw;
+        }
+    }
+
+    void onCloseRequest()
+    {
+        eventLoop.exit();
+    }
+
+    void onKeyDown(int keycode, unsigned long flags)
+    {
+        if (keycode == PX_KEY_ESCAPE)
+        {
+            eventLoop.exit();
+            return;
+        }
+
+        double latency = pxMicroseconds()-gSendTime;
+        gTotalLatency += latency;
+        if (latency > gMaxLatency) gMaxLatency = latency;
+        gReceived++;
+    }
+};
+
+void sendKey(Display* display, Window w, KeySym k)
+{
+    XKeyEvent e;
+    memset(&e, 0, sizeof(e));
+    e.type = KeyPress;
+    e.display = display;
+    e.window = w;
+    e.root = DefaultRootWindow(display);
+    e.keycode = XKeysymToKeycode(display, k);
+    e.same_screen = True;
+    XSendEvent(display, w, True, KeyPressMask, (XEvent*)&e);
+    XFlush(display);
+}
+
+void* driver(void* p)
+{
+    myWindow* w = (myWindow*)p;
+
+    // Separate connection so that this thread doesn't touch the
+    // loop's Display
+    Display* display = XOpenDisplay(NULL);
+    if (!display)
+        return NULL;
+
+    // Let the window settle and then count how often the loop's thread
+    // blocks while nothing is happening.  It blocks once more after the
+    // first count and is woken by the second, which isn't idle.
+    pxSleepMS(500);
+
+    w->sendSynchronizedMessage(gCountSleeps, NULL);
+    long before = w->sleeps;
+    pxSleepMS(gIdleSeconds*1000);
+    w->sendSynchronizedMessage(gCountSleeps, NULL);
+
+    long wakeups = w->sleeps - before - 1;
+    printf("idle wakeups: %.1f/s\n", (double)wakeups/gIdleSeconds);
+
+    for (int i = 0; i < gEvents; i++)
+    {
+        gSendTime = pxMicroseconds();
+        sendKey(display, w->window(), XK_space);
+        pxSleepMS(20);
+    }
+
+    sendKey(display, w->window(), XK_Escape);
+    XCloseDisplay(display);
+
+    return NULL;
+}
+
+int pxMain()
+{
+    Display* display = XOpenDisplay(NULL);
+    if (!display)
+    {
+        printf("Can't open the X display, nothing was measured\n");
+        return 1;
+    }
+    XCloseDisplay(display);
+
+    myWindow win;
+
+    win.init(10, 64, 320, 240);
+    win.setTitle(gTitle);
+    win.setVisibility(true);
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, driver, &win);
+
+    eventLoop.run();
+
+    pthread_join(thread, NULL);
+
+    if (gReceived)
+    {
+        printf("event to callback latency: avg %.1fus max %.1fus (%d events)\n",
+               gTotalLatency/gReceived, gMaxLatency, gReceived);
+    }
+
+    return 0;
+}
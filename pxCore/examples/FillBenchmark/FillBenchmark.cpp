@@ -0,0 +1,223 @@
+// FillBenchmark Example CopyRight 2007 John Robinson
+// Checks the SIMD pxBuffer fills against the scalar ones and measures
+// fills from small rectangles up to 4K surfaces
+
+#include "pxCore.h"
+#include "pxOffscreen.h"
+#include "pxCpu.h"
+#include "pxTimer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct
+{
+    const char* name;
+    unsigned int mask;
+} kernel;
+
+const kernel gKernels[] =
+{
+    { "scalar", 0 },
+    { "SSE2", PX_CPU_SSE2 },
+    { "AVX2", PX_CPU_SSE2|PX_CPU_AVX2 },
+};
+const int gKernelCount = sizeof(gKernels)/sizeof(gKernels[0]);
+
+// This is what pxBuffer::fill used to do
+void legacyFill(pxBuffer& b, const pxRect& r, const pxColor& color)
+{
+    pxRect c = b.bounds();
+    c.intersect(r);
+
+    for (int i = c.top(); i < c.bottom(); i++)
+    {
+        pxPixel *p = b.pixel(c.left(), i);
+        pxPixel *pe = p + c.width();
+        while (p < pe)
+            *p++ = color;
+    }
+}
+
+// A buffer over a larger allocation so that writes outside of it show up
+class testBuffer: public pxBuffer
+{
+public:
+    testBuffer(int width, int height, int pad, bool upsideDown)
+    {
+        mSize = (width+pad) * (height+2) + 1;
+        mData = new pxPixel[mSize];
+        for (int i = 0; i < mSize; i++)
+            mData[i].u = i * 2654435761U;
+        // Start one row in and off 16 byte alignment
+        setBase(mData + width + pad + 1);
+        setWidth(width);
+        setHeight(height);
+        setStride((width+pad)*4);
+        setUpsideDown(upsideDown);
+    }
+
+    ~testBuffer()
+    {
+        delete [] mData;
+    }
+
+    int differences(testBuffer& b)
+    {
+        int count = 0;
+        for (int i = 0; i < mSize; i++)
+        {
+            if (mData[i].u != b.mData[i].u)
+                count++;
+        }
+        return count;
+    }
+
+private:
+    pxPixel* mData;
+    int mSize;
+};
+
+bool checkKernels()
+{
+    bool ok = true;
+    srand(1);
+
+    for (int test = 0; test < 2000; test++)
+    {
+        int w = 1 + rand() % 200;
+        int h = 1 + rand() % 20;
+        int pad = (rand() & 1)?rand() % 9:0;
+        bool upsideDown = (rand() & 1) != 0;
+        pxRect r(rand() % (w+10) - 5, rand() % (h+4) - 2, 0, 0);
+        r.setRight(r.left() + rand() % (w+10));
+        r.setBottom(r.top() + rand() % (h+4));
+        if (rand() % 4 == 0)
+            r = pxRect(0, 0, w, h);
+        pxColor c(rand(), rand(), rand(), rand());
+        unsigned char alpha = rand();
+
+        testBuffer reference(w, h, pad, upsideDown);
+        pxCpuSetFeatureMask(0);
+        reference.fill(r, c);
+        reference.fillAlpha(alpha);
+
+        for (int k = 1; k < gKernelCount; k++)
+        {
+            pxCpuSetFeatureMask(gKernels[k].mask);
+            if ((pxCpuFeatures() & gKernels[k].mask) != gKernels[k].mask)
+                continue;
+
+            testBuffer b(w, h, pad, upsideDown);
+            b.fill(r, c);
+            b.fillAlpha(alpha);
+
+            int d = b.differences(reference);
+            if (d)
+            {
+                printf("FAIL %s %dx%d pad %d%s rect %d,%d %dx%d: %d pixels differ\n",
+                       gKernels[k].name, w, h, pad, upsideDown?" upside down":"",
+                       r.left(), r.top(), r.width(), r.height(), d);
+                ok = false;
+            }
+        }
+    }
+
+    pxCpuSetFeatureMask(~0U);
+    return ok;
+}
+
+enum operation { fillRect, fillAlpha, legacy };
+
+// Returns fills per second
+double run(pxBuffer& b, const pxRect& r, operation op)
+{
+    int count = 0;
+    double start = pxMilliseconds();
+    double end;
+    do
+    {
+        // Enough per round that the timer doesn't dominate small rects
+        for (int i = 0; i < 16; i++)
+        {
+            if (op == fillRect)
+                b.fill(r, pxColor(count, i, 0));
+            else if (op == fillAlpha)
+                b.fillAlpha(count + i);
+            else
+                legacyFill(b, r, pxColor(count, i, 0));
+        }
+        count += 16;
+        end = pxMilliseconds();
+    } while (end - start < 300);
+
+    return count * 1000.0 / (end - start);
+}
+
+void benchmark(const char* name, pxBuffer& b, const pxRect& r, operation op)
+{
+    printf("%-24s", name);
+
+    double bytes = (double)r.width() * r.height() * 4;
+    if (op == fillAlpha)
+        bytes = (double)b.width() * b.height() * 4;
+
+    if (op != fillAlpha)
+    {
+        double rate = run(b, r, legacy);
+        printf("%9.2f GB/s", rate * bytes / 1e9);
+    }
+    else
+        printf("%14s", "");
+
+    for (int k = 0; k < gKernelCount; k++)
+    {
+        pxCpuSetFeatureMask(gKernels[k].mask);
+        if ((pxCpuFeatures() & gKernels[k].mask) != gKernels[k].mask)
+        {
+            printf("%14s", "n/a");
+            continue;
+        }
+        double rate = run(b, r, op);
+        printf("%9.2f GB/s", rate * bytes / 1e9);
+    }
+    printf("\n");
+
+    pxCpuSetFeatureMask(~0U);
+}
+
+int pxMain()
+{
+    bool ok = checkKernels();
+    printf("SIMD fills match the scalar fills: %s\n\n", ok?"yes":"NO");
+
+    printf("%-24s%14s", "", "legacy");
+    for (int k = 0; k < gKernelCount; k++)
+        printf("%14s", gKernels[k].name);
+    printf("\n");
+
+    pxOffscreen hd;
+    hd.init(1920, 1080);
+
+    benchmark("16x16 rect", hd, pxRect(100, 100, 116, 116), fillRect);
+    benchmark("64x64 rect", hd, pxRect(100, 100, 164, 164), fillRect);
+    benchmark("256x256 rect", hd, pxRect(101, 100, 357, 356), fillRect);
+
+    pxOffscreen vga;
+    vga.init(640, 480);
+    benchmark("640x480 fill", vga, vga.bounds(), fillRect);
+    benchmark("640x480 fillAlpha", vga, vga.bounds(), fillAlpha);
+
+    benchmark("1920x1080 fill", hd, hd.bounds(), fillRect);
+    benchmark("1920x1080 fillAlpha", hd, hd.bounds(), fillAlpha);
+
+    // Rows that aren't contiguous
+    benchmark("1900x1080 rect", hd, pxRect(10, 0, 1910, 1080), fillRect);
+
+    pxOffscreen uhd;
+    uhd.init(3840, 2160);
+    benchmark("3840x2160 fill", uhd, uhd.bounds(), fillRect);
+    benchmark("3840x2160 fillAlpha", uhd, uhd.bounds(), fillAlpha);
+
+    return ok?0:1;
+}
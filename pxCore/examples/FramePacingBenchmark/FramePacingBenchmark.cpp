@@ -0,0 +1,174 @@
+// FramePacingBenchmark Example CopyRight 2007 John Robinson
+// Compares the old millisecond animation timer with pxFrameScheduler:
+// the rate actually achieved, how late frames are, several rates sharing
+// one scheduler and what each policy does when frames take too long
+
+#include "pxCore.h"
+#include "pxFrameScheduler.h"
+#include "pxTimer.h"
+
+#include <stdio.h>
+#include <vector>
+
+using namespace std;
+
+const double gSeconds = 2;
+
+// Runs the scheduler the way the event loop does, sleeping until the
+// next deadline and calling everything that is due
+void runScheduler(pxFrameScheduler& s, double seconds)
+{
+    long long end = pxNanoseconds() + (long long)(seconds * PX_NS_PER_SECOND);
+    for (;;)
+    {
+        long long next = s.nextDeadline();
+        if (next < 0 || next > end)
+            break;
+        pxSleepUntil(next);
+        s.run(pxNanoseconds());
+    }
+}
+
+class counter: public pxFrameClient
+{
+public:
+    counter(): mStallEvery(0), mStallNS(0), mExact(true) {}
+
+    // Makes every nth frame take ns to deliver
+    void setStall(int every, long long ns)
+    {
+        mStallEvery = every;
+        mStallNS = ns;
+    }
+
+    void onFrame(const pxFrameInfo& info)
+    {
+        // A second's worth of frames should always span exactly a second
+        if (mTargets.size() >= (size_t)mFPS &&
+            info.frame > (unsigned long long)mFPS)
+        {
+            for (size_t i = 0; i < mTargets.size(); i++)
+            {
+                if (mFrames[i] == info.frame - mFPS &&
+                    info.target - mTargets[i] != PX_NS_PER_SECOND)
+                    mExact = false;
+            }
+            if (mTargets.size() > (size_t)mFPS * 2)
+            {
+                mTargets.erase(mTargets.begin());
+                mFrames.erase(mFrames.begin());
+            }
+        }
+        mTargets.push_back(info.target);
+        mFrames.push_back(info.frame);
+
+        if (mStallEvery && (info.frame % mStallEvery) == 0)
+            pxSleepUntil(pxNanoseconds() + mStallNS);
+    }
+
+    long mFPS;
+    int mStallEvery;
+    long long mStallNS;
+    bool mExact;
+    vector<long long> mTargets;
+    vector<unsigned long long> mFrames;
+};
+
+void printStats(const char* name, pxFrameScheduler& s, counter& c,
+                double seconds)
+{
+    pxFrameStats st;
+    s.stats(&c, st);
+    printf("%-16s %8.2f %8llu %8llu %10.1f %10.1f %10.1f %6s\n", name,
+           st.frames / seconds, st.frames, st.dropped,
+           st.meanJitter / PX_NS_PER_US, st.jitterDeviation / PX_NS_PER_US,
+           (double)st.maxJitter / PX_NS_PER_US, c.mExact?"yes":"NO");
+}
+
+void printHeader()
+{
+    printf("%-16s %8s %8s %8s %10s %10s %10s %6s\n", "", "fps", "frames",
+           "dropped", "mean us", "dev us", "max us", "exact");
+}
+
+// The X11 loop before the scheduler: fire once a whole number of
+// milliseconds has passed since the last frame, then start counting again.
+// Returns how far ahead of the real schedule the last frame was in ms.
+double oldTimer(long fps, double seconds)
+{
+    double start = pxMilliseconds();
+    double last = start;
+    int frames = 0;
+    double ahead = 0;
+    while (pxMilliseconds() - start < seconds * 1000)
+    {
+        double deadline = last + (1000/fps);
+        pxSleepUntil((long long)(deadline * PX_NS_PER_MS));
+        double now = pxMilliseconds();
+        if (now - last >= (1000/fps))
+        {
+            frames++;
+            ahead = start + frames * 1000.0 / fps - now;
+            last = now;
+        }
+    }
+    printf("%-16s %8.2f %8d\n", "old timer", frames / seconds, frames);
+    return ahead;
+}
+
+int pxMain()
+{
+    printf("60fps for %gs, jitter is how late each frame was delivered and\n"
+           "exact checks a second of frames always spans exactly a second\n\n",
+           gSeconds);
+    printHeader();
+    double ahead = oldTimer(60, gSeconds);
+    {
+        pxFrameScheduler s;
+        counter c;
+        c.mFPS = 60;
+        s.schedule(&c, 60);
+        runScheduler(s, gSeconds);
+        printStats("scheduler", s, c, gSeconds);
+    }
+    printf("\nThe old timer ended %.1fms ahead of a true 60fps schedule\n",
+           ahead);
+
+    printf("\nFour rates sharing one scheduler for %gs\n\n", gSeconds);
+    printHeader();
+    {
+        const long rates[] = { 24, 30, 60, 144 };
+        const int count = sizeof(rates)/sizeof(rates[0]);
+        pxFrameScheduler s;
+        counter c[count];
+        for (int i = 0; i < count; i++)
+        {
+            c[i].mFPS = rates[i];
+            s.schedule(&c[i], rates[i]);
+        }
+        runScheduler(s, gSeconds);
+        for (int i = 0; i < count; i++)
+        {
+            char name[32];
+            sprintf(name, "%ldfps", rates[i]);
+            printStats(name, s, c[i], gSeconds);
+        }
+    }
+
+    printf("\n60fps for %gs with every 30th frame taking 50ms\n\n", gSeconds);
+    printHeader();
+    const pxFramePolicy policies[] = { PX_FRAME_DROP, PX_FRAME_CATCHUP };
+    const char* names[] = { "drop", "catch up" };
+    for (int i = 0; i < 2; i++)
+    {
+        pxFrameScheduler s;
+        counter c;
+        c.mFPS = 60;
+        c.setStall(30, 50 * PX_NS_PER_MS);
+        s.schedule(&c, 60, policies[i]);
+        runScheduler(s, gSeconds);
+        printStats(names[i], s, c, gSeconds);
+    }
+
+    return 0;
+}
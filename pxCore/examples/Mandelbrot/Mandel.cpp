@@ -0,0 +1,858 @@
+// Mandelbrot Example CopyRight 2007 John Robinson
+// Renders the mandelbrot set into a pxBuffer a tile at a time
+// on all of the processors.  Also used by MandelbrotBenchmark.
+
+#include "Mandel.h"
+#include "pxAtomic.h"
+#include "pxCpu.h"
+
+#include "pxTimer.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(PX_SIMD_X86)
+#include <immintrin.h>
+#endif
+
+// Pixels are iterated a run of a row at a time into this many counts
+#define MANDEL_RUN 256
+
+// Bits of precision kept between neighbouring pixels beyond the ones
+// that tell them apart, for the error that builds up while iterating.
+// long double has no SIMD kernel and is several times slower than
+// double, so double is kept until the pixels get within a few bits of
+// its epsilon, and differs from long double in only a few pixels there.
+#define MANDEL_FLOAT_GUARD_BITS 8
+#define MANDEL_DOUBLE_GUARD_BITS 3
+
+// Every kernel counts how many steps the pixels from left to right take
+// to escape a radius of 3.0 (or reach maxiter) with
+//
+//     cx = xmin + x * xrange / div
+//
+// and the same operations in the same order, so the SIMD kernels give
+// exactly the same counts as the scalar ones.
+
+typedef void (*floatFunc)(unsigned* counts, int left, int right, float xmin,
+                          float xrange, float div, float cy, unsigned maxiter);
+typedef void (*doubleFunc)(unsigned* counts, int left, int right, double xmin,
+                           double xrange, double div, double cy, unsigned maxiter);
+
+static void escapeFloat(unsigned* counts, int left, int right, float xmin,
+                        float xrange, float div, float cy, unsigned maxiter)
+{
+    for (int ix = left; ix < right; ix++)
+    {
+        float cx = xmin + ix * xrange / div;
+        float x = 0, y = 0, x2 = 0, y2 = 0;
+        unsigned iter = 0;
+        while (iter < maxiter && (x2 + y2) <= 9.0f)
+        {
+            float temp = x2 - y2 + cx;
+            y = 2 * x * y + cy;
+            x = temp;
+            x2 = x * x;
+            y2 = y * y;
+            iter++;
+        }
+        *counts++ = iter;
+    }
+}
+
+static void escapeDouble(unsigned* counts, int left, int right, double xmin,
+                         double xrange, double div, double cy, unsigned maxiter)
+{
+    for (int ix = left; ix < right; ix++)
+    {
+        double cx = xmin + ix * xrange / div;
+        double x = 0, y = 0, x2 = 0, y2 = 0;
+        unsigned iter = 0;
+        while (iter < maxiter && (x2 + y2) <= 9.0)
+        {
+            double temp = x2 - y2 + cx;
+            y = 2 * x * y + cy;
+            x = temp;
+            x2 = x * x;
+            y2 = y * y;
+            iter++;
+        }
+        *counts++ = iter;
+    }
+}
+
+static void escapeLongDouble(unsigned* counts, int left, int right,
+                             long double xmin, long double xrange,
+                             long double div, long double cy, unsigned maxiter)
+{
+    for (int ix = left; ix < right; ix++)
+    {
+        long double cx = xmin + ix * xrange / div;
+        long double x = 0, y = 0, x2 = 0, y2 = 0;
+        unsigned iter = 0;
+        while (iter < maxiter && (x2 + y2) <= 9.0)
+        {
+            long double temp = x2 - y2 + cx;
+            y = 2 * x * y + cy;
+            x = temp;
+            x2 = x * x;
+            y2 = y * y;
+            iter++;
+        }
+        *counts++ = iter;
+    }
+}
+
+#if defined(PX_SIMD_X86)
+
+// The lanes all take a step each time round until every one has escaped.
+// Escaped lanes stop counting but keep iterating harmlessly off to
+// infinity; live is sticky so they can't come back.
+
+PX_TARGET_SSE2 static void escapeFloatSSE2(unsigned* counts, int left, int right,
+                                           float xmin, float xrange, float div,
+                                           float cy, unsigned maxiter)
+{
+    __m128 vxmin = _mm_set1_ps(xmin);
+    __m128 vxrange = _mm_set1_ps(xrange);
+    __m128 vdiv = _mm_set1_ps(div);
+    __m128 vcy = _mm_set1_ps(cy);
+    __m128 two = _mm_set1_ps(2.0f);
+    __m128 nine = _mm_set1_ps(9.0f);
+
+    int ix = left;
+    for (; ix + 4 <= right; ix += 4)
+    {
+        __m128 fx = _mm_cvtepi32_ps(_mm_setr_epi32(ix, ix+1, ix+2, ix+3));
+        __m128 cx = _mm_add_ps(vxmin, _mm_div_ps(_mm_mul_ps(fx, vxrange), vdiv));
+        __m128 x = _mm_setzero_ps(), y = x, x2 = x, y2 = x;
+        __m128 live = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        __m128i count = _mm_setzero_si128();
+
+        for (unsigned i = 0; i < maxiter; i++)
+        {
+            live = _mm_and_ps(live, _mm_cmple_ps(_mm_add_ps(x2, y2), nine));
+            if (!_mm_movemask_ps(live))
+                break;
+            count = _mm_sub_epi32(count, _mm_castps_si128(live));
+
+            __m128 temp = _mm_add_ps(_mm_sub_ps(x2, y2), cx);
+            y = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(two, x), y), vcy);
+            x = temp;
+            x2 = _mm_mul_ps(x, x);
+            y2 = _mm_mul_ps(y, y);
+        }
+        _mm_storeu_si128((__m128i*)counts, count);
+        counts += 4;
+    }
+    escapeFloat(counts, ix, right, xmin, xrange, div, cy, maxiter);
+}
+
+PX_TARGET_SSE2 static void escapeDoubleSSE2(unsigned* counts, int left, int right,
+                                            double xmin, double xrange, double div,
+                                            double cy, unsigned maxiter)
+{
+    __m128d vxmin = _mm_set1_pd(xmin);
+    __m128d vxrange = _mm_set1_pd(xrange);
+    __m128d vdiv = _mm_set1_pd(div);
+    __m128d vcy = _mm_set1_pd(cy);
+    __m128d two = _mm_set1_pd(2.0);
+    __m128d nine = _mm_set1_pd(9.0);
+
+    int ix = left;
+    for (; ix + 2 <= right; ix += 2)
+    {
+        __m128d fx = _mm_cvtepi32_pd(_mm_setr_epi32(ix, ix+1, 0, 0));
+        __m128d cx = _mm_add_pd(vxmin, _mm_div_pd(_mm_mul_pd(fx, vxrange), vdiv));
+        __m128d x = _mm_setzero_pd(), y = x, x2 = x, y2 = x;
+        __m128d live = _mm_castsi128_pd(_mm_set1_epi32(-1));
+        __m128i count = _mm_setzero_si128();
+
+        for (unsigned i = 0; i < maxiter; i++)
+        {
+            live = _mm_and_pd(live, _mm_cmple_pd(_mm_add_pd(x2, y2), nine));
+            if (!_mm_movemask_pd(live))
+                break;
+            count = _mm_sub_epi64(count, _mm_castpd_si128(live));
+
+            __m128d temp = _mm_add_pd(_mm_sub_pd(x2, y2), cx);
+            y = _mm_add_pd(_mm_mul_pd(_mm_mul_pd(two, x), y), vcy);
+            x = temp;
+            x2 = _mm_mul_pd(x, x);
+            y2 = _mm_mul_pd(y, y);
+        }
+        // The counts are in the low halves of the 64 bit lanes
+        counts[0] = (unsigned)_mm_cvtsi128_si32(count);
+        counts[1] = (unsigned)_mm_cvtsi128_si32(_mm_srli_si128(count, 8));
+        counts += 2;
+    }
+    escapeDouble(counts, ix, right, xmin, xrange, div, cy, maxiter);
+}
+
+PX_TARGET_AVX2 static void escapeFloatAVX2(unsigned* counts, int left, int right,
+                                           float xmin, float xrange, float div,
+                                           float cy, unsigned maxiter)
+{
+    __m256 vxmin = _mm256_set1_ps(xmin);
+    __m256 vxrange = _mm256_set1_ps(xrange);
+    __m256 vdiv = _mm256_set1_ps(div);
+    __m256 vcy = _mm256_set1_ps(cy);
+    __m256 two = _mm256_set1_ps(2.0f);
+    __m256 nine = _mm256_set1_ps(9.0f);
+    __m256i step = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    int ix = left;
+    for (; ix + 8 <= right; ix += 8)
+    {
+        __m256 fx = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(ix), step));
+        __m256 cx = _mm256_add_ps(vxmin, _mm256_div_ps(_mm256_mul_ps(fx, vxrange), vdiv));
+        __m256 x = _mm256_setzero_ps(), y = x, x2 = x, y2 = x;
+        __m256 live = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        __m256i count = _mm256_setzero_si256();
+
+        for (unsigned i = 0; i < maxiter; i++)
+        {
+            live = _mm256_and_ps(live, _mm256_cmp_ps(_mm256_add_ps(x2, y2), nine, _CMP_LE_OQ));
+            if (!_mm256_movemask_ps(live))
+                break;
+            count = _mm256_sub_epi32(count, _mm256_castps_si256(live));
+
+            __m256 temp = _mm256_add_ps(_mm256_sub_ps(x2, y2), cx);
+            y = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(two, x), y), vcy);
+            x = temp;
+            x2 = _mm256_mul_ps(x, x);
+            y2 = _mm256_mul_ps(y, y);
+        }
+        _mm256_storeu_si256((__m256i*)counts, count);
+        counts += 8;
+    }
+    escapeFloatSSE2(counts, ix, right, xmin, xrange, div, cy, maxiter);
+}
+
+PX_TARGET_AVX2 static void escapeDoubleAVX2(unsigned* counts, int left, int right,
+                                            double xmin, double xrange, double div,
+                                            double cy, unsigned maxiter)
+{
+    __m256d vxmin = _mm256_set1_pd(xmin);
+    __m256d vxrange = _mm256_set1_pd(xrange);
+    __m256d vdiv = _mm256_set1_pd(div);
+    __m256d vcy = _mm256_set1_pd(cy);
+    __m256d two = _mm256_set1_pd(2.0);
+    __m256d nine = _mm256_set1_pd(9.0);
+
+    int ix = left;
+    for (; ix + 4 <= right; ix += 4)
+    {
+        __m256d fx = _mm256_cvtepi32_pd(_mm_setr_epi32(ix, ix+1, ix+2, ix+3));
+        __m256d cx = _mm256_add_pd(vxmin, _mm256_div_pd(_mm256_mul_pd(fx, vxrange), vdiv));
+        __m256d x = _mm256_setzero_pd(), y = x, x2 = x, y2 = x;
+        __m256d live = _mm256_castsi256_pd(_mm256_set1_epi32(-1));
+        __m256i count = _mm256_setzero_si256();
+
+        for (unsigned i = 0; i < maxiter; i++)
+        {
+            live = _mm256_and_pd(live, _mm256_cmp_pd(_mm256_add_pd(x2, y2), nine, _CMP_LE_OQ));
+            if (!_mm256_movemask_pd(live))
+                break;
+            count = _mm256_sub_epi64(count, _mm256_castpd_si256(live));
+
+            __m256d temp = _mm256_add_pd(_mm256_sub_pd(x2, y2), cx);
+            y = _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(two, x), y), vcy);
+            x = temp;
+            x2 = _mm256_mul_pd(x, x);
+            y2 = _mm256_mul_pd(y, y);
+        }
+        // Gather the low halves of the 64 bit lanes
+        __m256i low = _mm256_permutevar8x32_epi32(count, _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6));
+        _mm_storeu_si128((__m128i*)counts, _mm256_castsi256_si128(low));
+        counts += 4;
+    }
+    escapeDoubleSSE2(counts, ix, right, xmin, xrange, div, cy, maxiter);
+}
+
+#endif
+
+static floatFunc pickFloat()
+{
+#if defined(PX_SIMD_X86)
+    unsigned int features = pxCpuFeatures();
+    if (features & PX_CPU_AVX2)
+        return escapeFloatAVX2;
+    if (features & PX_CPU_SSE2)
+        return escapeFloatSSE2;
+#endif
+    return escapeFloat;
+}
+
+static doubleFunc pickDouble()
+{
+#if defined(PX_SIMD_X86)
+    unsigned int features = pxCpuFeatures();
+    if (features & PX_CPU_AVX2)
+        return escapeDoubleAVX2;
+    if (features & PX_CPU_SSE2)
+        return escapeDoubleSSE2;
+#endif
+    return escapeDouble;
+}
+
+// Rounds towards minus infinity so blocks and tiles left of and above
+// the grid origin line up too
+static int floorDiv(int a, int b)
+{
+    return (a >= 0)?a / b:-((b - 1 - a) / b);
+}
+
+// Select a color based on how many iterations it took to escape
+// the mandelbrot set
+static pxPixel shade(unsigned iter, unsigned maxiter)
+{
+    pxPixel p;
+    if (iter >= maxiter)
+    {
+        p.r = p.b = p.g = 0;
+        p.a = 32;
+    }
+    else
+    {
+        double v = (double)iter/(double)maxiter;
+        p.r = (unsigned char)(255*v);
+        p.b = (unsigned char)(80*(1.0-v));
+        p.g = (unsigned char)(255*(1.0-v));
+        p.a = 255;
+    }
+    return p;
+}
+
+mandelRenderer::mandelRenderer():
+    mXMin(-2), mXMax(1), mYMin(-1.5), mYMax(1.5), mGrid(false),
+    mGridX0(0), mGridY0(0), mSpacing(0), mGridLeft(0), mGridTop(0),
+    mMaxIter(16), mBlock(1), mPrecision(MANDEL_AUTO), mIterations(0)
+{
+}
+
+void mandelRenderer::setView(long double xmin, long double xmax,
+                             long double ymin, long double ymax)
+{
+    mXMin = xmin;
+    mXMax = xmax;
+    mYMin = ymin;
+    mYMax = ymax;
+    mGrid = false;
+}
+
+void mandelRenderer::setGrid(long double x0, long double y0, long double spacing,
+                             int left, int top)
+{
+    mGridX0 = x0;
+    mGridY0 = y0;
+    mSpacing = spacing;
+    mGridLeft = left;
+    mGridTop = top;
+    mGrid = true;
+}
+
+void mandelRenderer::mapping(const pxBuffer& b, long double& x0, long double& xrange,
+                             long double& xdiv, int& left, long double& y0,
+                             long double& yrange, long double& ydiv, int& top) const
+{
+    if (mGrid)
+    {
+        x0 = mGridX0;
+        y0 = mGridY0;
+        xrange = yrange = mSpacing;
+        xdiv = ydiv = 1;
+        left = mGridLeft;
+        top = mGridTop;
+    }
+    else
+    {
+        x0 = mXMin;
+        y0 = mYMin;
+        xrange = mXMax - mXMin;
+        yrange = mYMax - mYMin;
+        xdiv = b.width() - 1;
+        ydiv = b.height() - 1;
+        left = top = 0;
+    }
+}
+
+mandelPrecision mandelRenderer::pickPrecision(int width, int height) const
+{
+    if (mPrecision != MANDEL_AUTO)
+        return mPrecision;
+
+    pxBuffer b;
+    b.setWidth(width);
+    b.setHeight(height);
+    long double x0, xrange, xdiv, y0, yrange, ydiv;
+    int left, top;
+    mapping(b, x0, xrange, xdiv, left, y0, yrange, ydiv, top);
+    xdiv = pxMax<long double>(xdiv, 1);
+    ydiv = pxMax<long double>(ydiv, 1);
+
+    long double spacing = pxMin<long double>(fabsl(xrange / xdiv), fabsl(yrange / ydiv));
+    long double x1 = x0 + (left + width) * xrange / xdiv;
+    long double y1 = y0 + (top + height) * yrange / ydiv;
+    x0 += left * xrange / xdiv;
+    y0 += top * yrange / ydiv;
+
+    // Iterating can take points out to the escape radius of 3
+    long double scale = pxMax<long double>(pxMax<long double>(fabsl(x0), fabsl(x1)),
+                                           pxMax<long double>(fabsl(y0), fabsl(y1)));
+    scale = pxMax<long double>(scale, 3);
+
+    if (spacing <= 0)
+        return MANDEL_LONG_DOUBLE;
+    // Bits needed to tell neighbouring pixels apart
+    int bits = (int)ceill(log2l(scale / spacing));
+    if (bits + MANDEL_FLOAT_GUARD_BITS <= 24)
+        return MANDEL_FLOAT;
+    if (bits + MANDEL_DOUBLE_GUARD_BITS <= 53)
+        return MANDEL_DOUBLE;
+    return MANDEL_LONG_DOUBLE;
+}
+
+void mandelRenderer::renderTile(pxBuffer& b, const pxRect& tile)
+{
+    unsigned maxiter = mMaxIter;
+    int block = mBlock;
+    unsigned counts[MANDEL_RUN];
+    long total = 0;
+
+    long double x0, xrange, xdiv, y0, yrange, ydiv;
+    int left, top;
+    mapping(b, x0, xrange, xdiv, left, y0, yrange, ydiv, top);
+
+    mandelPrecision use = pickPrecision(b.width(), b.height());
+    floatFunc escapeF = pickFloat();
+    doubleFunc escapeD = pickDouble();
+
+    // Blocks are numbered across the whole grid.  Block bx covers pixels
+    // bx * block - left onwards and is iterated at x0 + bx * (block *
+    // xrange) / xdiv, which is just the pixel's own point for blocks of one.
+    int firstBlock = floorDiv(tile.left() + left, block);
+    int lastBlock = floorDiv(tile.right() - 1 + left, block);
+    long double blockRange = xrange * block;
+
+    for (int iy = tile.top(); iy < tile.bottom(); )
+    { 
+        int by = floorDiv(iy + top, block);
+        int rowEnd = pxMin<int>((by + 1) * block - top, tile.bottom());
+
+        for (int run = firstBlock; run <= lastBlock; run += MANDEL_RUN)
+        {
+            int runEnd = pxMin<int>(run + MANDEL_RUN, lastBlock + 1);
+
+            if (use == MANDEL_FLOAT)
+            {
+                float cy = (float)y0 + by * (float)(yrange * block) / (float)ydiv;
+                escapeF(counts, run, runEnd, (float)x0, (float)blockRange,
+                        (float)xdiv, cy, maxiter);
+            }
+            else if (use == MANDEL_DOUBLE)
+            {
+                double cy = (double)y0 + by * (double)(yrange * block) / (double)ydiv;
+                escapeD(counts, run, runEnd, (double)x0, (double)blockRange,
+                        (double)xdiv, cy, maxiter);
+            }
+            else
+            {
+                long double cy = y0 + by * (yrange * block) / ydiv;
+                escapeLongDouble(counts, run, runEnd, x0, blockRange, xdiv, cy, maxiter);
+            }
+
+            for (int i = 0; i < runEnd - run; i++)
+            {
+                total += counts[i];
+                pxPixel c = shade(counts[i], maxiter);
+
+                int from = pxMax<int>((run + i) * block - left, tile.left());
+                int to = pxMin<int>((run + i + 1) * block - left, tile.right());
+                for (int y = iy; y < rowEnd; y++)
+                {
+                    pxPixel* p = b.pixel(from, y);
+                    for (int x = from; x < to; x++)
+                        *p++ = c;
+                }
+            }
+        }
+        iy = rowEnd;
+    }
+
+    pxAtomicAdd(&mIterations, total);
+}
+
+// Finished tiles by view, tile position and maxiter.  When it's full the
+// least recently used tile makes way.
+struct mandelCachedTile
+{
+    long double x0, y0, spacing;
+    unsigned maxiter;
+    int column, row;
+    unsigned lastUsed;
+    pxPixel* pixels;
+    mandelCachedTile* next;
+};
+
+class mandelTileCache
+{
+public:
+    mandelTileCache(): mTiles(NULL), mCount(0), mCapacity(0), mClock(0)
+    {
+        memset(mBuckets, 0, sizeof(mBuckets));
+    }
+
+    ~mandelTileCache()
+    {
+        for (int i = 0; i < mCount; i++)
+            delete [] mTiles[i].pixels;
+        delete [] mTiles;
+    }
+
+    // Only ever grows so that at least the tiles on screen fit
+    void reserve(int capacity)
+    {
+        if (capacity <= mCapacity)
+            return;
+        mandelCachedTile* tiles = new mandelCachedTile[capacity];
+        for (int i = 0; i < mCount; i++)
+            tiles[i] = mTiles[i];
+        delete [] mTiles;
+        mTiles = tiles;
+        mCapacity = capacity;
+        rehash();
+    }
+
+    mandelCachedTile* find(long double x0, long double y0, long double spacing,
+                           unsigned maxiter, int column, int row)
+    {
+        for (mandelCachedTile* t = mBuckets[hash(maxiter, column, row)]; t; t = t->next)
+        {
+            if (t->column == column && t->row == row && t->maxiter == maxiter &&
+                t->x0 == x0 && t->y0 == y0 && t->spacing == spacing)
+            {
+                t->lastUsed = ++mClock;
+                return t;
+            }
+        }
+        return NULL;
+    }
+
+    // Returns the tile to copy the pixels into
+    mandelCachedTile* add(long double x0, long double y0, long double spacing,
+                          unsigned maxiter, int column, int row)
+    {
+        mandelCachedTile* t;
+        if (mCount < mCapacity)
+        {
+            t = &mTiles[mCount++];
+            t->pixels = new pxPixel[MANDEL_TILE * MANDEL_TILE];
+        }
+        else
+        {
+            t = &mTiles[0];
+            for (int i = 1; i < mCount; i++)
+            {
+                if (mTiles[i].lastUsed < t->lastUsed)
+                    t = &mTiles[i];
+            }
+            unlink(t);
+        }
+
+        t->x0 = x0;
+        t->y0 = y0;
+        t->spacing = spacing;
+        t->maxiter = maxiter;
+        t->column = column;
+        t->row = row;
+        t->lastUsed = ++mClock;
+
+        int h = hash(maxiter, column, row);
+        t->next = mBuckets[h];
+        mBuckets[h] = t;
+        return t;
+    }
+
+    // Describes a tile's pixels as a pxBuffer to blit to and from
+    static void wrap(mandelCachedTile* t, pxBuffer& b)
+    {
+        b.setBase(t->pixels);
+        b.setWidth(MANDEL_TILE);
+        b.setHeight(MANDEL_TILE);
+        b.setStride(MANDEL_TILE * sizeof(pxPixel));
+        b.setUpsideDown(false);
+    }
+
+private:
+    enum { buckets = 1024 };
+
+    static int hash(unsigned maxiter, int column, int row)
+    {
+        unsigned h = (unsigned)column * 73856093U ^ (unsigned)row * 19349663U ^ maxiter;
+        return (int)(h % buckets);
+    }
+
+    void unlink(mandelCachedTile* t)
+    {
+        mandelCachedTile** p = &mBuckets[hash(t->maxiter, t->column, t->row)];
+        while (*p != t)
+            p = &(*p)->next;
+        *p = t->next;
+    }
+
+    void rehash()
+    {
+        memset(mBuckets, 0, sizeof(mBuckets));
+        for (int i = 0; i < mCount; i++)
+        {
+            mandelCachedTile* t = &mTiles[i];
+            int h = hash(t->maxiter, t->column, t->row);
+            t->next = mBuckets[h];
+            mBuckets[h] = t;
+        }
+    }
+
+    mandelCachedTile* mBuckets[buckets];
+    mandelCachedTile* mTiles;
+    int mCount, mCapacity;
+    unsigned mClock;
+};
+
+// Preview block sizes, coarsest first, ending with full resolution
+static const int gLevels[] = { 16, 4, 1 };
+static const int gLevelCount = sizeof(gLevels)/sizeof(gLevels[0]);
+
+// Tile order by distance from the middle of the window
+static int gSortColumns;
+static int gSortCenterX, gSortCenterY;
+
+static int compareTiles(const void* a, const void* b)
+{
+    int ia = *(const int*)a, ib = *(const int*)b;
+    int ax = (ia % gSortColumns) * MANDEL_TILE + MANDEL_TILE/2 - gSortCenterX;
+    int ay = (ia / gSortColumns) * MANDEL_TILE + MANDEL_TILE/2 - gSortCenterY;
+    int bx = (ib % gSortColumns) * MANDEL_TILE + MANDEL_TILE/2 - gSortCenterX;
+    int by = (ib / gSortColumns) * MANDEL_TILE + MANDEL_TILE/2 - gSortCenterY;
+    long da = (long)ax * ax + (long)ay * ay;
+    long db = (long)bx * bx + (long)by * by;
+    return (da < db)?-1:(da > db)?1:ia - ib;
+}
+
+mandelView::mandelView(): mWidth(0), mHeight(0), mX0(-2), mY0(-1.5),
+    mSpacing(1.0L/128), mLeft(0), mTop(0), mMaxIter(16), mCurrent(0),
+    mColumn(0), mRow(0), mColumns(0), mRows(0), mState(NULL), mOrder(NULL),
+    mRemaining(0), mCache(new mandelTileCache), mBatch(NULL),
+    mTilesRendered(0), mCacheHits(0)
+{
+}
+
+mandelView::~mandelView()
+{
+    delete [] mState;
+    delete [] mOrder;
+    delete [] mBatch;
+    delete mCache;
+}
+
+void mandelView::setSize(int width, int height)
+{
+    mWidth = width;
+    mHeight = height;
+    layout(true);
+}
+
+void mandelView::fit(long double xmin, long double xmax,
+                     long double ymin, long double ymax)
+{
+    mSpacing = pxMax<long double>((xmax - xmin) / pxMax<int>(mWidth - 1, 1),
+                                  (ymax - ymin) / pxMax<int>(mHeight - 1, 1));
+    mX0 = (xmin + xmax) / 2 - mSpacing * (mWidth - 1) / 2;
+    mY0 = (ymin + ymax) / 2 - mSpacing * (mHeight - 1) / 2;
+    mLeft = mTop = 0;
+    layout(false);
+}
+
+void mandelView::pan(int dx, int dy)
+{
+    mLeft -= dx;
+    mTop -= dy;
+    layout(true);
+}
+
+void mandelView::zoom(int x, int y, long double factor)
+{
+    // Start a new grid with the point under x, y staying put
+    long double px = mX0 + (mLeft + x) * mSpacing;
+    long double py = mY0 + (mTop + y) * mSpacing;
+    mSpacing /= factor;
+    mX0 = px - x * mSpacing;
+    mY0 = py - y * mSpacing;
+    mLeft = mTop = 0;
+    layout(false);
+}
+
+void mandelView::setMaxIterations(unsigned maxiter)
+{
+    mMaxIter = maxiter;
+    layout(false);
+}
+
+// Works out which tiles the window touches and fills them from the old
+// texture (if the view is the same) or the cache
+void mandelView::layout(bool keep)
+{
+    if (mWidth <= 0 || mHeight <= 0)
+        return;
+
+    int column = floorDiv(mLeft, MANDEL_TILE);
+    int row = floorDiv(mTop, MANDEL_TILE);
+    int columns = floorDiv(mLeft + mWidth - 1, MANDEL_TILE) - column + 1;
+    int rows = floorDiv(mTop + mHeight - 1, MANDEL_TILE) - row + 1;
+
+    if (keep && mState && column == mColumn && row == mRow &&
+        columns == mColumns && rows == mRows)
+        return;
+
+    int count = columns * rows;
+    mCache->reserve(pxMax<int>(1024, count * 2));
+
+    pxOffscreen& old = mTexture[mCurrent];
+    pxOffscreen& texture = mTexture[1 - mCurrent];
+    texture.init(columns * MANDEL_TILE, rows * MANDEL_TILE);
+
+    int* state = new int[count];
+    mRemaining = 0;
+    for (int r = 0; r < rows; r++)
+    {
+        for (int c = 0; c < columns; c++)
+        {
+            int* s = &state[r * columns + c];
+            int oc = column + c - mColumn;
+            int orow = row + r - mRow;
+            int x = c * MANDEL_TILE, y = r * MANDEL_TILE;
+
+            mandelCachedTile* t;
+            if (keep && mState && oc >= 0 && oc < mColumns && orow >= 0 &&
+                orow < mRows && mState[orow * mColumns + oc])
+            {
+                // Keeps unfinished previews too
+                *s = mState[orow * mColumns + oc];
+                old.blit(texture, x, y, MANDEL_TILE, MANDEL_TILE,
+                         oc * MANDEL_TILE, orow * MANDEL_TILE);
+            }
+            else if ((t = mCache->find(mX0, mY0, mSpacing, mMaxIter,
+                                       column + c, row + r)) != NULL)
+            {
+                pxBuffer b;
+                mandelTileCache::wrap(t, b);
+                b.blit(texture, x, y, MANDEL_TILE, MANDEL_TILE, 0, 0);
+                *s = 1;
+                mCacheHits++;
+            }
+            else
+            {
+                texture.fill(pxRect(x, y, x + MANDEL_TILE, y + MANDEL_TILE), pxBlack);
+                *s = 0;
+            }
+
+            if (*s != 1)
+                mRemaining++;
+        }
+    }
+
+    delete [] mState;
+    delete [] mOrder;
+    delete [] mBatch;
+    mState = state;
+    mOrder = new int[count];
+    mBatch = new pxRect[count];
+    mCurrent = 1 - mCurrent;
+    mColumn = column;
+    mRow = row;
+    mColumns = columns;
+    mRows = rows;
+
+    for (int i = 0; i < count; i++)
+        mOrder[i] = i;
+    gSortColumns = columns;
+    gSortCenterX = textureLeft() + mWidth / 2;
+    gSortCenterY = textureTop() + mHeight / 2;
+    qsort(mOrder, count, sizeof(int), compareTiles);
+}
+
+bool mandelView::step(double budget, pxRect& dirty)
+{
+    dirty = pxRect();
+    if (!mState)
+        return false;
+
+    double start = pxMilliseconds();
+    int threads = pxCpuCount();
+    pxOffscreen& texture = mTexture[mCurrent];
+    int count = mColumns * mRows;
+
+    mRenderer.setGrid(mX0, mY0, mSpacing, mColumn * MANDEL_TILE, mRow * MANDEL_TILE);
+    mRenderer.setMaxIterations(mMaxIter);
+
+    int minX = texture.width(), minY = texture.height(), maxX = 0, maxY = 0;
+    while (mRemaining > 0)
+    {
+        // Every tile gets each preview before any gets the next, the
+        // batches hold about the same amount of work whatever the level
+        int level = 0;
+        int batch = 0;
+        for (; level < gLevelCount && !batch; level++)
+        {
+            int block = gLevels[level];
+            int most = threads * 2 * block * block;
+            for (int i = 0; i < count && batch < most; i++)
+            {
+                int s = mState[mOrder[i]];
+                if (s == 0 || s > block)
+                {
+                    int x = (mOrder[i] % mColumns) * MANDEL_TILE;
+                    int y = (mOrder[i] / mColumns) * MANDEL_TILE;
+                    mBatch[batch++] = pxRect(x, y, x + MANDEL_TILE, y + MANDEL_TILE);
+                }
+            }
+        }
+        int block = gLevels[level - 1];
+
+        mRenderer.setBlockSize(block);
+        mRenderer.render(texture, mBatch, batch);
+
+        for (int i = 0; i < batch; i++)
+        {
+            const pxRect& r = mBatch[i];
+            int c = r.left() / MANDEL_TILE, row = r.top() / MANDEL_TILE;
+            mState[row * mColumns + c] = block;
+            if (block == 1)
+            {
+                mRemaining--;
+                mTilesRendered++;
+
+                pxBuffer b;
+                mandelTileCache::wrap(mCache->add(mX0, mY0, mSpacing, mMaxIter,
+                                                  mColumn + c, mRow + row), b);
+                texture.blit(b, 0, 0, MANDEL_TILE, MANDEL_TILE, r.left(), r.top());
+            }
+            minX = pxMin<int>(minX, r.left());
+            minY = pxMin<int>(minY, r.top());
+            maxX = pxMax<int>(maxX, r.right());
+            maxY = pxMax<int>(maxY, r.bottom());
+        }
+
+        if (pxMilliseconds() - start >= budget)
+            break;
+    }
+
+    if (maxX > minX)
+    {
+        dirty = pxRect(minX - textureLeft(), minY - textureTop(),
+                       maxX - textureLeft(), maxY - textureTop());
+        dirty.intersect(pxRect(0, 0, mWidth, mHeight));
+    }
+    return mRemaining > 0;
+}
@@ -0,0 +1,158 @@
+// Mandelbrot Example CopyRight 2007 John Robinson
+// Renders the mandelbrot set into a pxBuffer a tile at a time
+// on all of the processors.  Also used by MandelbrotBenchmark.
+
+#ifndef MANDEL_H
+#define MANDEL_H
+
+#include "pxCore.h"
+#include "pxOffscreen.h"
+#include "pxTileRenderer.h"
+
+// float and double pixels are iterated 4 or 8 at a time with SSE2 or
+// AVX2, long double pixels one at a time
+enum mandelPrecision
+{
+    MANDEL_AUTO,        // The cheapest that can tell neighbouring pixels apart
+    MANDEL_FLOAT,
+    MANDEL_DOUBLE,
+    MANDEL_LONG_DOUBLE
+};
+
+class mandelRenderer: public pxTileRenderer
+{
+public:
+    mandelRenderer();
+
+    // The part of the complex plane the whole buffer shows
+    void setView(long double xmin, long double xmax,
+                 long double ymin, long double ymax);
+
+    // Pixel (x, y) of the buffer shows x0 + (left + x) * spacing,
+    // y0 + (top + y) * spacing, so buffers rendered at different offsets
+    // line up exactly.  Replaces the view.
+    void setGrid(long double x0, long double y0, long double spacing,
+                 int left, int top);
+
+    void setMaxIterations(unsigned maxiter) { mMaxIter = maxiter; }
+
+    // Iterates one pixel in each size x size block and fills the block
+    // with it, for quick previews.  Blocks are aligned to the grid.
+    void setBlockSize(int size) { mBlock = pxMax<int>(size, 1); }
+
+    void setPrecision(mandelPrecision precision) { mPrecision = precision; }
+
+    // What MANDEL_AUTO picks for the view in a buffer of this size.  The
+    // more the view is zoomed in the smaller the steps between pixels
+    // get compared to the coordinates and the more bits it takes to
+    // keep them apart.
+    mandelPrecision pickPrecision(int width, int height) const;
+
+    // Iterations done since the last reset, for measuring throughput
+    long iterations() const { return mIterations; }
+    void resetIterations() { mIterations = 0; }
+
+protected:
+    void renderTile(pxBuffer& b, const pxRect& tile);
+
+private:
+    // Pixel x shows x0 + (x + left) * xrange / xdiv
+    void mapping(const pxBuffer& b, long double& x0, long double& xrange,
+                 long double& xdiv, int& left, long double& y0,
+                 long double& yrange, long double& ydiv, int& top) const;
+
+    long double mXMin, mXMax, mYMin, mYMax;
+    bool mGrid;
+    long double mGridX0, mGridY0, mSpacing;
+    int mGridLeft, mGridTop;
+    unsigned mMaxIter;
+    int mBlock;
+    mandelPrecision mPrecision;
+    volatile long mIterations;
+};
+
+class mandelTileCache;
+
+// mandelView tiles are this many pixels square
+#define MANDEL_TILE 64
+
+// A window's worth of the mandelbrot set drawn progressively.  Each step
+// renders for a time budget, first a coarse preview of every tile, then
+// finer ones, nearest the middle first.  Finished tiles are kept in a
+// cache keyed by the view, tile and maxiter so panning, resizing and
+// going back to an earlier view only render what hasn't been seen.
+//
+// The picture lives on a grid of MANDEL_TILE pixel tiles in an
+// offscreen that covers every tile the window touches.
+class mandelView
+{
+public:
+    mandelView();
+    ~mandelView();
+
+    void setSize(int width, int height);
+    int width() const { return mWidth; }
+    int height() const { return mHeight; }
+
+    // Centres the given part of the plane in the window
+    void fit(long double xmin, long double xmax,
+             long double ymin, long double ymax);
+
+    // Moves the picture by dx, dy pixels
+    void pan(int dx, int dy);
+
+    // Magnifies by factor around window pixel x, y
+    void zoom(int x, int y, long double factor);
+
+    void setMaxIterations(unsigned maxiter);
+    unsigned maxIterations() const { return mMaxIter; }
+
+    // Renders for about budget milliseconds, always at least one batch
+    // of tiles.  dirty is set to the part of the window that changed.
+    // Returns true while there is more to do.
+    bool step(double budget, pxRect& dirty);
+    bool complete() const { return mRemaining == 0; }
+
+    // The window's pixels are at textureLeft, textureTop in texture
+    pxOffscreen& texture() { return mTexture[mCurrent]; }
+    int textureLeft() const { return mLeft - mColumn * MANDEL_TILE; }
+    int textureTop() const { return mTop - mRow * MANDEL_TILE; }
+
+    // Window pixel (x, y) shows x0 + (left + x) * spacing,
+    // y0 + (top + y) * spacing
+    long double x0() const { return mX0; }
+    long double y0() const { return mY0; }
+    long double spacing() const { return mSpacing; }
+    int left() const { return mLeft; }
+    int top() const { return mTop; }
+
+    // Full resolution tiles rendered and found in the cache so far
+    int tilesRendered() const { return mTilesRendered; }
+    int cacheHits() const { return mCacheHits; }
+
+private:
+    void layout(bool keep);
+
+    int mWidth, mHeight;
+    long double mX0, mY0, mSpacing;
+    int mLeft, mTop;
+    unsigned mMaxIter;
+
+    // The tiles in the texture, the finest block size each has been
+    // rendered at (0 for not at all) and the order to render them in
+    pxOffscreen mTexture[2];
+    int mCurrent;
+    int mColumn, mRow, mColumns, mRows;
+    int* mState;
+    int* mOrder;
+    int mRemaining;
+
+    mandelRenderer mRenderer;
+    mandelTileCache* mCache;
+    pxRect* mBatch;
+
+    int mTilesRendered;
+    int mCacheHits;
+};
+
+#endif
@@ -1,6 +1,6 @@
 // Mandelbrot Example CopyRight 2007 John Robinson
 // Demonstrates filling a pxBuffer with the mandelbrot set
-// and drawing it into a window.
+// and drawing it into a window.  See Mandel.cpp for the rendering.
 
 #include "pxCore.h"
 #include "pxEventLoop.h"
@@ -8,70 +8,20 @@
 
 #include "pxOffscreen.h"
 
+#include "Mandel.h"
+
 pxEventLoop eventLoop;
 
-void mandel( pxBuffer& b,
-	     long double xmin, long double xmax,
-	     long double ymin, long double ymax,
-	     unsigned maxiter
-	   )
-{ 
-    int nx = b.width();
-    int ny = b.height();
-    
-    short ix, iy;
-    unsigned iter;
-    long double cx, cy;
-    long double x, y, x2, y2, temp;
-
-    for( iy = 0; iy < ny; iy ++ )
-    { 
-        cy = ymin + iy * ( ymax - ymin ) / ( ny - 1 );
- 
-        for( ix = 0; ix < nx; ix ++ )
-    	{ 
-
-            // for a given pixel calculate if that point is in
-            // the mandelbrot set
-            cx = xmin + ix * ( xmax - xmin ) / ( nx - 1 );
-            x = y = x2 = y2 = 0.0;
-            iter = 0;
-
-            // use an escape radius of 9.0
-            while( iter < maxiter && ( x2 + y2 ) <= 9.0 )
-	        { 
-                temp = x2 - y2 + cx;
-                y = 2 * x * y + cy;
-                x = temp;
-                x2 = x * x;
-                y2 = y * y;
-                iter++;
-	        }
-
-            pxPixel* p = b.pixel(ix, iy);
-
-
-            // Select a color based on how many iterations it took to escape
-            // the mandelbrot set
-            if (iter >= maxiter)
-            {
-                p->r = p->b = p->g = 0;
-                p->a = 32;
-            }
-            else
-            {
-                double v = (double)iter/(double)maxiter;
-		        p->r = (unsigned char)(255*v);
-		        p->b = (unsigned char)(80*(1.0-v));
-		        p->g = (unsigned char)(255*(1.0-v));
-		        p->a = 255;
-            }
-	}
-    }
-}
+// Each step of a progressive render gets this long, then the
+// partial picture is shown
+#define STEP_BUDGET 8
 
 class myWindow: public pxWindow
 {
+public:
+    myWindow(): mProgressive(true), mDragging(false), mSized(false),
+        mMouseX(0), mMouseY(0) {}
+
 private:
     // Event Handlers - Look in pxWindow.h for more
     void onCloseRequest()
@@ -81,18 +31,106 @@ private:
 
     void onSize(int w, int h)
     {
-        // Fill an offscreen buffer (pxOffscreen) with the Mandelbrot pattern
-        mTexture.init(w, h);  // Initialize the offscreen to be the desired size
-        mandel(mTexture, -2, 1, -1.5, 1.5, 16);
+        mView.setSize(w, h);
+        if (!mSized)
+        {
+            mView.fit(-2, 1, -1.5, 1.5);
+            mSized = true;
+        }
+        // The whole window is drawn after onSize
+        update(false);
     }
 
     void onDraw(pxSurfaceNative s)
     {
         // Draw the texture into this window
-        mTexture.blit(s);
+        mView.texture().blit(s, 0, 0, mView.width(), mView.height(),
+                             mView.textureLeft(), mView.textureTop(),
+                             mView.width(), mView.height());
+    }
+
+    // Drag to pan, Z and X zoom in and out, I and U raise and lower the
+    // iterations and P turns progressive rendering on and off
+    void onMouseDown(int x, int y, unsigned long flags)
+    {
+        if (flags & PX_LEFTBUTTON)
+        {
+            mDragging = true;
+            mDragX = x;
+            mDragY = y;
+        }
+    }
+
+    void onMouseUp(int x, int y, unsigned long flags)
+    {
+        mDragging = false;
+    }
+
+    void onMouseMove(int x, int y)
+    {
+        mMouseX = x;
+        mMouseY = y;
+        if (mDragging)
+        {
+            mView.pan(x - mDragX, y - mDragY);
+            mDragX = x;
+            mDragY = y;
+            update(true);
+        }
+    }
+
+    void onKeyDown(int keycode, unsigned long flags)
+    {
+        switch (keycode)
+        {
+        case 'Z':
+            mView.zoom(mMouseX, mMouseY, 2);
+            break;
+        case 'X':
+            mView.zoom(mMouseX, mMouseY, 0.5);
+            break;
+        case 'I':
+            mView.setMaxIterations(mView.maxIterations() * 2);
+            break;
+        case 'U':
+            mView.setMaxIterations(pxMax<unsigned>(mView.maxIterations() / 2, 16));
+            break;
+        case 'P':
+            mProgressive = !mProgressive;
+            break;
+        default:
+            return;
+        }
+        update(true);
+    }
+
+    // Shows a first coarse pass straight away and refines it on the
+    // animation timer, or renders everything now when not progressive
+    void update(bool draw)
+    {
+        pxRect dirty;
+        mView.step(mProgressive?0:1e30, dirty);
+        if (draw)
+            invalidateRect();
+        setAnimationFPS(mView.complete()?0:60);
+    }
+
+    void onAnimationTimer()
+    {
+        pxRect dirty;
+        mView.step(STEP_BUDGET, dirty);
+        if (dirty.width() > 0 && dirty.height() > 0)
+            invalidateRect(&dirty);
+        if (mView.complete())
+            setAnimationFPS(0);
     }
 
-    pxOffscreen mTexture;
+    mandelView mView;
+    bool mProgressive;
+    bool mDragging;
+    bool mSized;
+    int mMouseX, mMouseY;
+    int mDragX, mDragY;
 };
 
 int pxMain()
@@ -0,0 +1,336 @@
+// MandelbrotBenchmark Example CopyRight 2007 John Robinson
+// Times the tiled Mandelbrot renderer with different numbers of threads,
+// compares work stealing with fixed bands of rows, measures the
+// iterations per second of each precision and kernel and how quickly
+// progressive rendering shows something and reuses cached tiles
+
+#include "pxCore.h"
+#include "pxOffscreen.h"
+#include "pxTimer.h"
+#include "pxCpu.h"
+
+#include "../Mandelbrot/Mandel.h"
+
+#include <stdio.h>
+#include <string.h>
+
+const int gWidth = 1280;
+const int gHeight = 720;
+
+typedef struct
+{
+    const char* name;
+    long double xmin, xmax, ymin, ymax;
+    unsigned maxiter;
+    mandelPrecision expected;       // What auto should pick
+} view;
+
+// The whole set is cheap at the edges and dear in the middle, the
+// seahorse valley zoom is uneven everywhere and the deep zoom into the
+// tip at i takes all but a few bits of double to tell its pixels apart
+const view gViews[] =
+{
+    { "whole set", -2, 1, -1.5, 1.5, 256, MANDEL_FLOAT },
+    { "seahorse valley", -0.7545, -0.7425, 0.0965, 0.1035, 1024, MANDEL_DOUBLE },
+    { "deep zoom", -5e-11L, 5e-11L, 1 - 2.8125e-11L, 1 + 2.8125e-11L, 512,
+      MANDEL_DOUBLE },
+};
+const int gScalingViews = 2;
+
+// Milliseconds per progressive step, as in the example
+const double gStepBudget = 8;
+
+typedef struct
+{
+    const char* name;
+    unsigned int mask;
+} kernel;
+
+const kernel gKernels[] =
+{
+    { "scalar", 0 },
+    { "SSE2", PX_CPU_SSE2 },
+    { "AVX2", PX_CPU_SSE2|PX_CPU_AVX2 },
+};
+const int gKernelCount = sizeof(gKernels)/sizeof(gKernels[0]);
+
+const char* gPrecisionNames[] = { "auto", "float", "double", "long double" };
+const int gViewCount = sizeof(gViews)/sizeof(gViews[0]);
+
+// Fraction of the pixels that differ
+double differing(pxBuffer& a, pxBuffer& b)
+{
+    long count = 0;
+    for (int y = 0; y < a.height(); y++)
+    {
+        for (int x = 0; x < a.width(); x++)
+        {
+            if (a.pixel(x, y)->u != b.pixel(x, y)->u)
+                count++;
+        }
+    }
+    return (double)count / ((double)a.width() * a.height());
+}
+
+bool same(pxBuffer& a, pxBuffer& b)
+{
+    for (int y = 0; y < a.height(); y++)
+    {
+        if (memcmp(a.scanline(y), b.scanline(y), a.width() * sizeof(pxPixel)))
+            return false;
+    }
+    return true;
+}
+
+// Whether the window part of a view's texture matches b
+bool sameView(mandelView& mv, pxBuffer& b)
+{
+    for (int y = 0; y < mv.height(); y++)
+    {
+        if (memcmp(mv.texture().pixel(mv.textureLeft(), mv.textureTop() + y),
+                   b.scanline(y), mv.width() * sizeof(pxPixel)))
+            return false;
+    }
+    return true;
+}
+
+// Best of a few renders in milliseconds
+double timeRender(mandelRenderer& m, pxBuffer& b, int threads)
+{
+    double best = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        double start = pxMilliseconds();
+        m.render(b, threads);
+        double t = pxMilliseconds() - start;
+        if (i == 0 || t < best)
+            best = t;
+    }
+    return best;
+}
+
+int pxMain()
+{
+    int cpus = pxCpuCount();
+    printf("%d processors, %dx%d\n\n", cpus, gWidth, gHeight);
+
+    pxOffscreen reference, result;
+    reference.init(gWidth, gHeight);
+    result.init(gWidth, gHeight);
+
+    bool ok = true;
+
+    for (int v = 0; v < gScalingViews; v++)
+    {
+        const view& w = gViews[v];
+        mandelRenderer m;
+        m.setView(w.xmin, w.xmax, w.ymin, w.ymax);
+        m.setMaxIterations(w.maxiter);
+
+        m.render(reference, 1);
+        double single = timeRender(m, reference, 1);
+
+        printf("%s, maxiter %u\n", w.name, w.maxiter);
+        printf("%8s %12s %8s %8s %12s %8s\n", "threads", "stealing", "speedup",
+               "steals", "bands", "speedup");
+
+        int threads = 1;
+        for (;;)
+        {
+            m.setTileSize(64, 64);
+            result.fill(pxRed);
+            double tiled = timeRender(m, result, threads);
+            int steals = m.steals();
+            if (!same(reference, result))
+            {
+                printf("Tiled render with %d threads differs\n", threads);
+                ok = false;
+            }
+
+            // One full width tile per thread can't be rebalanced
+            m.setTileSize(gWidth, (gHeight + threads - 1) / threads);
+            double banded = timeRender(m, result, threads);
+            if (!same(reference, result))
+            {
+                printf("Banded render with %d threads differs\n", threads);
+                ok = false;
+            }
+
+            printf("%8d %10.1fms %7.2fx %8d %10.1fms %7.2fx\n", threads,
+                   tiled, single / tiled, steals, banded, single / banded);
+
+            if (threads >= cpus * 2)
+                break;
+            threads = pxMin<int>(threads * 2, cpus * 2);
+        }
+        printf("\n");
+    }
+
+    // One thread so the numbers are per core
+    pxOffscreen exact;
+    exact.init(gWidth, gHeight);
+    for (int v = 0; v < gViewCount; v++)
+    {
+        const view& w = gViews[v];
+        mandelRenderer m;
+        m.setView(w.xmin, w.xmax, w.ymin, w.ymax);
+        m.setMaxIterations(w.maxiter);
+
+        mandelPrecision picked = m.pickPrecision(gWidth, gHeight);
+        printf("%s, maxiter %u, auto picks %s\n", w.name, w.maxiter,
+               gPrecisionNames[picked]);
+        if (picked != w.expected)
+        {
+            printf("Auto should pick %s\n", gPrecisionNames[w.expected]);
+            ok = false;
+        }
+        printf("%-12s %-7s %10s %12s %16s\n", "precision", "kernel", "time",
+               "Miter/s", "differing from long double");
+
+        m.setPrecision(MANDEL_LONG_DOUBLE);
+        m.render(exact, 1);
+
+        for (int p = MANDEL_FLOAT; p <= MANDEL_LONG_DOUBLE; p++)
+        {
+            m.setPrecision((mandelPrecision)p);
+            for (int k = 0; k < gKernelCount; k++)
+            {
+                // Only float and double have SIMD kernels
+                if (p == MANDEL_LONG_DOUBLE && k > 0)
+                    break;
+                if ((pxCpuFeatures() & gKernels[k].mask) != gKernels[k].mask)
+                    continue;
+
+                pxCpuSetFeatureMask(gKernels[k].mask);
+                m.resetIterations();
+                result.fill(pxRed);
+                double start = pxMilliseconds();
+                m.render(result, 1);
+                double t = pxMilliseconds() - start;
+                pxCpuSetFeatureMask(~0U);
+
+                if (k == 0)
+                    result.blit(reference);
+                else if (!same(reference, result))
+                {
+                    printf("%s %s differs from scalar\n", gPrecisionNames[p],
+                           gKernels[k].name);
+                    ok = false;
+                }
+
+                printf("%-12s %-7s %8.1fms %12.1f %15.2f%%\n",
+                       gPrecisionNames[p], gKernels[k].name, t,
+                       m.iterations() / (t * 1000.0),
+                       differing(exact, result) * 100);
+            }
+        }
+        printf("\n");
+    }
+
+    for (int v = 0; v < gScalingViews; v++)
+    {
+        const view& w = gViews[v];
+        printf("%s progressive, maxiter %u\n", w.name, w.maxiter);
+
+        mandelView mv;
+        mv.setSize(gWidth, gHeight);
+        mv.fit(w.xmin, w.xmax, w.ymin, w.ymax);
+        mv.setMaxIterations(w.maxiter);
+
+        // What the example used to do before showing anything
+        mandelRenderer m;
+        m.setGrid(mv.x0(), mv.y0(), mv.spacing(), mv.left(), mv.top());
+        m.setMaxIterations(w.maxiter);
+        double start = pxMilliseconds();
+        m.render(reference);
+        double full = pxMilliseconds() - start;
+        printf("  full render before first paint %10.1fms\n", full);
+
+        pxRect dirty;
+        start = pxMilliseconds();
+        mv.step(0, dirty);
+        double first = pxMilliseconds() - start;
+        int steps = 1;
+        while (mv.step(gStepBudget, dirty))
+            steps++;
+        double all = pxMilliseconds() - start;
+        printf("  first pixels %10.1fms, finished after %d steps %10.1fms\n",
+               first, steps, all);
+
+        if (!sameView(mv, reference))
+        {
+            printf("  Progressive render differs from a full render\n");
+            ok = false;
+        }
+
+        struct
+        {
+            const char* name;
+            int dx, dy, width, height;
+        } moves[] =
+        {
+            { "pan 100,37", 100, 37, gWidth, gHeight },
+            { "resize to 1400x800", 0, 0, 1400, 800 },
+            { "pan back", -100, -37, 1400, 800 },
+        };
+        for (int i = 0; i < 3; i++)
+        {
+            int rendered = mv.tilesRendered(), hits = mv.cacheHits();
+            start = pxMilliseconds();
+            mv.pan(moves[i].dx, moves[i].dy);
+            mv.setSize(moves[i].width, moves[i].height);
+            while (mv.step(gStepBudget, dirty)) {}
+            double t = pxMilliseconds() - start;
+            printf("  %-20s %4d tiles rendered %4d from cache %10.1fms\n",
+                   moves[i].name, mv.tilesRendered() - rendered,
+                   mv.cacheHits() - hits, t);
+
+            result.init(mv.width(), mv.height());
+            m.setGrid(mv.x0(), mv.y0(), mv.spacing(), mv.left(), mv.top());
+            m.render(result);
+            if (!sameView(mv, result))
+            {
+                printf("  Progressive render differs after %s\n", moves[i].name);
+                ok = false;
+            }
+        }
+        printf("\n");
+    }
+
+    // Lots of small renders, as progressive rendering does, so the cost
+    // of getting the worker threads going shows
+    {
+        const view& w = gViews[0];
+        const int size = 128, renders = 2000;
+        mandelRenderer m;
+        m.setView(w.xmin, w.xmax, w.ymin, w.ymax);
+        m.setMaxIterations(16);
+        m.setTileSize(16, 16);
+
+        pxOffscreen small, smallReference;
+        small.init(size, size);
+        smallReference.init(size, size);
+        m.render(smallReference, 1);
+
+        printf("%d renders of %dx%d, maxiter 16\n", renders, size, size);
+        printf("%8s %12s\n", "threads", "per render");
+        for (int threads = 1; threads <= 8; threads *= 2)
+        {
+            double start = pxMilliseconds();
+            for (int i = 0; i < renders; i++)
+                m.render(small, threads);
+            double t = pxMilliseconds() - start;
+            printf("%8d %10.1fus\n", threads, t * 1000 / renders);
+
+            if (!same(smallReference, small))
+            {
+                printf("Small render with %d threads differs\n", threads);
+                ok = false;
+            }
+        }
+        printf("\n");
+    }
+
+    printf("Results: %s\n", ok?"ok":"FAILED");
+    return ok?0:1;
+}
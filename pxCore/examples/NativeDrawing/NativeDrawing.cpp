@@ -11,6 +11,7 @@
 #include "pxOffscreen.h"
 
 #include <stdio.h>
+#include <string.h>
 
 pxEventLoop eventLoop;
 
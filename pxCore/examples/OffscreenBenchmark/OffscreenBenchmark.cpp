@@ -0,0 +1,150 @@
+// OffscreenBenchmark Example CopyRight 2007 John Robinson
+// Measures what resizing offscreens costs, like a window being dragged
+// to a new size, and checks the pixel memory bookkeeping
+
+#include "pxCore.h"
+#include "pxOffscreen.h"
+#include "pxTimer.h"
+
+#include <stdio.h>
+
+const int gSteps = 200;
+
+// Sizes a window goes through while being dragged around 1080p
+void dragSize(int step, int& width, int& height)
+{
+    int phase = step % 40;
+    int d = (phase < 20)?phase:40 - phase;
+    width = 1600 + d * 16;
+    height = 900 + d * 9;
+}
+
+void printStats(const char* name)
+{
+    pxOffscreenStats s = pxOffscreen::stats();
+    printf("%-30s %5lu allocs %5lu frees %5lu pool hits %5lu reuses, "
+           "%.1fMB in use %.1fMB pooled %.1fMB peak\n", name, s.allocations,
+           s.frees, s.poolHits, s.reuses, s.bytesInUse / 1048576.0,
+           s.bytesPooled / 1048576.0, s.peakBytes / 1048576.0);
+}
+
+bool check(bool ok, const char* what)
+{
+    if (!ok)
+        printf("FAIL %s\n", what);
+    return ok;
+}
+
+bool checkBookkeeping()
+{
+    bool ok = true;
+    pxOffscreenStats before = pxOffscreen::stats();
+
+    {
+        pxOffscreen o;
+        for (int w = 1; w < 300; w += 37)
+        {
+            o.init(w, 7);
+            ok = check(((size_t)o.base() & 63) == 0, "base isn't 64 byte aligned") && ok;
+            ok = check((o.stride() & 63) == 0, "stride isn't a multiple of 64") && ok;
+            ok = check(o.stride() >= w * 4, "stride is too small") && ok;
+            o.fill(pxRed);
+        }
+
+        o.init(1024, 10);
+        ok = check(o.stride() % 4096 != 0, "stride is a multiple of 4KB") && ok;
+
+        // Shrinking and growing back within the capacity reuses it
+        o.init(1920, 1080);
+        pxOffscreenStats s = pxOffscreen::stats();
+        o.init(1280, 720);
+        o.init(1919, 1079);
+        pxOffscreenStats t = pxOffscreen::stats();
+        ok = check(t.allocations == s.allocations, "resizing within capacity allocated") && ok;
+        ok = check(t.reuses == s.reuses + 2, "reuses weren't counted") && ok;
+    }
+
+    // Pooled buffers come back for the next offscreen of a similar size
+    {
+        pxOffscreen a;
+        a.init(800, 600, PX_OFFSCREEN_POOLED);
+    }
+    pxOffscreenStats s = pxOffscreen::stats();
+    ok = check(s.bytesPooled > 0, "freed buffer wasn't pooled") && ok;
+    {
+        pxOffscreen b;
+        b.init(790, 600, PX_OFFSCREEN_POOLED);
+        pxOffscreenStats t = pxOffscreen::stats();
+        ok = check(t.poolHits == s.poolHits + 1, "pool wasn't used") && ok;
+        ok = check(t.allocations == s.allocations, "pool hit allocated") && ok;
+    }
+
+    pxOffscreen::trimPool();
+    s = pxOffscreen::stats();
+    ok = check(s.bytesPooled == 0, "trimPool left buffers") && ok;
+    ok = check(s.bytesInUse == before.bytesInUse, "bytes in use leaked") && ok;
+    ok = check(s.allocations - before.allocations == s.frees - before.frees,
+               "allocations and frees don't balance") && ok;
+    return ok;
+}
+
+int pxMain()
+{
+    bool ok = checkBookkeeping();
+    printf("Bookkeeping: %s\n\n", ok?"ok":"FAIL");
+
+    int width, height;
+    double start;
+
+    // What every onSize used to cost, new memory each time
+    {
+        pxOffscreen o;
+        start = pxMilliseconds();
+        for (int i = 0; i < gSteps; i++)
+        {
+            dragSize(i, width, height);
+            o.term();
+            o.init(width, height);
+            o.fill(pxGray);
+        }
+        printf("%-30s %8.3f ms per resize\n", "free and allocate",
+               (pxMilliseconds() - start) / gSteps);
+    }
+
+    // Growing to the biggest size once and reusing it after that
+    {
+        pxOffscreen o;
+        start = pxMilliseconds();
+        for (int i = 0; i < gSteps; i++)
+        {
+            dragSize(i, width, height);
+            o.init(width, height);
+            o.fill(pxGray);
+        }
+        printf("%-30s %8.3f ms per resize\n", "reuse capacity",
+               (pxMilliseconds() - start) / gSteps);
+    }
+
+    // A scratch offscreen created and destroyed every frame
+    for (int pooled = 0; pooled < 2; pooled++)
+    {
+        start = pxMilliseconds();
+        for (int i = 0; i < gSteps; i++)
+        {
+            dragSize(i, width, height);
+            pxOffscreen scratch;
+            scratch.init(width, height, pooled?PX_OFFSCREEN_POOLED:0);
+            scratch.fill(pxGray);
+        }
+        printf("%-30s %8.3f ms per frame\n",
+               pooled?"scratch offscreen, pooled":"scratch offscreen",
+               (pxMilliseconds() - start) / gSteps);
+    }
+
+    printf("\n");
+    printStats("totals");
+    pxOffscreen::trimPool();
+    printStats("after trimPool");
+
+    return ok?0:1;
+}
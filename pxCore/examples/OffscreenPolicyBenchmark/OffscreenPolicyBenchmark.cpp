@@ -0,0 +1,118 @@
+// OffscreenPolicyBenchmark Example CopyRight 2007 John Robinson
+// Compares the pxOffscreen allocation policies for 4K and 8K surfaces:
+// how long init takes, what the first frame drawn into fresh memory
+// costs and what frames cost after that
+
+#include "pxCore.h"
+#include "pxOffscreen.h"
+#include "pxTimer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+typedef struct
+{
+    const char* name;
+    unsigned int flags;
+} policy;
+
+const policy gPolicies[] =
+{
+    { "heap", 0 },
+    { "heap, prefault", PX_OFFSCREEN_PREFAULT },
+    { "mapped", PX_OFFSCREEN_MAPPED },
+    { "mapped, prefault", PX_OFFSCREEN_MAPPED|PX_OFFSCREEN_PREFAULT },
+    { "huge pages", PX_OFFSCREEN_HUGEPAGES },
+    { "huge pages, prefault", PX_OFFSCREEN_HUGEPAGES|PX_OFFSCREEN_PREFAULT },
+};
+const int gPolicyCount = sizeof(gPolicies)/sizeof(gPolicies[0]);
+
+const int gSteadyFrames = 5;
+
+unsigned int gSink;
+
+// A per pixel pass like the Mandelbrot example's followed by a walk down
+// every 8th column, which touches a new page on every row
+void drawFrame(pxBuffer& b, int frame)
+{
+    for (int y = 0; y < b.height(); y++)
+    {
+        pxPixel* p = b.scanline(y);
+        for (int x = 0; x < b.width(); x++)
+            p[x].u = (x ^ y) + frame;
+    }
+
+    unsigned int sum = 0;
+    for (int x = 0; x < b.width(); x += 8)
+    {
+        for (int y = 0; y < b.height(); y++)
+            sum += b.pixel(x, y)->u;
+    }
+    gSink += sum;
+}
+
+// Transparent huge pages in use by the process according to the kernel,
+// -1 if it doesn't say
+long anonHugePagesKB()
+{
+    FILE* f = fopen("/proc/self/smaps_rollup", "r");
+    if (!f)
+        return -1;
+    char line[256];
+    long kb = -1;
+    while (fgets(line, sizeof(line), f))
+    {
+        if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1)
+            break;
+    }
+    fclose(f);
+    return kb;
+}
+
+void benchmark(int width, int height)
+{
+    printf("%dx%d (%.0fMB)\n", width, height, width * height * 4 / 1048576.0);
+    printf("%-24s %10s %12s %12s %10s\n", "", "init", "first frame",
+           "steady frame", "THP");
+
+    for (int i = 0; i < gPolicyCount; i++)
+    {
+        pxOffscreenStats before = pxOffscreen::stats();
+        pxOffscreen o;
+
+        double start = pxMilliseconds();
+        o.init(width, height, gPolicies[i].flags);
+        double init = pxMilliseconds() - start;
+
+        start = pxMilliseconds();
+        drawFrame(o, 0);
+        double first = pxMilliseconds() - start;
+
+        start = pxMilliseconds();
+        for (int f = 1; f <= gSteadyFrames; f++)
+            drawFrame(o, f);
+        double steady = (pxMilliseconds() - start) / gSteadyFrames;
+
+        long thp = anonHugePagesKB();
+        pxOffscreenStats after = pxOffscreen::stats();
+
+        char thpText[32];
+        if (thp >= 0)
+            sprintf(thpText, "%ldMB", thp / 1024);
+        else
+            strcpy(thpText, "?");
+
+        printf("%-24s %8.2fms %10.2fms %10.2fms %10s%s\n", gPolicies[i].name,
+               init, first, steady, thpText,
+               (after.hugePageAllocations > before.hugePageAllocations)?
+               " MAP_HUGETLB":"");
+    }
+    printf("\n");
+}
+
+int pxMain()
+{
+    benchmark(3840, 2160);
+    benchmark(7680, 4320);
+    return 0;
+}
@@ -0,0 +1,274 @@
+// ScaleBenchmark Example CopyRight 2007 John Robinson
+// Checks the SIMD scaling kernels against the scalar ones and measures
+// shrinking a 4K frame to window sizes, switching between two sizes and
+// scaling small frames on several threads
+
+#include "pxCore.h"
+#include "pxOffscreen.h"
+#include "pxScale.h"
+#include "pxCpu.h"
+#include "pxTimer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct
+{
+    const char* name;
+    unsigned int mask;
+} kernel;
+
+const kernel gKernels[] =
+{
+    { "scalar", 0 },
+    { "SSE2", PX_CPU_SSE2 },
+    { "AVX2", PX_CPU_SSE2|PX_CPU_AVX2 },
+};
+const int gKernelCount = sizeof(gKernels)/sizeof(gKernels[0]);
+
+const char* gFilterNames[] = { "nearest", "bilinear", "box" };
+
+bool available(const kernel& k)
+{
+    pxCpuSetFeatureMask(~0U);
+    return (pxCpuFeatures() & k.mask) == k.mask;
+}
+
+void randomize(pxBuffer& b)
+{
+    for (int y = 0; y < b.height(); y++)
+    {
+        pxPixel* p = b.scanline(y);
+        for (int x = 0; x < b.width(); x++)
+            p[x].u = rand() ^ (rand() << 16);
+    }
+}
+
+bool sameBuffers(pxBuffer& a, pxBuffer& b)
+{
+    for (int y = 0; y < a.height(); y++)
+    {
+        for (int x = 0; x < a.width(); x++)
+        {
+            if (a.pixel(x, y)->u != b.pixel(x, y)->u)
+                return false;
+        }
+    }
+    return true;
+}
+
+bool checkValues()
+{
+    bool ok = true;
+    pxScaler scaler;
+
+    // A constant color stays exactly the same whatever the sizes
+    pxOffscreen src, dst;
+    src.initWithColor(37, 23, pxColor(10, 200, 77, 128));
+    for (int f = PX_SCALE_NEAREST; f <= PX_SCALE_BOX; f++)
+    {
+        dst.init(101, 9);
+        scaler.scale(src, dst, (pxScaleFilter)f);
+        pxOffscreen expected;
+        expected.initWithColor(101, 9, pxColor(10, 200, 77, 128));
+        if (!sameBuffers(dst, expected))
+        {
+            printf("FAIL %s changes a constant color\n", gFilterNames[f]);
+            ok = false;
+        }
+    }
+
+    // Same size is a copy
+    src.init(50, 30);
+    randomize(src);
+    for (int f = PX_SCALE_NEAREST; f <= PX_SCALE_BOX; f++)
+    {
+        dst.init(50, 30);
+        scaler.scale(src, dst, (pxScaleFilter)f);
+        if (!sameBuffers(dst, src))
+        {
+            printf("FAIL %s at the same size isn't a copy\n", gFilterNames[f]);
+            ok = false;
+        }
+    }
+
+    // Halving with a box filter averages 2x2 blocks
+    src.init(4, 2);
+    for (int x = 0; x < 4; x++)
+    {
+        src.pixel(x, 0)->u = (x & 1)?0xffffffff:0;
+        src.pixel(x, 1)->u = 0;
+    }
+    dst.init(2, 1);
+    scaler.scale(src, dst, PX_SCALE_BOX);
+    if (dst.pixel(0, 0)->u != 0x40404040 || dst.pixel(1, 0)->u != 0x40404040)
+    {
+        printf("FAIL box halving gave %08x %08x\n", dst.pixel(0, 0)->u,
+               dst.pixel(1, 0)->u);
+        ok = false;
+    }
+
+    return ok;
+}
+
+bool checkKernels()
+{
+    bool ok = true;
+    srand(1);
+
+    for (int test = 0; test < 300; test++)
+    {
+        pxScaleFilter filter = (pxScaleFilter)(test % 3);
+        int sw = 1 + rand() % 90, sh = 1 + rand() % 40;
+        int dw = 1 + rand() % 90, dh = 1 + rand() % 40;
+        bool srcUpsideDown = (rand() & 1) != 0;
+        bool dstUpsideDown = (rand() & 1) != 0;
+
+        pxOffscreen src, reference;
+        src.init(sw, sh);
+        src.setUpsideDown(srcUpsideDown);
+        randomize(src);
+        reference.init(dw, dh);
+        reference.setUpsideDown(dstUpsideDown);
+
+        pxScaler scaler;
+        pxCpuSetFeatureMask(0);
+        scaler.scale(src, reference, filter);
+
+        for (int k = 0; k < gKernelCount; k++)
+        {
+            if (!available(gKernels[k]))
+                continue;
+            pxCpuSetFeatureMask(gKernels[k].mask);
+
+            pxOffscreen dst;
+            dst.init(dw, dh);
+            dst.setUpsideDown(dstUpsideDown);
+            scaler.scale(src, dst, filter, 1 + test % 4);
+
+            if (!sameBuffers(dst, reference))
+            {
+                printf("FAIL %s %s %dx%d to %dx%d\n", gKernels[k].name,
+                       gFilterNames[filter], sw, sh, dw, dh);
+                ok = false;
+            }
+        }
+    }
+
+    pxCpuSetFeatureMask(~0U);
+    return ok;
+}
+
+// Returns milliseconds per frame
+double run(pxScaler& scaler, pxBuffer& src, pxBuffer& dst,
+           pxScaleFilter filter, int threads)
+{
+    int count = 0;
+    double start = pxMilliseconds();
+    double end;
+    do
+    {
+        scaler.scale(src, dst, filter, threads);
+        count++;
+        end = pxMilliseconds();
+    } while (end - start < 300);
+
+    return (end - start) / count;
+}
+
+void benchmark(pxBuffer& src, int width, int height, pxScaleFilter filter)
+{
+    char name[64];
+    sprintf(name, "%dx%d to %dx%d %s", src.width(), src.height(), width,
+            height, gFilterNames[filter]);
+    printf("%-36s", name);
+
+    pxOffscreen dst;
+    dst.init(width, height);
+    pxScaler scaler;
+
+    for (int k = 0; k < gKernelCount; k++)
+    {
+        if (!available(gKernels[k]))
+        {
+            printf("%11s", "n/a");
+            continue;
+        }
+        pxCpuSetFeatureMask(gKernels[k].mask);
+        printf("%8.2f ms", run(scaler, src, dst, filter, 1));
+    }
+    printf("%8.2f ms\n", run(scaler, src, dst, filter, 0));
+    pxCpuSetFeatureMask(~0U);
+}
+
+// A preview and a full window view of the same frames, one after the
+// other, with one scaler and with a new scaler (so new tables) each time
+void alternating(pxBuffer& src)
+{
+    pxOffscreen big, small;
+    big.init(1280, 720);
+    small.init(320, 180);
+
+    const int frames = 100;
+    pxScaler scaler;
+    double start = pxMilliseconds();
+    for (int i = 0; i < frames; i++)
+        scaler.scale(src, (i & 1)?small:big, PX_SCALE_BILINEAR);
+    double kept = (pxMilliseconds() - start) / frames;
+
+    start = pxMilliseconds();
+    for (int i = 0; i < frames; i++)
+    {
+        pxScaler fresh;
+        fresh.scale(src, (i & 1)?small:big, PX_SCALE_BILINEAR);
+    }
+    double rebuilt = (pxMilliseconds() - start) / frames;
+
+    printf("%dx%d to 1280x720 and 320x180 in turn, bilinear\n", src.width(),
+           src.height());
+    printf("  tables kept %8.3f ms, rebuilt %8.3f ms\n\n", kept, rebuilt);
+}
+
+int pxMain()
+{
+    bool ok = checkValues();
+    printf("Known values: %s\n", ok?"ok":"FAIL");
+    bool kernels = checkKernels();
+    printf("SIMD kernels match the scalar kernels: %s\n\n", kernels?"yes":"NO");
+    ok = ok && kernels;
+
+    printf("%-36s%11s%11s%11s%8s x%d\n", "", gKernels[0].name, gKernels[1].name,
+           gKernels[2].name, "threads", pxCpuCount());
+
+    pxOffscreen uhd;
+    uhd.init(3840, 2160);
+    randomize(uhd);
+
+    benchmark(uhd, 640, 360, PX_SCALE_NEAREST);
+    benchmark(uhd, 640, 360, PX_SCALE_BILINEAR);
+    benchmark(uhd, 640, 360, PX_SCALE_BOX);
+    benchmark(uhd, 1280, 720, PX_SCALE_BOX);
+
+    pxOffscreen vga;
+    vga.init(640, 480);
+    randomize(vga);
+    benchmark(vga, 1920, 1080, PX_SCALE_BILINEAR);
+    printf("\n");
+
+    alternating(vga);
+
+    // Frames this small show what handing out the bands costs
+    pxOffscreen small;
+    small.init(320, 240);
+    printf("320x240 to 160x120 bilinear\n");
+    for (int threads = 1; threads <= 4; threads++)
+    {
+        pxOffscreen dst;
+        dst.init(160, 120);
+        pxScaler scaler;
+        printf("  %d threads %8.3f ms\n", threads,
+               run(scaler, small, dst, PX_SCALE_BILINEAR, threads));
+    }
+
+    return ok?0:1;
+}
@@ -37,6 +37,35 @@ int pxMain()
 
    printf("\telapsed %gs\n\n", end-start);
 
+   printf("Timing back to back in nanoseconds...\n");
+   long long startNS = pxNanoseconds();
+   long long endNS = pxNanoseconds();
+
+   printf("\telapsed %lldns\n\n", endNS-startNS);
+
+   // Each deadline is a whole number of nanoseconds after the first so
+   // oversleeping one tick is made up on the next rather than adding up
+   printf("Sleeping until 100 deadlines 5ms apart...\n");
+   long long period = 5 * PX_NS_PER_MS;
+   long long late = 0, worst = 0;
+   startNS = pxNanoseconds();
+   for (int i = 1; i <= 100; i++)
+   {
+      long long deadline = startNS + i*period;
+      pxSleepUntil(deadline);
+      long long l = pxNanoseconds() - deadline;
+      late += l;
+      if (l > worst)
+         worst = l;
+   }
+   endNS = pxNanoseconds();
+
+   printf("\telapsed %gms, expected %gms\n", 
+          (double)(endNS-startNS)/PX_NS_PER_MS, 
+          (double)(100*period)/PX_NS_PER_MS);
+   printf("\twoke %gus late on average, %gus at worst\n\n", 
+          (double)late/100/PX_NS_PER_US, (double)worst/PX_NS_PER_US);
+
    printf("Press <Enter> to continue.");
    getchar();
    printf("\n");
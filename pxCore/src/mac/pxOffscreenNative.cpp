@@ -4,33 +4,57 @@
 
 #include "pxOffscreen.h"
 
-pxError pxOffscreen::init(int width, int height)
+pxError pxOffscreen::init(int width, int height, unsigned int flags)
 {
-	term();
+	if (width < 0 || height < 0)
+	{
+		term();
+		return PX_FAIL;
+	}
 
-	Rect pr;
-	MacSetRect(&pr, 0, 0, width, height);	
+	int stride = alignedStride(width);
+	size_t bytes = (size_t)stride * height;
 
-	data = new char[4 * width * height];
-	
-	if (data)
+	// Keep the memory we have if the new size fits in it, only the
+	// GWorld describing it has to change
+	if (data && flags == allocFlags && bytes <= capacity)
+	{
+		if (gworld)
+		{
+			DisposeGWorld(gworld);
+			gworld = NULL;
+		}
+		countReuse();
+	}
+	else
 	{
-		NewGWorldFromPtr (&gworld, 32, &pr, NULL, NULL, 0, (char*)data, 4*width);
+		term();
 
-		setBase(data);
-		setWidth(width);
-		setHeight(height);
-		setStride(width*4);
-		setUpsideDown(false);
+		data = (char*)allocPixels(bytes, capacity, flags);
+		if (!data)
+			return PX_FAIL;
+		allocFlags = flags;
 	}
 
+	Rect pr;
+	MacSetRect(&pr, 0, 0, width, height);	
+
+	NewGWorldFromPtr (&gworld, 32, &pr, NULL, NULL, 0, (char*)data, stride);
+
+	setBase(data);
+	setWidth(width);
+	setHeight(height);
+	setStride(stride);
+	setUpsideDown(false);
+
 	return (gworld && data)?PX_OK:PX_FAIL;
 }
 
 pxError pxOffscreen::term()
 {
-	delete [] data; 
+	freePixels(data, capacity, allocFlags);
 	data = NULL;
+	capacity = 0;
 		
 	if (gworld)
 	{
@@ -40,4 +64,3 @@ pxError pxOffscreen::term()
 	return PX_OK;
 }
 
-
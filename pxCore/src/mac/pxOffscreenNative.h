@@ -10,10 +10,15 @@
 class pxOffscreenNative: public pxBuffer
 {
 public:
-	pxOffscreenNative(): gworld(NULL), data(NULL) {}
+	pxOffscreenNative(): gworld(NULL), data(NULL), capacity(0), allocFlags(0) {}
+
+	// Blits have finished with the pixels by the time they return
+	void waitForBlits() {}
 protected:
 	GWorldPtr gworld;
 	char* data;
+	size_t capacity;
+	unsigned int allocFlags;
 };
 
 #endif
\ No newline at end of file
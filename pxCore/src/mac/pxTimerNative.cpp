@@ -29,7 +29,26 @@ double  pxMicroseconds()
 	return t;
 }
 
+long long pxNanoseconds()
+{
+	UInt64 t;
+	Microseconds((UnsignedWide*) &t);
+	return (long long)t * PX_NS_PER_US;
+}
+
 void pxSleepMS(unsigned long msToSleep)
 {
 	usleep(msToSleep*1000);
 }
+
+void pxSleepUntil(long long deadline)
+{
+	// usleep wakes early on a signal so check the clock again
+	for (;;)
+	{
+		long long remaining = deadline - pxNanoseconds();
+		if (remaining <= 0)
+			break;
+		usleep((useconds_t)((remaining + PX_NS_PER_US - 1) / PX_NS_PER_US));
+	}
+}
@@ -164,6 +164,16 @@ pxError pxWindow::setAnimationFPS(long fps)
     return PX_OK;
 }
 
+void pxWindow::setAnimationPolicy(pxFramePolicy policy)
+{
+	// The event loop timer has no notion of deadlines
+}
+
+pxError pxWindow::animationStats(pxFrameStats& stats)
+{
+	return PX_FAIL;
+}
+
 void pxWindow::setTitle(char* title)
 {
 	SetWindowTitleWithCFString(mWindowRef,CFStringCreateWithCString(nil,title,kCFStringEncodingASCII));
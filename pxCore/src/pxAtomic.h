@@ -0,0 +1,102 @@
+// pxCore CopyRight 2007 John Robinson
+// Portable Framebuffer and Windowing Library
+// pxAtomic.h
+
+#ifndef PX_ATOMIC_H
+#define PX_ATOMIC_H
+
+#include "pxCore.h"
+
+// Interlocked operations used for refcounting and lock free queues.
+// All of them are full memory barriers.
+
+#if defined(PX_PLATFORM_WIN)
+
+inline long pxAtomicIncrement(volatile long* p)
+{
+    return InterlockedIncrement((long*)p);
+}
+
+inline long pxAtomicDecrement(volatile long* p)
+{
+    return InterlockedDecrement((long*)p);
+}
+
+// Adds v to *p and returns the new value
+inline long pxAtomicAdd(volatile long* p, long v)
+{
+    return InterlockedExchangeAdd((long*)p, v) + v;
+}
+
+// Sets *p to newValue if it is equal to oldValue.  Returns true on success.
+inline bool pxAtomicCompareAndSwap(volatile long* p, long oldValue, long newValue)
+{
+    return InterlockedCompareExchange((long*)p, newValue, oldValue) == oldValue;
+}
+
+inline void pxMemoryBarrier()
+{
+    MemoryBarrier();
+}
+
+// Pointer versions for linking lock free lists
+inline void* pxAtomicExchangePointer(void* volatile* p, void* v)
+{
+    return InterlockedExchangePointer((PVOID*)p, v);
+}
+
+inline bool pxAtomicCompareAndSwapPointer(void* volatile* p, void* oldValue, void* newValue)
+{
+    return InterlockedCompareExchangePointer((PVOID*)p, newValue, oldValue) == oldValue;
+}
+
+#else
+
+inline long pxAtomicIncrement(volatile long* p)
+{
+    return __sync_add_and_fetch(p, 1);
+}
+
+inline long pxAtomicDecrement(volatile long* p)
+{
+    return __sync_sub_and_fetch(p, 1);
+}
+
+// Adds v to *p and returns the new value
+inline long pxAtomicAdd(volatile long* p, long v)
+{
+    return __sync_add_and_fetch(p, v);
+}
+
+// Sets *p to newValue if it is equal to oldValue.  Returns true on success.
+inline bool pxAtomicCompareAndSwap(volatile long* p, long oldValue, long newValue)
+{
+    return __sync_bool_compare_and_swap(p, oldValue, newValue);
+}
+
+inline void pxMemoryBarrier()
+{
+    __sync_synchronize();
+}
+
+// Pointer versions for linking lock free lists
+inline bool pxAtomicCompareAndSwapPointer(void* volatile* p, void* oldValue, void* newValue)
+{
+    return __sync_bool_compare_and_swap(p, oldValue, newValue);
+}
+
+// __sync_lock_test_and_set is only an acquire barrier so swap with a
+// compare and swap loop instead
+inline void* pxAtomicExchangePointer(void* volatile* p, void* v)
+{
+    void* old;
+    do
+    {
+        old = *p;
+    } while (!__sync_bool_compare_and_swap(p, old, v));
+    return old;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,638 @@
+// pxCore CopyRight 2007 John Robinson
+// Portable Framebuffer and Windowing Library
+// pxBuffer.cpp
+
+#include "pxCore.h"
+#include "pxBuffer.h"
+#include "pxCpu.h"
+
+#include <string.h>
+
+#if defined(PX_SIMD_X86)
+#include <immintrin.h>
+#endif
+
+// Fills bigger than this bypass the cache with non-temporal stores.  A
+// surface that size won't be in the cache anyway and streaming it out
+// leaves the cache to whatever is going to be drawn next.
+#define PX_STREAMING_FILL_BYTES     (4*1024*1024)
+
+typedef void (*fillFunc)(pxPixel* p, int count, unsigned int value, bool stream);
+typedef void (*fillAlphaFunc)(pxPixel* p, int count, unsigned char alpha);
+
+// Scalar kernels
+
+static void fillSpan(pxPixel* p, int count, unsigned int value, bool)
+{
+    unsigned int* d = (unsigned int*)p;
+    unsigned int* de = d + count;
+    while (d < de)
+        *d++ = value;
+}
+
+static void fillAlphaSpan(pxPixel* p, int count, unsigned char alpha)
+{
+    pxPixel* pe = p + count;
+    while (p < pe)
+    {
+        p->a = alpha;
+        p++;
+    }
+}
+
+// The alpha byte of a pixel as a 32 bit value
+#define PX_ALPHA_MASK   0xff000000
+
+#if defined(PX_SIMD_X86)
+
+// SSE2 kernels
+
+PX_TARGET_SSE2 static void fillSpanSSE2(pxPixel* p, int count, unsigned int value,
+                                        bool stream)
+{
+    unsigned int* d = (unsigned int*)p;
+    unsigned int* de = d + count;
+
+    // Pixels are 4 byte aligned so at most 3 go before the first 16
+    // byte boundary
+    while (d < de && ((size_t)d & 15))
+        *d++ = value;
+
+    __m128i v = _mm_set1_epi32(value);
+    if (stream)
+    {
+        for (; d + 16 <= de; d += 16)
+        {
+            _mm_stream_si128((__m128i*)d, v);
+            _mm_stream_si128((__m128i*)(d+4), v);
+            _mm_stream_si128((__m128i*)(d+8), v);
+            _mm_stream_si128((__m128i*)(d+12), v);
+        }
+        _mm_sfence();
+    }
+    else
+    {
+        for (; d + 16 <= de; d += 16)
+        {
+            _mm_store_si128((__m128i*)d, v);
+            _mm_store_si128((__m128i*)(d+4), v);
+            _mm_store_si128((__m128i*)(d+8), v);
+            _mm_store_si128((__m128i*)(d+12), v);
+        }
+    }
+    for (; d + 4 <= de; d += 4)
+        _mm_store_si128((__m128i*)d, v);
+
+    while (d < de)
+        *d++ = value;
+}
+
+PX_TARGET_SSE2 static void fillAlphaSpanSSE2(pxPixel* p, int count, unsigned char alpha)
+{
+    unsigned int* d = (unsigned int*)p;
+    unsigned int* de = d + count;
+    unsigned int a = (unsigned int)alpha << 24;
+
+    while (d < de && ((size_t)d & 15))
+    {
+        *d = (*d & ~PX_ALPHA_MASK) | a;
+        d++;
+    }
+
+    __m128i keep = _mm_set1_epi32(~PX_ALPHA_MASK);
+    __m128i va = _mm_set1_epi32(a);
+    for (; d + 8 <= de; d += 8)
+    {
+        __m128i p0 = _mm_load_si128((__m128i*)d);
+        __m128i p1 = _mm_load_si128((__m128i*)(d+4));
+        _mm_store_si128((__m128i*)d, _mm_or_si128(_mm_and_si128(p0, keep), va));
+        _mm_store_si128((__m128i*)(d+4), _mm_or_si128(_mm_and_si128(p1, keep), va));
+    }
+
+    while (d < de)
+    {
+        *d = (*d & ~PX_ALPHA_MASK) | a;
+        d++;
+    }
+}
+
+// AVX2 kernels
+
+PX_TARGET_AVX2 static void fillSpanAVX2(pxPixel* p, int count, unsigned int value,
+                                        bool stream)
+{
+    unsigned int* d = (unsigned int*)p;
+    unsigned int* de = d + count;
+
+    while (d < de && ((size_t)d & 31))
+        *d++ = value;
+
+    __m256i v = _mm256_set1_epi32(value);
+    if (stream)
+    {
+        for (; d + 32 <= de; d += 32)
+        {
+            _mm256_stream_si256((__m256i*)d, v);
+            _mm256_stream_si256((__m256i*)(d+8), v);
+            _mm256_stream_si256((__m256i*)(d+16), v);
+            _mm256_stream_si256((__m256i*)(d+24), v);
+        }
+        _mm_sfence();
+    }
+    else
+    {
+        for (; d + 32 <= de; d += 32)
+        {
+            _mm256_store_si256((__m256i*)d, v);
+            _mm256_store_si256((__m256i*)(d+8), v);
+            _mm256_store_si256((__m256i*)(d+16), v);
+            _mm256_store_si256((__m256i*)(d+24), v);
+        }
+    }
+    for (; d + 8 <= de; d += 8)
+        _mm256_store_si256((__m256i*)d, v);
+
+    while (d < de)
+        *d++ = value;
+}
+
+PX_TARGET_AVX2 static void fillAlphaSpanAVX2(pxPixel* p, int count, unsigned char alpha)
+{
+    unsigned int* d = (unsigned int*)p;
+    unsigned int* de = d + count;
+    unsigned int a = (unsigned int)alpha << 24;
+
+    while (d < de && ((size_t)d & 31))
+    {
+        *d = (*d & ~PX_ALPHA_MASK) | a;
+        d++;
+    }
+
+    __m256i keep = _mm256_set1_epi32(~PX_ALPHA_MASK);
+    __m256i va = _mm256_set1_epi32(a);
+    for (; d + 16 <= de; d += 16)
+    {
+        __m256i p0 = _mm256_load_si256((__m256i*)d);
+        __m256i p1 = _mm256_load_si256((__m256i*)(d+8));
+        _mm256_store_si256((__m256i*)d, _mm256_or_si256(_mm256_and_si256(p0, keep), va));
+        _mm256_store_si256((__m256i*)(d+8), _mm256_or_si256(_mm256_and_si256(p1, keep), va));
+    }
+
+    while (d < de)
+    {
+        *d = (*d & ~PX_ALPHA_MASK) | a;
+        d++;
+    }
+}
+
+#endif
+
+static fillFunc pickFill()
+{
+#if defined(PX_SIMD_X86)
+    unsigned int features = pxCpuFeatures();
+    if (features & PX_CPU_AVX2)
+        return fillSpanAVX2;
+    if (features & PX_CPU_SSE2)
+        return fillSpanSSE2;
+#endif
+    return fillSpan;
+}
+
+static fillAlphaFunc pickFillAlpha()
+{
+#if defined(PX_SIMD_X86)
+    unsigned int features = pxCpuFeatures();
+    if (features & PX_CPU_AVX2)
+        return fillAlphaSpanAVX2;
+    if (features & PX_CPU_SSE2)
+        return fillAlphaSpanSSE2;
+#endif
+    return fillAlphaSpan;
+}
+
+void pxBuffer::fill(const pxRect& r, const pxColor& color)
+{
+    // calc clip
+    pxRect c = bounds();
+    c.intersect(r);
+
+    if (c.width() <= 0 || c.height() <= 0)
+        return;
+
+    fillFunc f = pickFill();
+    bool stream = (double)c.width() * c.height() * 4 > PX_STREAMING_FILL_BYTES;
+
+    if (c.width() == width() && mStride == width()*4)
+    {
+        // Whole rows with no padding between them are one span.  The
+        // lowest row in memory depends on the orientation.
+        f(scanline(mUpsideDown?c.bottom()-1:c.top()), c.width()*c.height(),
+          color.u, stream);
+        return;
+    }
+
+    for (int i = c.top(); i < c.bottom(); i++)
+        f(pixel(c.left(), i), c.width(), color.u, stream);
+}
+
+void pxBuffer::fill(const pxColor& color)
+{
+    fill(bounds(), color);
+}
+
+void pxBuffer::fillAlpha(unsigned char alpha)
+{
+    if (width() <= 0 || height() <= 0)
+        return;
+
+    fillAlphaFunc f = pickFillAlpha();
+
+    if (mStride == width()*4)
+    {
+        f(scanline(mUpsideDown?height()-1:0), width()*height(), alpha);
+        return;
+    }
+
+    for (int i = 0; i < height(); i++)
+        f(scanline(i), width(), alpha);
+}
+
+// Clips a blit of a dstWidth x dstHeight rect at srcLeft, srcTop in src
+// to dstLeft, dstTop in dst.  The source rect is clipped to src, moved
+// over to dst and clipped again, what's left maps back to the source by
+// the same offset.  Returns false if nothing is left.
+static bool clipBlit(const pxBuffer& src, const pxBuffer& dst, 
+                     int dstLeft, int dstTop, int dstWidth, int dstHeight, 
+                     int srcLeft, int srcTop, pxRect& c, int& sx, int& sy)
+{
+    int dx = dstLeft - srcLeft;
+    int dy = dstTop - srcTop;
+
+    c = pxRect(srcLeft, srcTop, srcLeft+dstWidth, srcTop+dstHeight);
+    c.intersect(src.bounds());
+    c = pxRect(c.left()+dx, c.top()+dy, c.right()+dx, c.bottom()+dy);
+    c.intersect(dst.bounds());
+
+    sx = c.left() - dx;
+    sy = c.top() - dy;
+    return c.width() > 0 && c.height() > 0;
+}
+
+void pxBuffer::blit(pxBuffer& b, int dstLeft, int dstTop, 
+                    int dstWidth, int dstHeight, 
+                    int srcLeft, int srcTop)
+{
+    pxRect c;
+    int sx, sy;
+    if (!clipBlit(*this, b, dstLeft, dstTop, dstWidth, dstHeight, 
+                  srcLeft, srcTop, c, sx, sy))
+        return;
+
+    int w = c.width();
+    int h = c.height();
+    int rowBytes = w * 4;
+
+    if (rowBytes == mStride && rowBytes == b.mStride && 
+        mUpsideDown == b.mUpsideDown)
+    {
+        // Full width rows with no padding, laid out the same way in both
+        // buffers, are one block of memory.
+        int first = mUpsideDown?h-1:0;
+        memmove((void*)b.pixel(0, c.top()+first), pixel(0, sy+first), rowBytes * h);
+        return;
+    }
+
+    // When the buffers share memory and the destination is higher up in
+    // memory the rows have to be copied from the highest address down so
+    // that none are overwritten before they are read
+    bool later = (unsigned char*)b.pixel(c.left(), c.top()) > 
+                 (unsigned char*)pixel(sx, sy);
+    if (later != mUpsideDown)
+    {
+        for (int y = h-1; y >= 0; y--)
+            memmove((void*)b.pixel(c.left(), c.top()+y), pixel(sx, sy+y), rowBytes);
+    }
+    else
+    {
+        for (int y = 0; y < h; y++)
+            memmove((void*)b.pixel(c.left(), c.top()+y), pixel(sx, sy+y), rowBytes);
+    }
+}
+
+// Compositing
+//
+// Everything is done in 8 bit fixed point with x/255 rounded to nearest,
+// computed as (t + (t >> 8)) >> 8 with t = x + 128.  The SIMD kernels do
+// exactly the same arithmetic so they match the scalar ones bit for bit.
+//
+// Straight alpha: a = sa*alpha/255, d = (s*a + d*(255-a))/255 for the
+// colors and a + da*(255-a)/255 for the alpha, which is the same mix
+// with 255 in place of the source alpha.
+//
+// Premultiplied: s = s*alpha/255, d = s + d*(255-sa)/255 saturated.
+
+typedef void (*blendFunc)(const pxPixel* s, pxPixel* d, int count, 
+                          unsigned int alpha);
+
+static inline unsigned int div255(unsigned int x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+static inline unsigned int blendPixel(unsigned int s, unsigned int d, 
+                                      unsigned int alpha)
+{
+    unsigned int a = div255((s >> 24) * alpha);
+    if (a == 0)
+        return d;
+    if (a == 255)
+        return s;
+
+    unsigned int r = 0;
+    s |= PX_ALPHA_MASK;
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        unsigned int sc = (s >> shift) & 0xff;
+        unsigned int dc = (d >> shift) & 0xff;
+        r |= div255(sc*a + dc*(255-a)) << shift;
+    }
+    return r;
+}
+
+static inline unsigned int blendPixelPremultiplied(unsigned int s, unsigned int d, 
+                                                   unsigned int alpha)
+{
+    if (s == 0)
+        return d;
+    if ((s >> 24) == 255 && alpha == 255)
+        return s;
+
+    unsigned int r = 0;
+    unsigned int a = div255((s >> 24) * alpha);
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        unsigned int sc = div255(((s >> shift) & 0xff) * alpha);
+        unsigned int dc = (d >> shift) & 0xff;
+        r |= pxMin<unsigned int>(255, sc + div255(dc*(255-a))) << shift;
+    }
+    return r;
+}
+
+static void blendSpan(const pxPixel* s, pxPixel* d, int count, unsigned int alpha)
+{
+    for (int i = 0; i < count; i++)
+        d[i].u = blendPixel(s[i].u, d[i].u, alpha);
+}
+
+static void blendSpanPremultiplied(const pxPixel* s, pxPixel* d, int count, 
+                                   unsigned int alpha)
+{
+    for (int i = 0; i < count; i++)
+        d[i].u = blendPixelPremultiplied(s[i].u, d[i].u, alpha);
+}
+
+#if defined(PX_SIMD_X86)
+
+// The kernels work on pixels unpacked to 16 bits per channel, two per
+// 128 bit lane, and skip groups of pixels that are all transparent or
+// (with no global alpha) all opaque.
+
+// SSE2 kernels
+
+PX_TARGET_SSE2 static inline __m128i div255SSE2(__m128i x)
+{
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+PX_TARGET_SSE2 static inline __m128i alphaSSE2(__m128i p)
+{
+    return _mm_shufflehi_epi16(_mm_shufflelo_epi16(p, 0xff), 0xff);
+}
+
+PX_TARGET_SSE2 static inline __m128i mixSSE2(__m128i s, __m128i d, __m128i alpha)
+{
+    __m128i a = div255SSE2(_mm_mullo_epi16(alphaSSE2(s), alpha));
+    s = _mm_or_si128(s, _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0));
+    return div255SSE2(_mm_add_epi16(_mm_mullo_epi16(s, a), 
+        _mm_mullo_epi16(d, _mm_sub_epi16(_mm_set1_epi16(255), a))));
+}
+
+PX_TARGET_SSE2 static inline __m128i mixPremultipliedSSE2(__m128i s, __m128i d, 
+                                                          __m128i alpha)
+{
+    s = div255SSE2(_mm_mullo_epi16(s, alpha));
+    __m128i a = alphaSSE2(s);
+    return _mm_add_epi16(s, div255SSE2(_mm_mullo_epi16(d, 
+        _mm_sub_epi16(_mm_set1_epi16(255), a))));
+}
+
+PX_TARGET_SSE2 static void blendSpanSSE2(const pxPixel* s, pxPixel* d, int count, 
+                                         unsigned int alpha)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i alphaMask = _mm_set1_epi32(PX_ALPHA_MASK);
+    __m128i va = _mm_set1_epi16(alpha);
+    bool opaque = alpha == 255;
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i sp = _mm_loadu_si128((__m128i*)(s+i));
+        __m128i sa = _mm_and_si128(sp, alphaMask);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(sa, zero)) == 0xffff)
+            continue;
+        if (opaque && _mm_movemask_epi8(_mm_cmpeq_epi32(sa, alphaMask)) == 0xffff)
+        {
+            _mm_storeu_si128((__m128i*)(d+i), sp);
+            continue;
+        }
+
+        __m128i dp = _mm_loadu_si128((__m128i*)(d+i));
+        __m128i lo = mixSSE2(_mm_unpacklo_epi8(sp, zero), 
+                             _mm_unpacklo_epi8(dp, zero), va);
+        __m128i hi = mixSSE2(_mm_unpackhi_epi8(sp, zero), 
+                             _mm_unpackhi_epi8(dp, zero), va);
+        _mm_storeu_si128((__m128i*)(d+i), _mm_packus_epi16(lo, hi));
+    }
+
+    blendSpan(s+i, d+i, count-i, alpha);
+}
+
+PX_TARGET_SSE2 static void blendSpanPremultipliedSSE2(const pxPixel* s, pxPixel* d, 
+                                                      int count, unsigned int alpha)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i alphaMask = _mm_set1_epi32(PX_ALPHA_MASK);
+    __m128i va = _mm_set1_epi16(alpha);
+    bool opaque = alpha == 255;
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i sp = _mm_loadu_si128((__m128i*)(s+i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(sp, zero)) == 0xffff)
+            continue;
+        if (opaque && _mm_movemask_epi8(_mm_cmpeq_epi32(
+                _mm_and_si128(sp, alphaMask), alphaMask)) == 0xffff)
+        {
+            _mm_storeu_si128((__m128i*)(d+i), sp);
+            continue;
+        }
+
+        __m128i dp = _mm_loadu_si128((__m128i*)(d+i));
+        __m128i lo = mixPremultipliedSSE2(_mm_unpacklo_epi8(sp, zero), 
+                                          _mm_unpacklo_epi8(dp, zero), va);
+        __m128i hi = mixPremultipliedSSE2(_mm_unpackhi_epi8(sp, zero), 
+                                          _mm_unpackhi_epi8(dp, zero), va);
+        _mm_storeu_si128((__m128i*)(d+i), _mm_packus_epi16(lo, hi));
+    }
+
+    blendSpanPremultiplied(s+i, d+i, count-i, alpha);
+}
+
+// AVX2 kernels
+
+PX_TARGET_AVX2 static inline __m256i div255AVX2(__m256i x)
+{
+    x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+PX_TARGET_AVX2 static inline __m256i alphaAVX2(__m256i p)
+{
+    return _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(p, 0xff), 0xff);
+}
+
+PX_TARGET_AVX2 static inline __m256i mixAVX2(__m256i s, __m256i d, __m256i alpha)
+{
+    __m256i a = div255AVX2(_mm256_mullo_epi16(alphaAVX2(s), alpha));
+    s = _mm256_or_si256(s, _mm256_set_epi16(255, 0, 0, 0, 255, 0, 0, 0, 
+                                            255, 0, 0, 0, 255, 0, 0, 0));
+    return div255AVX2(_mm256_add_epi16(_mm256_mullo_epi16(s, a), 
+        _mm256_mullo_epi16(d, _mm256_sub_epi16(_mm256_set1_epi16(255), a))));
+}
+
+PX_TARGET_AVX2 static inline __m256i mixPremultipliedAVX2(__m256i s, __m256i d, 
+                                                          __m256i alpha)
+{
+    s = div255AVX2(_mm256_mullo_epi16(s, alpha));
+    __m256i a = alphaAVX2(s);
+    return _mm256_add_epi16(s, div255AVX2(_mm256_mullo_epi16(d, 
+        _mm256_sub_epi16(_mm256_set1_epi16(255), a))));
+}
+
+PX_TARGET_AVX2 static void blendSpanAVX2(const pxPixel* s, pxPixel* d, int count, 
+                                         unsigned int alpha)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i alphaMask = _mm256_set1_epi32(PX_ALPHA_MASK);
+    __m256i va = _mm256_set1_epi16(alpha);
+    bool opaque = alpha == 255;
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i sp = _mm256_loadu_si256((__m256i*)(s+i));
+        __m256i sa = _mm256_and_si256(sp, alphaMask);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(sa, zero)) == -1)
+            continue;
+        if (opaque && _mm256_movemask_epi8(_mm256_cmpeq_epi32(sa, alphaMask)) == -1)
+        {
+            _mm256_storeu_si256((__m256i*)(d+i), sp);
+            continue;
+        }
+
+        // Unpacking and packing both work within 128 bit lanes so the
+        // pixels come back out in order
+        __m256i dp = _mm256_loadu_si256((__m256i*)(d+i));
+        __m256i lo = mixAVX2(_mm256_unpacklo_epi8(sp, zero), 
+                             _mm256_unpacklo_epi8(dp, zero), va);
+        __m256i hi = mixAVX2(_mm256_unpackhi_epi8(sp, zero), 
+                             _mm256_unpackhi_epi8(dp, zero), va);
+        _mm256_storeu_si256((__m256i*)(d+i), _mm256_packus_epi16(lo, hi));
+    }
+
+    blendSpan(s+i, d+i, count-i, alpha);
+}
+
+PX_TARGET_AVX2 static void blendSpanPremultipliedAVX2(const pxPixel* s, pxPixel* d, 
+                                                      int count, unsigned int alpha)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i alphaMask = _mm256_set1_epi32(PX_ALPHA_MASK);
+    __m256i va = _mm256_set1_epi16(alpha);
+    bool opaque = alpha == 255;
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i sp = _mm256_loadu_si256((__m256i*)(s+i));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(sp, zero)) == -1)
+            continue;
+        if (opaque && _mm256_movemask_epi8(_mm256_cmpeq_epi32(
+                _mm256_and_si256(sp, alphaMask), alphaMask)) == -1)
+        {
+            _mm256_storeu_si256((__m256i*)(d+i), sp);
+            continue;
+        }
+
+        __m256i dp = _mm256_loadu_si256((__m256i*)(d+i));
+        __m256i lo = mixPremultipliedAVX2(_mm256_unpacklo_epi8(sp, zero), 
+                                          _mm256_unpacklo_epi8(dp, zero), va);
+        __m256i hi = mixPremultipliedAVX2(_mm256_unpackhi_epi8(sp, zero), 
+                                          _mm256_unpackhi_epi8(dp, zero), va);
+        _mm256_storeu_si256((__m256i*)(d+i), _mm256_packus_epi16(lo, hi));
+    }
+
+    blendSpanPremultiplied(s+i, d+i, count-i, alpha);
+}
+
+#endif
+
+static blendFunc pickBlend(bool premultiplied)
+{
+#if defined(PX_SIMD_X86)
+    unsigned int features = pxCpuFeatures();
+    if (features & PX_CPU_AVX2)
+        return premultiplied?blendSpanPremultipliedAVX2:blendSpanAVX2;
+    if (features & PX_CPU_SSE2)
+        return premultiplied?blendSpanPremultipliedSSE2:blendSpanSSE2;
+#endif
+    return premultiplied?blendSpanPremultiplied:blendSpan;
+}
+
+static void blendRows(const pxBuffer& src, pxBuffer& dst, 
+                      int dstLeft, int dstTop, int dstWidth, int dstHeight, 
+                      int srcLeft, int srcTop, unsigned char alpha, 
+                      bool premultiplied)
+{
+    pxRect c;
+    int sx, sy;
+    if (alpha == 0 || 
+        !clipBlit(src, dst, dstLeft, dstTop, dstWidth, dstHeight, 
+                  srcLeft, srcTop, c, sx, sy))
+        return;
+
+    blendFunc f = pickBlend(premultiplied);
+    for (int y = 0; y < c.height(); y++)
+        f(src.scanline(sy+y) + sx, dst.pixel(c.left(), c.top()+y), c.width(), alpha);
+}
+
+void pxBuffer::blend(pxBuffer& b, int dstLeft, int dstTop, 
+                     int dstWidth, int dstHeight, 
+                     int srcLeft, int srcTop, unsigned char alpha)
+{
+    blendRows(*this, b, dstLeft, dstTop, dstWidth, dstHeight, 
+              srcLeft, srcTop, alpha, false);
+}
+
+void pxBuffer::blendPremultiplied(pxBuffer& b, int dstLeft, int dstTop, 
+                                  int dstWidth, int dstHeight, 
+                                  int srcLeft, int srcTop, unsigned char alpha)
+{
+    blendRows(*this, b, dstLeft, dstTop, dstWidth, dstHeight, 
+              srcLeft, srcTop, alpha, true);
+}
@@ -37,9 +37,9 @@ public:
     bool upsideDown() const { return mUpsideDown; }
     void setUpsideDown(bool upsideDown) { mUpsideDown = upsideDown; }
     
-    inline unsigned long *scanlineInt32(int line) const
+    inline unsigned int *scanlineInt32(int line) const
     {
-		return (unsigned long*)((unsigned char*)mBase + 
+		return (unsigned int*)((unsigned char*)mBase + 
 			((mUpsideDown?(mHeight-line-1):line) * mStride));
     }
 
@@ -64,47 +64,14 @@ public:
         return pxRect(0, 0, width(), height());
     }
 
-    void fill(const pxRect& r, const pxColor& color)
-    {
-        // calc clip
-        pxRect c = bounds();
-        c.intersect(r);
-
-	for (int i = c.top(); i < c.bottom(); i++)
-	{
-    	     pxPixel *p = pixel(c.left(), i);
-             pxPixel *pe = p + c.width();
-             while (p < pe)
-	     {
-                 *p++ = color;
-	     }
-        }
-    }
-
-    void fill(const pxColor& color)
-    {
-	for (int i = 0; i < height(); i++)
-	{
-		pxPixel *p = scanline(i);
-		for (int j = 0; j < width(); j++)
-		{
-			*p++ = color;
-		}
-	}
-    }
+    // Fills are done with SIMD stores where available.  Rows with no
+    // padding between them are filled as one span and large fills
+    // bypass the cache.
+    void fill(const pxRect& r, const pxColor& color);
+    void fill(const pxColor& color);
 
-    void fillAlpha(unsigned char alpha)
-    {
-	    for (int i = 0; i < height(); i++)
-	    {
-		    pxPixel*p = scanline(i);
-		    for (int j = 0; j < width(); j++)
-		    {
-			    p->a = alpha;
-			    p++;
-		    }
-	    }
-    }
+    // Sets the alpha of every pixel leaving the color alone
+    void fillAlpha(unsigned char alpha);
 
     void blit(pxSurfaceNative s, int dstLeft, int dstRight, 
               int dstWidth, int dstHeight, 
@@ -124,39 +91,34 @@ public:
         blit(s, 0, 0, width(), height(), 0, 0);
     }
     
-    inline void blit(pxBuffer& b, int dstLeft, int dstTop, 
+    // Copies a dstWidth x dstHeight rectangle at srcLeft, srcTop in this
+    // buffer to dstLeft, dstTop in b, clipped to both buffers.  Rows are
+    // copied whole with memmove and buffers whose rows are contiguous and
+    // laid out the same way are copied in one go.  The buffers may share
+    // memory (scrolling within a buffer for instance).
+    void blit(pxBuffer& b, int dstLeft, int dstTop, 
               int dstWidth, int dstHeight, 
-              int srcLeft, int srcTop)
-    {
-        pxRect srcBounds = bounds();
-        pxRect dstBounds = b.bounds();
-
-        pxRect srcRect(srcLeft, srcTop, srcLeft+dstWidth, srcTop+dstHeight);
-        pxRect dstRect(dstLeft, dstTop, dstLeft+dstWidth, dstTop+dstHeight);
-
-        srcBounds.intersect(srcRect);
-        dstBounds.intersect(dstRect);
-
-        int w = pxMin<int>(srcBounds.width(), dstBounds.width());
-        int h = pxMin<int>(srcBounds.height(), dstBounds.height());
-
-        for (int y = 0; y < h; y++)
-        {
-            pxPixel *s = scanline(y+srcBounds.top());
-            pxPixel *se = s + w;
-            pxPixel *d = b.scanline(y+dstBounds.top());
-            while(s < se)
-            {
-                *d++ = *s++;
-            }
-        }
-    }
+              int srcLeft, int srcTop);
 
     inline void blit(pxBuffer b)
     {
         blit(b, 0, 0, width(), height(), 0, 0);
     }
 
+    // Composites a rectangle of this buffer over b, clipped the same way
+    // as blit.  alpha is applied on top of each pixel's own alpha.  With
+    // straight alpha the colors are mixed by the source alpha and b's
+    // alpha becomes sa + da*(1-sa).  Premultiplied sources are added to
+    // b scaled by 1-sa.  Transparent and opaque runs are skipped or
+    // copied without blending.
+    void blend(pxBuffer& b, int dstLeft, int dstTop, 
+               int dstWidth, int dstHeight, 
+               int srcLeft, int srcTop, unsigned char alpha = 255);
+
+    void blendPremultiplied(pxBuffer& b, int dstLeft, int dstTop, 
+                            int dstWidth, int dstHeight, 
+                            int srcLeft, int srcTop, unsigned char alpha = 255);
+
 protected:
     void* mBase;
     int mWidth;
@@ -0,0 +1,366 @@
+// pxCore CopyRight 2007 John Robinson
+// Portable Framebuffer and Windowing Library
+// pxColorConvert.cpp
+
+#include "pxColorConvert.h"
+#include "pxCpu.h"
+
+#include <string.h>
+
+#if defined(PX_SIMD_X86)
+#include <immintrin.h>
+#endif
+
+// Every kernel converts a single row.  Packed formats only use y, NV12
+// passes the uv plane as u.
+typedef void (*rowFunc)(const unsigned char* y, const unsigned char* u,
+                        const unsigned char* v, pxPixel* dst, int width);
+
+// Coefficients in 6 bit fixed point so that the SIMD kernels can work in
+// 16 bit lanes and still match the scalar code bit for bit.  Sums that
+// overflow 16 bits saturate and end up clamped to 255 either way.
+#define PX_YUV_Y    75      // 1.164
+#define PX_YUV_RV   102     // 1.596
+#define PX_YUV_GU   25      // 0.391
+#define PX_YUV_GV   52      // 0.813
+#define PX_YUV_BU   129     // 2.018
+
+static inline unsigned char clamp255(int c)
+{
+    return (unsigned char)((c < 0)?0:(c > 255)?255:c);
+}
+
+static inline void yuvToPixel(int y, int u, int v, pxPixel* p)
+{
+    int c = (y - 16) * PX_YUV_Y + 32;
+    u -= 128;
+    v -= 128;
+    p->r = clamp255((c + PX_YUV_RV * v) >> 6);
+    p->g = clamp255((c - PX_YUV_GU * u - PX_YUV_GV * v) >> 6);
+    p->b = clamp255((c + PX_YUV_BU * u) >> 6);
+    p->a = 255;
+}
+
+// Scalar kernels
+
+static inline void packedRow(const unsigned char* s, pxPixel* d, int width,
+                             int yOffset, int uOffset, int vOffset)
+{
+    for (int x = 0; x < width; x += 2)
+    {
+        int u = s[uOffset];
+        int v = s[vOffset];
+        yuvToPixel(s[yOffset], u, v, d++);
+        if (x+1 < width)
+            yuvToPixel(s[yOffset+2], u, v, d++);
+        s += 4;
+    }
+}
+
+static void yuy2Row(const unsigned char* y, const unsigned char*,
+                    const unsigned char*, pxPixel* dst, int width)
+{
+    packedRow(y, dst, width, 0, 1, 3);
+}
+
+static void uyvyRow(const unsigned char* y, const unsigned char*,
+                    const unsigned char*, pxPixel* dst, int width)
+{
+    packedRow(y, dst, width, 1, 0, 2);
+}
+
+static void nv12Row(const unsigned char* y, const unsigned char* uv,
+                    const unsigned char*, pxPixel* dst, int width)
+{
+    for (int x = 0; x < width; x++)
+        yuvToPixel(y[x], uv[x & ~1], uv[x | 1], dst++);
+}
+
+static void i420Row(const unsigned char* y, const unsigned char* u,
+                    const unsigned char* v, pxPixel* dst, int width)
+{
+    for (int x = 0; x < width; x++)
+        yuvToPixel(y[x], u[x/2], v[x/2], dst++);
+}
+
+#if defined(PX_SIMD_X86)
+
+// SSE2 kernels, 8 pixels at a time
+
+// y holds 8 luma values and uv the 4 u, v pairs that go with them, all
+// as 16 bit lanes
+PX_TARGET_SSE2 static inline void yuvToPixels8(__m128i y, __m128i uv, pxPixel* dst)
+{
+    // Give every pixel its own copy of the chroma
+    __m128i u = _mm_and_si128(uv, _mm_set1_epi32(0xffff));
+    u = _mm_or_si128(u, _mm_slli_epi32(u, 16));
+    __m128i v = _mm_srli_epi32(uv, 16);
+    v = _mm_or_si128(v, _mm_slli_epi32(v, 16));
+    u = _mm_sub_epi16(u, _mm_set1_epi16(128));
+    v = _mm_sub_epi16(v, _mm_set1_epi16(128));
+
+    __m128i c = _mm_mullo_epi16(_mm_sub_epi16(y, _mm_set1_epi16(16)),
+                                _mm_set1_epi16(PX_YUV_Y));
+    c = _mm_add_epi16(c, _mm_set1_epi16(32));
+
+    __m128i r = _mm_adds_epi16(c, _mm_mullo_epi16(v, _mm_set1_epi16(PX_YUV_RV)));
+    __m128i g = _mm_adds_epi16(c, _mm_add_epi16(
+        _mm_mullo_epi16(u, _mm_set1_epi16(-PX_YUV_GU)),
+        _mm_mullo_epi16(v, _mm_set1_epi16(-PX_YUV_GV))));
+    __m128i b = _mm_adds_epi16(c, _mm_mullo_epi16(u, _mm_set1_epi16(PX_YUV_BU)));
+
+    r = _mm_packus_epi16(_mm_srai_epi16(r, 6), _mm_setzero_si128());
+    g = _mm_packus_epi16(_mm_srai_epi16(g, 6), _mm_setzero_si128());
+    b = _mm_packus_epi16(_mm_srai_epi16(b, 6), _mm_setzero_si128());
+
+    // b, g, r, a
+    __m128i bg = _mm_unpacklo_epi8(b, g);
+    __m128i ra = _mm_unpacklo_epi8(r, _mm_set1_epi8((char)0xff));
+    _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi16(bg, ra));
+    _mm_storeu_si128((__m128i*)(dst+4), _mm_unpackhi_epi16(bg, ra));
+}
+
+PX_TARGET_SSE2 static void yuy2RowSSE2(const unsigned char* y, const unsigned char* u,
+                                       const unsigned char* v, pxPixel* dst, int width)
+{
+    const __m128i lo = _mm_set1_epi16(0xff);
+    int x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+        __m128i p = _mm_loadu_si128((const __m128i*)(y + x*2));
+        yuvToPixels8(_mm_and_si128(p, lo), _mm_srli_epi16(p, 8), dst + x);
+    }
+    yuy2Row(y + x*2, u, v, dst + x, width - x);
+}
+
+PX_TARGET_SSE2 static void uyvyRowSSE2(const unsigned char* y, const unsigned char* u,
+                                       const unsigned char* v, pxPixel* dst, int width)
+{
+    const __m128i lo = _mm_set1_epi16(0xff);
+    int x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+        __m128i p = _mm_loadu_si128((const __m128i*)(y + x*2));
+        yuvToPixels8(_mm_srli_epi16(p, 8), _mm_and_si128(p, lo), dst + x);
+    }
+    uyvyRow(y + x*2, u, v, dst + x, width - x);
+}
+
+PX_TARGET_SSE2 static void nv12RowSSE2(const unsigned char* y, const unsigned char* uv,
+                                       const unsigned char* v, pxPixel* dst, int width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+        __m128i py = _mm_loadl_epi64((const __m128i*)(y + x));
+        __m128i puv = _mm_loadl_epi64((const __m128i*)(uv + x));
+        yuvToPixels8(_mm_unpacklo_epi8(py, zero), _mm_unpacklo_epi8(puv, zero),
+                     dst + x);
+    }
+    nv12Row(y + x, uv + x, v, dst + x, width - x);
+}
+
+static inline int load32(const unsigned char* p)
+{
+    int i;
+    memcpy(&i, p, 4);
+    return i;
+}
+
+PX_TARGET_SSE2 static void i420RowSSE2(const unsigned char* y, const unsigned char* u,
+                                       const unsigned char* v, pxPixel* dst, int width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+        __m128i py = _mm_loadl_epi64((const __m128i*)(y + x));
+        __m128i pu = _mm_cvtsi32_si128(load32(u + x/2));
+        __m128i pv = _mm_cvtsi32_si128(load32(v + x/2));
+        __m128i puv = _mm_unpacklo_epi8(pu, pv);
+        yuvToPixels8(_mm_unpacklo_epi8(py, zero), _mm_unpacklo_epi8(puv, zero),
+                     dst + x);
+    }
+    i420Row(y + x, u + x/2, v + x/2, dst + x, width - x);
+}
+
+// AVX2 kernels, 16 pixels at a time.  Each 128 bit lane works on 8
+// pixels exactly like the SSE2 kernels.
+
+PX_TARGET_AVX2 static inline void yuvToPixels16(__m256i y, __m256i uv, pxPixel* dst)
+{
+    __m256i u = _mm256_and_si256(uv, _mm256_set1_epi32(0xffff));
+    u = _mm256_or_si256(u, _mm256_slli_epi32(u, 16));
+    __m256i v = _mm256_srli_epi32(uv, 16);
+    v = _mm256_or_si256(v, _mm256_slli_epi32(v, 16));
+    u = _mm256_sub_epi16(u, _mm256_set1_epi16(128));
+    v = _mm256_sub_epi16(v, _mm256_set1_epi16(128));
+
+    __m256i c = _mm256_mullo_epi16(_mm256_sub_epi16(y, _mm256_set1_epi16(16)),
+                                   _mm256_set1_epi16(PX_YUV_Y));
+    c = _mm256_add_epi16(c, _mm256_set1_epi16(32));
+
+    __m256i r = _mm256_adds_epi16(c, _mm256_mullo_epi16(v, _mm256_set1_epi16(PX_YUV_RV)));
+    __m256i g = _mm256_adds_epi16(c, _mm256_add_epi16(
+        _mm256_mullo_epi16(u, _mm256_set1_epi16(-PX_YUV_GU)),
+        _mm256_mullo_epi16(v, _mm256_set1_epi16(-PX_YUV_GV))));
+    __m256i b = _mm256_adds_epi16(c, _mm256_mullo_epi16(u, _mm256_set1_epi16(PX_YUV_BU)));
+
+    const __m256i zero = _mm256_setzero_si256();
+    r = _mm256_packus_epi16(_mm256_srai_epi16(r, 6), zero);
+    g = _mm256_packus_epi16(_mm256_srai_epi16(g, 6), zero);
+    b = _mm256_packus_epi16(_mm256_srai_epi16(b, 6), zero);
+
+    __m256i bg = _mm256_unpacklo_epi8(b, g);
+    __m256i ra = _mm256_unpacklo_epi8(r, _mm256_set1_epi8((char)0xff));
+    __m256i lo = _mm256_unpacklo_epi16(bg, ra);     // pixels 0-3, 8-11
+    __m256i hi = _mm256_unpackhi_epi16(bg, ra);     // pixels 4-7, 12-15
+    _mm256_storeu_si256((__m256i*)dst, _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256((__m256i*)(dst+8), _mm256_permute2x128_si256(lo, hi, 0x31));
+}
+
+PX_TARGET_AVX2 static void yuy2RowAVX2(const unsigned char* y, const unsigned char* u,
+                                       const unsigned char* v, pxPixel* dst, int width)
+{
+    const __m256i lo = _mm256_set1_epi16(0xff);
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m256i p = _mm256_loadu_si256((const __m256i*)(y + x*2));
+        yuvToPixels16(_mm256_and_si256(p, lo), _mm256_srli_epi16(p, 8), dst + x);
+    }
+    yuy2RowSSE2(y + x*2, u, v, dst + x, width - x);
+}
+
+PX_TARGET_AVX2 static void uyvyRowAVX2(const unsigned char* y, const unsigned char* u,
+                                       const unsigned char* v, pxPixel* dst, int width)
+{
+    const __m256i lo = _mm256_set1_epi16(0xff);
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m256i p = _mm256_loadu_si256((const __m256i*)(y + x*2));
+        yuvToPixels16(_mm256_srli_epi16(p, 8), _mm256_and_si256(p, lo), dst + x);
+    }
+    uyvyRowSSE2(y + x*2, u, v, dst + x, width - x);
+}
+
+PX_TARGET_AVX2 static void nv12RowAVX2(const unsigned char* y, const unsigned char* uv,
+                                       const unsigned char* v, pxPixel* dst, int width)
+{
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i py = _mm_loadu_si128((const __m128i*)(y + x));
+        __m128i puv = _mm_loadu_si128((const __m128i*)(uv + x));
+        yuvToPixels16(_mm256_cvtepu8_epi16(py), _mm256_cvtepu8_epi16(puv), dst + x);
+    }
+    nv12RowSSE2(y + x, uv + x, v, dst + x, width - x);
+}
+
+PX_TARGET_AVX2 static void i420RowAVX2(const unsigned char* y, const unsigned char* u,
+                                       const unsigned char* v, pxPixel* dst, int width)
+{
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i py = _mm_loadu_si128((const __m128i*)(y + x));
+        __m128i pu = _mm_loadl_epi64((const __m128i*)(u + x/2));
+        __m128i pv = _mm_loadl_epi64((const __m128i*)(v + x/2));
+        yuvToPixels16(_mm256_cvtepu8_epi16(py),
+                      _mm256_cvtepu8_epi16(_mm_unpacklo_epi8(pu, pv)), dst + x);
+    }
+    i420RowSSE2(y + x, u + x/2, v + x/2, dst + x, width - x);
+}
+
+#endif
+
+// Kernels for one format, best last
+typedef struct
+{
+    rowFunc scalar;
+    rowFunc sse2;
+    rowFunc avx2;
+} rowKernels;
+
+#if defined(PX_SIMD_X86)
+static const rowKernels gYUY2 = { yuy2Row, yuy2RowSSE2, yuy2RowAVX2 };
+static const rowKernels gUYVY = { uyvyRow, uyvyRowSSE2, uyvyRowAVX2 };
+static const rowKernels gNV12 = { nv12Row, nv12RowSSE2, nv12RowAVX2 };
+static const rowKernels gI420 = { i420Row, i420RowSSE2, i420RowAVX2 };
+#else
+static const rowKernels gYUY2 = { yuy2Row, NULL, NULL };
+static const rowKernels gUYVY = { uyvyRow, NULL, NULL };
+static const rowKernels gNV12 = { nv12Row, NULL, NULL };
+static const rowKernels gI420 = { i420Row, NULL, NULL };
+#endif
+
+static rowFunc pick(const rowKernels& k)
+{
+    unsigned int features = pxCpuFeatures();
+    if ((features & PX_CPU_AVX2) && k.avx2)
+        return k.avx2;
+    if ((features & PX_CPU_SSE2) && k.sse2)
+        return k.sse2;
+    return k.scalar;
+}
+
+static pxError convertPacked(const rowKernels& k, const void* src, int srcStride,
+                             pxBuffer& dst)
+{
+    if (!src)
+        return PX_FAIL;
+
+    rowFunc row = pick(k);
+    const unsigned char* s = (const unsigned char*)src;
+    for (int y = 0; y < dst.height(); y++)
+        row(s + y * srcStride, NULL, NULL, dst.scanline(y), dst.width());
+
+    return PX_OK;
+}
+
+pxError pxConvertYUY2(const void* src, int srcStride, pxBuffer& dst)
+{
+    return convertPacked(gYUY2, src, srcStride, dst);
+}
+
+pxError pxConvertUYVY(const void* src, int srcStride, pxBuffer& dst)
+{
+    return convertPacked(gUYVY, src, srcStride, dst);
+}
+
+pxError pxConvertNV12(const void* y, int yStride, const void* uv, int uvStride,
+                      pxBuffer& dst)
+{
+    if (!y || !uv)
+        return PX_FAIL;
+
+    rowFunc row = pick(gNV12);
+    for (int i = 0; i < dst.height(); i++)
+    {
+        row((const unsigned char*)y + i * yStride,
+            (const unsigned char*)uv + (i/2) * uvStride, NULL,
+            dst.scanline(i), dst.width());
+    }
+
+    return PX_OK;
+}
+
+pxError pxConvertI420(const void* y, int yStride, const void* u, int uStride,
+                      const void* v, int vStride, pxBuffer& dst)
+{
+    if (!y || !u || !v)
+        return PX_FAIL;
+
+    rowFunc row = pick(gI420);
+    for (int i = 0; i < dst.height(); i++)
+    {
+        row((const unsigned char*)y + i * yStride,
+            (const unsigned char*)u + (i/2) * uStride,
+            (const unsigned char*)v + (i/2) * vStride,
+            dst.scanline(i), dst.width());
+    }
+
+    return PX_OK;
+}
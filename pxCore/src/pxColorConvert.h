@@ -0,0 +1,34 @@
+// pxCore CopyRight 2007 John Robinson
+// Portable Framebuffer and Windowing Library
+// pxColorConvert.h
+
+#ifndef PX_COLORCONVERT_H
+#define PX_COLORCONVERT_H
+
+#include "pxCore.h"
+#include "pxBuffer.h"
+
+// Conversions from the YUV formats that cameras and video decoders produce
+// to pxPixel.  The source is BT.601 limited range with chroma shared by
+// each pair of pixels (4:2:2) or 2x2 block of pixels (4:2:0).  The size
+// of the destination buffer determines how much is converted, it can have
+// any stride and can be upside down.  Alpha is set to 255.
+//
+// SSE2 and AVX2 kernels are picked at runtime (see pxCpu.h) and produce
+// exactly the same pixels as the scalar code.
+
+// Packed y0 u y1 v
+pxError pxConvertYUY2(const void* src, int srcStride, pxBuffer& dst);
+
+// Packed u y0 v y1
+pxError pxConvertUYVY(const void* src, int srcStride, pxBuffer& dst);
+
+// Y plane and an interleaved half resolution uv plane
+pxError pxConvertNV12(const void* y, int yStride, const void* uv, int uvStride,
+                      pxBuffer& dst);
+
+// Y plane and half resolution u and v planes
+pxError pxConvertI420(const void* y, int yStride, const void* u, int uStride,
+                      const void* v, int vStride, pxBuffer& dst);
+
+#endif
@@ -13,6 +13,19 @@ typedef int pxError;
 #define PX_FAIL                 1           // General Failure
 #define PX_NOTINITILIZED        2           // Object requires initialization before use
 
+// One pointer position reported by the windowing system, time is in
+// milliseconds on the platform's own event clock
+struct pxMouseSample
+{
+    int x, y;
+    unsigned long time;
+};
+
+// Called for the p1 of a posted message that will never be delivered,
+// because a newer one replaced it or its window went away, so whatever
+// it holds can be freed (see pxWindowNative::postMessage)
+typedef void (*pxMessageRelease)(char* messageName, void* p1);
+
 // Utility Functions
 
 template <typename t> 
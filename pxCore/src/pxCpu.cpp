@@ -0,0 +1,110 @@
+// pxCore CopyRight 2007 John Robinson
+// Portable Framebuffer and Windowing Library
+// pxCpu.cpp
+
+#include "pxCpu.h"
+
+#if defined(PX_PLATFORM_WIN)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#if defined(PX_SIMD_X86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+static unsigned int gFeatureMask = ~0U;
+
+#if defined(PX_SIMD_X86)
+
+static void cpuid(int leaf, int subleaf, unsigned int r[4])
+{
+#if defined(_MSC_VER)
+    __cpuidex((int*)r, leaf, subleaf);
+#else
+    __cpuid_count(leaf, subleaf, r[0], r[1], r[2], r[3]);
+#endif
+}
+
+// Enabled state components, the OS has to save the ymm registers
+// for AVX to be usable
+static unsigned long long xgetbv()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned int lo, hi;
+    __asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((unsigned long long)hi << 32) | lo;
+#endif
+}
+
+static unsigned int detect()
+{
+    unsigned int features = 0;
+    unsigned int r[4];
+
+    cpuid(0, 0, r);
+    unsigned int maxLeaf = r[0];
+    if (maxLeaf < 1)
+        return 0;
+
+    cpuid(1, 0, r);
+    if (r[3] & (1 << 26))
+        features |= PX_CPU_SSE2;
+
+    bool osxsave = (r[2] & (1 << 27)) != 0;
+    bool avx = (r[2] & (1 << 28)) != 0;
+    if (maxLeaf >= 7 && osxsave && avx && (xgetbv() & 6) == 6)
+    {
+        cpuid(7, 0, r);
+        if (r[1] & (1 << 5))
+            features |= PX_CPU_AVX2;
+    }
+
+    return features;
+}
+
+#else
+
+static unsigned int detect()
+{
+    return 0;
+}
+
+#endif
+
+unsigned int pxCpuFeatures()
+{
+    // Detection is idempotent so racing threads are harmless
+    static unsigned int features = 0;
+    static bool detected = false;
+    if (!detected)
+    {
+        features = detect();
+        detected = true;
+    }
+    return features & gFeatureMask;
+}
+
+void pxCpuSetFeatureMask(unsigned int mask)
+{
+    gFeatureMask = mask;
+}
+
+int pxCpuCount()
+{
+#if defined(PX_PLATFORM_WIN)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0)?(int)count:1;
+#endif
+}
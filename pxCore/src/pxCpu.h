@@ -0,0 +1,43 @@
+// pxCore CopyRight 2007 John Robinson
+// Portable Framebuffer and Windowing Library
+// pxCpu.h
+
+#ifndef PX_CPU_H
+#define PX_CPU_H
+
+#include "pxCore.h"
+
+// SIMD kernels are only built for x86 and assume little endian pixels.
+// MSVC needs 2012 or later for the AVX2 intrinsics.
+#if (defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || \
+     defined(_M_X64)) && defined(PX_LITTLEENDIAN_PIXELS) && \
+    (!defined(_MSC_VER) || _MSC_VER >= 1700)
+#define PX_SIMD_X86
+#endif
+
+// Lets a single translation unit carry kernels for several instruction
+// sets.  MSVC allows any intrinsic anywhere so it doesn't need these.
+#if defined(PX_SIMD_X86) && defined(__GNUC__)
+#define PX_TARGET_SSE2 __attribute__((target("sse2")))
+#define PX_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define PX_TARGET_SSE2
+#define PX_TARGET_AVX2
+#endif
+
+#define PX_CPU_SSE2     0x01
+#define PX_CPU_AVX2     0x02
+
+// Returns the PX_CPU_* instruction sets that are usable on this machine
+// (supported by both the processor and the OS) and allowed by the mask
+unsigned int pxCpuFeatures();
+
+// Restricts the instruction sets the kernels in pxCore may use.  Mostly
+// useful to compare the SIMD kernels against the scalar ones.  Defaults
+// to all of them.
+void pxCpuSetFeatureMask(unsigned int mask);
+
+// Returns the number of processors available to run threads on
+int pxCpuCount();
+
+#endif
@@ -0,0 +1,348 @@
+// pxCore CopyRight 2007 John Robinson
+// Portable Framebuffer and Windowing Library
+// pxFrameScheduler.cpp
+
+#include "pxFrameScheduler.h"
+#include "pxTimer.h"
+
+#include <math.h>
+
+// Slots are 2^20ns, about 1ms, so the wheel covers about a quarter of a
+// second.  Deadlines further out wait in their slot for the wheel to come
+// round again.
+#define PX_FRAME_SLOT_SHIFT     20
+#define PX_FRAME_SLOTS          256
+#define PX_FRAME_SLOT_MASK      (PX_FRAME_SLOTS-1)
+
+struct pxFrameTimer
+{
+    pxFrameClient* client;
+    long fps;
+    pxFramePolicy policy;
+    long long start;
+    unsigned long long frame;   // The next frame to deliver
+    long long deadline;         // When it is due
+
+    // Set while the client is being called back, removing or restarting
+    // it then is left for fire to finish
+    bool firing;
+    bool removed;
+    bool restarted;
+
+    unsigned long long frames;
+    unsigned long long dropped;
+    double jitterSum;
+    double jitterSquares;
+    long long maxJitter;
+
+    // Slot list, slot is -1 when not in the wheel
+    pxFrameTimer* next;
+    pxFrameTimer* prev;
+    int slot;
+};
+
+// When frame n of t is due
+static long long frameTime(const pxFrameTimer* t, unsigned long long n)
+{
+    // Whole seconds and the frames left over are scaled separately so
+    // this can't overflow however long the animation runs
+    unsigned long long seconds = n / t->fps;
+    unsigned long long rest = n % t->fps;
+    return t->start + (long long)seconds * PX_NS_PER_SECOND +
+        (long long)(rest * PX_NS_PER_SECOND / t->fps);
+}
+
+// The last frame of t due at or before now
+static unsigned long long frameAt(const pxFrameTimer* t, long long now)
+{
+    long long elapsed = now - t->start;
+    if (elapsed <= 0)
+        return 0;
+
+    unsigned long long seconds = elapsed / PX_NS_PER_SECOND;
+    unsigned long long rest = elapsed % PX_NS_PER_SECOND;
+    return seconds * t->fps + rest * t->fps / PX_NS_PER_SECOND;
+}
+
+static void clearStats(pxFrameTimer* t)
+{
+    t->frames = 0;
+    t->dropped = 0;
+    t->jitterSum = 0;
+    t->jitterSquares = 0;
+    t->maxJitter = 0;
+}
+
+pxFrameScheduler::pxFrameScheduler()
+{
+    mSlots = new pxFrameTimer*[PX_FRAME_SLOTS];
+    for (int i = 0; i < PX_FRAME_SLOTS; i++)
+        mSlots[i] = NULL;
+    mCursor = pxNanoseconds() >> PX_FRAME_SLOT_SHIFT;
+}
+
+pxFrameScheduler::~pxFrameScheduler()
+{
+    for (unsigned i = 0; i < mTimers.size(); i++)
+        delete mTimers[i];
+    delete [] mSlots;
+}
+
+pxError pxFrameScheduler::schedule(pxFrameClient* c, long fps,
+                                   pxFramePolicy policy)
+{
+    if (!c || fps <= 0)
+        return PX_FAIL;
+
+    pxFrameTimer* t = find(c);
+    if (t)
+    {
+        t->policy = policy;
+        if (t->fps == fps)
+            return PX_OK;
+
+        if (t->firing)
+            t->restarted = true;
+        else
+            unlink(t);
+    }
+    else
+    {
+        t = new pxFrameTimer;
+        t->client = c;
+        t->firing = false;
+        t->removed = false;
+        t->restarted = false;
+        t->slot = -1;
+        clearStats(t);
+        mTimers.push_back(t);
+    }
+
+    t->fps = fps;
+    t->policy = policy;
+    t->start = pxNanoseconds();
+    t->frame = 1;
+    t->deadline = frameTime(t, 1);
+
+    if (!t->firing)
+        link(t);
+
+    return PX_OK;
+}
+
+void pxFrameScheduler::remove(pxFrameClient* c)
+{
+    for (unsigned i = 0; i < mTimers.size(); i++)
+    {
+        pxFrameTimer* t = mTimers[i];
+        if (t->client == c)
+        {
+            mTimers.erase(mTimers.begin() + i);
+            if (t->firing)
+                t->removed = true;
+            else
+            {
+                unlink(t);
+                delete t;
+            }
+            return;
+        }
+    }
+}
+
+bool pxFrameScheduler::scheduled(pxFrameClient* c)
+{
+    return find(c) != NULL;
+}
+
+long long pxFrameScheduler::nextDeadline()
+{
+    if (mTimers.empty())
+        return -1;
+
+    // The first slot holding a deadline from this turn of the wheel has
+    // the earliest one.  Overdue timers are always in the cursor's slot.
+    for (long long tick = mCursor; tick < mCursor + PX_FRAME_SLOTS; tick++)
+    {
+        long long best = -1;
+        for (pxFrameTimer* t = mSlots[tick & PX_FRAME_SLOT_MASK]; t; t = t->next)
+        {
+            if ((t->deadline >> PX_FRAME_SLOT_SHIFT) <= tick &&
+                (best < 0 || t->deadline < best))
+                best = t->deadline;
+        }
+        if (best >= 0)
+            return best;
+    }
+
+    // Everything is more than a turn of the wheel away
+    long long best = -1;
+    for (unsigned i = 0; i < mTimers.size(); i++)
+    {
+        if (best < 0 || mTimers[i]->deadline < best)
+            best = mTimers[i]->deadline;
+    }
+    return best;
+}
+
+void pxFrameScheduler::run(long long now)
+{
+    long long nowTick = now >> PX_FRAME_SLOT_SHIFT;
+
+    // After a long stall every slot is looked at once
+    long long last = nowTick;
+    if (last - mCursor >= PX_FRAME_SLOTS)
+        last = mCursor + PX_FRAME_SLOTS - 1;
+
+    for (long long tick = mCursor; tick <= last; tick++)
+    {
+        pxFrameTimer** slot = &mSlots[tick & PX_FRAME_SLOT_MASK];
+
+        // Callbacks can change any of the lists so the slot is searched
+        // again after each one
+        bool fired = true;
+        while (fired)
+        {
+            fired = false;
+            for (pxFrameTimer* t = *slot; t; t = t->next)
+            {
+                if (t->deadline <= now)
+                {
+                    unlink(t);
+                    fire(t, now);
+                    fired = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (nowTick > mCursor)
+        mCursor = nowTick;
+}
+
+pxError pxFrameScheduler::stats(pxFrameClient* c, pxFrameStats& s)
+{
+    pxFrameTimer* t = find(c);
+    if (!t)
+        return PX_FAIL;
+
+    s.frames = t->frames;
+    s.dropped = t->dropped;
+    s.maxJitter = t->maxJitter;
+    s.meanJitter = 0;
+    s.jitterDeviation = 0;
+    if (t->frames)
+    {
+        s.meanJitter = t->jitterSum / t->frames;
+        double variance = t->jitterSquares / t->frames -
+            s.meanJitter * s.meanJitter;
+        s.jitterDeviation = (variance > 0)?sqrt(variance):0;
+    }
+    return PX_OK;
+}
+
+void pxFrameScheduler::resetStats(pxFrameClient* c)
+{
+    pxFrameTimer* t = find(c);
+    if (t)
+        clearStats(t);
+}
+
+pxFrameTimer* pxFrameScheduler::find(pxFrameClient* c)
+{
+    for (unsigned i = 0; i < mTimers.size(); i++)
+    {
+        if (mTimers[i]->client == c)
+            return mTimers[i];
+    }
+    return NULL;
+}
+
+void pxFrameScheduler::link(pxFrameTimer* t)
+{
+    // Overdue timers go where run looks first
+    long long tick = t->deadline >> PX_FRAME_SLOT_SHIFT;
+    if (tick < mCursor)
+        tick = mCursor;
+
+    t->slot = (int)(tick & PX_FRAME_SLOT_MASK);
+    t->prev = NULL;
+    t->next = mSlots[t->slot];
+    if (t->next)
+        t->next->prev = t;
+    mSlots[t->slot] = t;
+}
+
+void pxFrameScheduler::unlink(pxFrameTimer* t)
+{
+    if (t->slot < 0)
+        return;
+
+    if (t->prev)
+        t->prev->next = t->next;
+    else
+        mSlots[t->slot] = t->next;
+    if (t->next)
+        t->next->prev = t->prev;
+
+    t->next = t->prev = NULL;
+    t->slot = -1;
+}
+
+// Delivers the frames of t that are due and puts it back in the wheel
+// for the next one.  t has already been unlinked.
+void pxFrameScheduler::fire(pxFrameTimer* t, long long now)
+{
+    t->firing = true;
+
+    int delivered = 0;
+    while (!t->removed && !t->restarted)
+    {
+        long long target = frameTime(t, t->frame);
+        if (target > now)
+            break;
+
+        unsigned long long dropped = 0;
+        if (t->policy == PX_FRAME_DROP || delivered >= PX_FRAME_MAX_CATCHUP)
+        {
+            unsigned long long latest = frameAt(t, now);
+            if (latest > t->frame)
+            {
+                dropped = latest - t->frame;
+                t->frame = latest;
+                target = frameTime(t, latest);
+            }
+        }
+
+        pxFrameInfo info;
+        info.frame = t->frame;
+        info.target = target;
+        info.actual = pxNanoseconds();
+        info.dropped = dropped;
+
+        long long jitter = info.actual - target;
+        t->frames++;
+        t->dropped += dropped;
+        t->jitterSum += (double)jitter;
+        t->jitterSquares += (double)jitter * jitter;
+        if (jitter > t->maxJitter)
+            t->maxJitter = jitter;
+
+        t->frame++;
+        delivered++;
+        t->client->onFrame(info);
+    }
+
+    t->firing = false;
+    t->restarted = false;
+
+    if (t->removed)
+    {
+        delete t;
+        return;
+    }
+
+    t->deadline = frameTime(t, t->frame);
+    link(t);
+}
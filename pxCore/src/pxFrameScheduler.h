@@ -0,0 +1,98 @@
+// pxCore CopyRight 2007 John Robinson
+// Portable Framebuffer and Windowing Library
+// pxFrameScheduler.h
+
+#ifndef PX_FRAME_SCHEDULER_H
+#define PX_FRAME_SCHEDULER_H
+
+// What to do about frames whose deadline has already passed when the
+// scheduler next runs, because the loop was busy or a frame took too long
+enum pxFramePolicy
+{
+    PX_FRAME_DROP,          // Skip to the latest frame due, the rest are counted as dropped
+    PX_FRAME_CATCHUP        // Deliver the missed frames back to back, up to PX_FRAME_MAX_CATCHUP
+};
+
+// Late frames delivered in one go under PX_FRAME_CATCHUP before any more
+// are dropped
+#define PX_FRAME_MAX_CATCHUP    4
+
+// Times are pxNanoseconds readings (see pxTimer.h)
+struct pxFrameInfo
+{
+    unsigned long long frame;   // Counts from 1 when the rate is set, dropped frames included
+    long long target;           // When the frame was due
+    long long actual;           // When the callback was made
+    unsigned long long dropped; // Frames skipped just before this one
+};
+
+// Jitter is how late each callback was, actual - target, in nanoseconds
+struct pxFrameStats
+{
+    unsigned long long frames;
+    unsigned long long dropped;
+    double meanJitter;
+    double jitterDeviation;
+    long long maxJitter;
+};
+
+class pxFrameClient
+{
+public:
+    virtual ~pxFrameClient() {}
+    virtual void onFrame(const pxFrameInfo& info) = 0;
+};
+
+class pxFrameScheduler;
+
+// pxCore.h includes the native window header, which needs the types
+// above, so it comes after them
+#include "pxCore.h"
+
+#include <vector>
+
+struct pxFrameTimer;
+
+// Calls clients back at fixed rates.  Frame n of a client is due at
+// start + n seconds/fps, worked out exactly in integer nanoseconds, so
+// the rate is exact and lateness never accumulates.
+//
+// Pending frames are kept in a hashed timer wheel of about 1ms slots,
+// so one scheduler can serve many clients and the next deadline is
+// found without walking all of them.  Clients may schedule or remove
+// themselves or each other from inside onFrame.
+class pxFrameScheduler
+{
+public:
+    pxFrameScheduler();
+    ~pxFrameScheduler();
+
+    // Starts calling c fps times a second, the first call one period from
+    // now.  Changing the rate of a scheduled client starts it again,
+    // setting the same rate only changes the policy.
+    pxError schedule(pxFrameClient* c, long fps,
+                     pxFramePolicy policy = PX_FRAME_DROP);
+    void remove(pxFrameClient* c);
+    bool scheduled(pxFrameClient* c);
+
+    // Earliest deadline of any client, -1 if there are none
+    long long nextDeadline();
+
+    // Calls every client whose deadline is at or before now
+    void run(long long now);
+
+    pxError stats(pxFrameClient* c, pxFrameStats& s);
+    void resetStats(pxFrameClient* c);
+
+private:
+    pxFrameTimer* find(pxFrameClient* c);
+    void link(pxFrameTimer* t);
+    void unlink(pxFrameTimer* t);
+    void fire(pxFrameTimer* t, long long now);
+
+    pxFrameTimer** mSlots;
+    long long mCursor;
+    std::vector<pxFrameTimer*> mTimers;
+};
+
+#endif
@@ -5,6 +5,192 @@
 #include "pxCore.h"
 #include "pxOffscreen.h"
 
+#include <stdlib.h>
+
+#if defined(PX_PLATFORM_WIN)
+#include <malloc.h>
+#else
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define PX_OFFSCREEN_ALIGNMENT      64
+
+// Buffers at least this big are mapped when asked to, smaller ones
+// wouldn't fill a huge page
+#define PX_MAP_MIN_BYTES            (2*1024*1024)
+#define PX_HUGE_PAGE_BYTES          (2*1024*1024)
+
+// Buffers smaller than this aren't worth pooling
+#define PX_POOL_MIN_BYTES           (64*1024)
+
+// Pooled buffers are rounded up to one of four sizes between each power
+// of two, wasting at most a fifth of a buffer
+#define PX_POOL_STEPS               4
+#define PX_POOL_MIN_SHIFT           16
+#define PX_POOL_BUCKETS             (PX_POOL_STEPS * (sizeof(size_t)*8 - PX_POOL_MIN_SHIFT))
+
+// Idle pooled buffers are kept in per bucket lists linked through their
+// first bytes
+struct pxPoolBlock
+{
+    pxPoolBlock* next;
+};
+
+#if defined(PX_PLATFORM_WIN)
+class pxPoolLock
+{
+public:
+    pxPoolLock() { InitializeCriticalSection(&mLock); }
+    ~pxPoolLock() { DeleteCriticalSection(&mLock); }
+    void lock() { EnterCriticalSection(&mLock); }
+    void unlock() { LeaveCriticalSection(&mLock); }
+private:
+    CRITICAL_SECTION mLock;
+};
+#else
+class pxPoolLock
+{
+public:
+    void lock() { pthread_mutex_lock(&mLock); }
+    void unlock() { pthread_mutex_unlock(&mLock); }
+    pthread_mutex_t mLock;
+};
+#endif
+
+#if defined(PX_PLATFORM_WIN)
+static pxPoolLock gPoolLock;
+#else
+static pxPoolLock gPoolLock = { PTHREAD_MUTEX_INITIALIZER };
+#endif
+
+// Mapped and heap buffers have to be freed differently so they are
+// pooled separately
+static pxPoolBlock* gPool[2][PX_POOL_BUCKETS];
+static size_t gPoolLimit = 64*1024*1024;
+static pxOffscreenStats gStats;
+
+// Finds the bucket for bytes and rounds bytes up to its size, or returns
+// -1 if it's too big for any bucket
+static int bucket(size_t& bytes)
+{
+    int shift = PX_POOL_MIN_SHIFT;
+    while (shift + 2 < (int)(sizeof(size_t)*8) && ((size_t)1 << (shift+1)) <= bytes)
+        shift++;
+
+    size_t step = ((size_t)1 << shift) / PX_POOL_STEPS;
+    bytes = (bytes + step - 1) / step * step;
+
+    // A size that rounds up to the next power of two lands in that
+    // power's first bucket
+    int index = (shift - PX_POOL_MIN_SHIFT) * PX_POOL_STEPS + 
+                (int)(bytes / step) - PX_POOL_STEPS;
+    return (index < (int)PX_POOL_BUCKETS)?index:-1;
+}
+
+static size_t bucketSize(int index)
+{
+    size_t step = ((size_t)1 << (PX_POOL_MIN_SHIFT + index / PX_POOL_STEPS)) / PX_POOL_STEPS;
+    return step * (PX_POOL_STEPS + index % PX_POOL_STEPS);
+}
+
+// Whether a buffer of bytes is (or was) allocated with mmap
+static bool mapped(size_t bytes, unsigned int flags)
+{
+#if defined(PX_PLATFORM_WIN)
+    return false;
+#else
+    return (flags & (PX_OFFSCREEN_MAPPED|PX_OFFSCREEN_HUGEPAGES)) &&
+           bytes >= PX_MAP_MIN_BYTES;
+#endif
+}
+
+#if !defined(PX_PLATFORM_WIN)
+static void* systemMap(size_t bytes, unsigned int flags)
+{
+    void* p = MAP_FAILED;
+
+#if defined(MAP_HUGETLB)
+    // Explicit huge pages only exist if the administrator reserved some
+    // (vm.nr_hugepages) and the length has to be a whole number of them
+    if ((flags & PX_OFFSCREEN_HUGEPAGES) && (bytes % PX_HUGE_PAGE_BYTES) == 0)
+    {
+        int populate = 0;
+#if defined(MAP_POPULATE)
+        if (flags & PX_OFFSCREEN_PREFAULT)
+            populate = MAP_POPULATE;
+#endif
+        p = mmap(NULL, bytes, PROT_READ|PROT_WRITE,
+                 MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB|populate, -1, 0);
+        if (p != MAP_FAILED)
+        {
+            gStats.hugePageAllocations++;
+            return p;
+        }
+    }
+#endif
+
+    p = mmap(NULL, bytes, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+
+#if defined(MADV_HUGEPAGE)
+    // Otherwise ask for transparent huge pages.  This has to happen before
+    // the pages are touched so prefaulting is done afterwards by hand.
+    if (flags & PX_OFFSCREEN_HUGEPAGES)
+        madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+    return p;
+}
+#endif
+
+static void* systemAlloc(size_t bytes, unsigned int flags)
+{
+    void* p;
+#if defined(PX_PLATFORM_WIN)
+    p = _aligned_malloc(bytes, PX_OFFSCREEN_ALIGNMENT);
+#else
+    if (mapped(bytes, flags))
+    {
+        p = systemMap(bytes, flags);
+        if (p)
+            gStats.mappedAllocations++;
+    }
+    else if (posix_memalign(&p, PX_OFFSCREEN_ALIGNMENT, bytes) != 0)
+        p = NULL;
+#endif
+    if (!p)
+        return NULL;
+
+    // Take the page faults now rather than in the middle of the first
+    // frame drawn.  Writing a byte per page is enough.
+    if (flags & PX_OFFSCREEN_PREFAULT)
+    {
+        for (size_t i = 0; i < bytes; i += 4096)
+            ((volatile char*)p)[i] = 0;
+    }
+
+    gStats.allocations++;
+    gStats.bytesInUse += bytes;
+    if (gStats.bytesInUse + gStats.bytesPooled > gStats.peakBytes)
+        gStats.peakBytes = gStats.bytesInUse + gStats.bytesPooled;
+    return p;
+}
+
+static void systemFree(void* p, size_t bytes, unsigned int flags)
+{
+    gStats.frees++;
+#if defined(PX_PLATFORM_WIN)
+    _aligned_free(p);
+#else
+    if (mapped(bytes, flags))
+        munmap(p, bytes);
+    else
+        free(p);
+#endif
+}
+
 pxOffscreen::pxOffscreen() 
 {
 }
@@ -14,11 +200,136 @@ pxOffscreen::~pxOffscreen()
 	term();
 }
 
-pxError pxOffscreen::initWithColor(int width, int height, const pxColor& color)
+pxError pxOffscreen::initWithColor(int width, int height, const pxColor& color,
+                                   unsigned int flags)
 {
-  pxError e = init(width, height);
+  pxError e = init(width, height, flags);
   fill(color);
   return e;
 }
 
+int pxOffscreen::alignedStride(int width)
+{
+    int stride = (width * 4 + PX_OFFSCREEN_ALIGNMENT - 1) & ~(PX_OFFSCREEN_ALIGNMENT - 1);
+
+    // Rows a multiple of 4KB apart map to the same cache sets, which
+    // hurts anything walking down a column
+    if (stride && (stride % 4096) == 0)
+        stride += PX_OFFSCREEN_ALIGNMENT;
+    return stride;
+}
+
+void* pxOffscreen::allocPixels(size_t bytes, size_t& capacity, unsigned int flags)
+{
+    capacity = (bytes + PX_OFFSCREEN_ALIGNMENT - 1) & ~(size_t)(PX_OFFSCREEN_ALIGNMENT - 1);
+    if (!capacity)
+        capacity = PX_OFFSCREEN_ALIGNMENT;
+
+    // Whole huge pages so that MAP_HUGETLB can be used
+    if ((flags & PX_OFFSCREEN_HUGEPAGES) && mapped(capacity, flags))
+        capacity = (capacity + PX_HUGE_PAGE_BYTES - 1) & ~(size_t)(PX_HUGE_PAGE_BYTES - 1);
+
+    gPoolLock.lock();
+
+    if ((flags & PX_OFFSCREEN_POOLED) && capacity >= PX_POOL_MIN_BYTES)
+    {
+        // Pooled buffers are allocated at their bucket's size so that
+        // they can go back to it
+        size_t size = capacity;
+        int b = bucket(size);
+        if (b >= 0 && mapped(size, flags) == mapped(capacity, flags))
+        {
+            capacity = size;
+            pxPoolBlock** pool = gPool[mapped(size, flags)?1:0];
+            if (pool[b])
+            {
+                pxPoolBlock* block = pool[b];
+                pool[b] = block->next;
+                gStats.poolHits++;
+                gStats.bytesPooled -= capacity;
+                gStats.bytesInUse += capacity;
+                gPoolLock.unlock();
+                return block;
+            }
+        }
+    }
+
+    void* p = systemAlloc(capacity, flags);
+    gPoolLock.unlock();
+    return p;
+}
+
+void pxOffscreen::freePixels(void* p, size_t capacity, unsigned int flags)
+{
+    if (!p)
+        return;
+
+    gPoolLock.lock();
+    gStats.bytesInUse -= capacity;
+
+    if ((flags & PX_OFFSCREEN_POOLED) && capacity >= PX_POOL_MIN_BYTES &&
+        gStats.bytesPooled + capacity <= gPoolLimit)
+    {
+        size_t size = capacity;
+        int b = bucket(size);
+        if (b >= 0 && size == capacity)
+        {
+            pxPoolBlock** pool = gPool[mapped(size, flags)?1:0];
+            pxPoolBlock* block = (pxPoolBlock*)p;
+            block->next = pool[b];
+            pool[b] = block;
+            gStats.bytesPooled += capacity;
+            gPoolLock.unlock();
+            return;
+        }
+    }
+
+    systemFree(p, capacity, flags);
+    gPoolLock.unlock();
+}
+
+void pxOffscreen::countReuse()
+{
+    gPoolLock.lock();
+    gStats.reuses++;
+    gPoolLock.unlock();
+}
 
+pxOffscreenStats pxOffscreen::stats()
+{
+    gPoolLock.lock();
+    pxOffscreenStats s = gStats;
+    gPoolLock.unlock();
+    return s;
+}
+
+void pxOffscreen::setPoolLimit(size_t bytes)
+{
+    gPoolLock.lock();
+    gPoolLimit = bytes;
+    gPoolLock.unlock();
+    if (stats().bytesPooled > bytes)
+        trimPool();
+}
+
+void pxOffscreen::trimPool()
+{
+    gPoolLock.lock();
+    for (int i = 0; i < (int)PX_POOL_BUCKETS; i++)
+    {
+        while (gPool[0][i])
+        {
+            pxPoolBlock* block = gPool[0][i];
+            gPool[0][i] = block->next;
+            systemFree(block, bucketSize(i), 0);
+        }
+        while (gPool[1][i])
+        {
+            pxPoolBlock* block = gPool[1][i];
+            gPool[1][i] = block->next;
+            systemFree(block, bucketSize(i), PX_OFFSCREEN_MAPPED);
+        }
+    }
+    gStats.bytesPooled = 0;
+    gPoolLock.unlock();
+}
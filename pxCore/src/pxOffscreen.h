@@ -8,6 +8,52 @@
 #include "pxCore.h"
 #include "pxBuffer.h"
 
+#include <stddef.h>
+
+// Flags for pxOffscreen::init
+
+// Take pixel memory from a process wide pool of recently freed buffers
+// and give it back there on term.  Handy for offscreens that come and go
+// at similar sizes (per frame scratch surfaces, resizing windows).
+#define PX_OFFSCREEN_POOLED         0x01
+
+// Map buffers of 2MB and up straight from the OS with mmap rather than
+// the heap.  Ignored on Windows.
+#define PX_OFFSCREEN_MAPPED         0x02
+
+// Map buffers of 2MB and up with huge pages, cutting TLB misses in loops
+// that walk a large surface.  Explicit huge pages (MAP_HUGETLB) are used
+// if any have been reserved, transparent huge pages otherwise.  Implies
+// PX_OFFSCREEN_MAPPED.
+#define PX_OFFSCREEN_HUGEPAGES      0x04
+
+// Fault every page in during init instead of on first touch, so the
+// first frame drawn doesn't pay for it
+#define PX_OFFSCREEN_PREFAULT       0x08
+
+// On X11 put the pixels in a MIT-SHM segment shared with the server, if
+// a display is already open, so blits to a window don't copy them through
+// the socket.  Meant for offscreens blitted every frame: setting up a
+// segment costs round trips to the server, and pooling and mapping don't
+// apply to it (huge pages and prefaulting do).  Blits from it return
+// before the server has read the pixels, so call waitForBlits before
+// drawing into it again.  Ignored elsewhere.
+#define PX_OFFSCREEN_SHARED         0x10
+
+// Counts for the pixel memory of every offscreen in the process
+typedef struct
+{
+    unsigned long allocations;          // Buffers allocated from the system
+    unsigned long frees;                // Buffers given back to the system
+    unsigned long poolHits;             // Allocations satisfied by the pool
+    unsigned long reuses;               // inits that fit in memory already held
+    unsigned long mappedAllocations;    // Allocations made with mmap
+    unsigned long hugePageAllocations;  // and of those with MAP_HUGETLB
+    size_t bytesInUse;                  // Held by offscreens
+    size_t bytesPooled;                 // Sitting idle in the pool
+    size_t peakBytes;                   // Most ever allocated from the system
+} pxOffscreenStats;
+
 // Class used to create and manage offscreen pixmaps
 // This class subclasses pxBuffer (pxBuffer.h)
 // Please refer to pxBuffer.h for additional methods
@@ -19,15 +65,41 @@ public:
     virtual ~pxOffscreen();
 
     // This will initialize the offscreen for the given height and width 
-    // but will not clear it.
-    pxError init(int width, int height);
+    // but will not clear it.  Rows start 64 byte aligned and the stride
+    // may be padded beyond width*4.  Memory already held is reused when
+    // the new size fits in it, so shrinking or growing a little doesn't
+    // touch the allocator.  flags are PX_OFFSCREEN_* above.
+    pxError init(int width, int height, unsigned int flags = 0);
     
     // This will initialize the offscreen for the given height and width and
     // will clear it with the provided color.
-    pxError initWithColor(int width, int height, const pxColor& color);
+    pxError initWithColor(int width, int height, const pxColor& color,
+                          unsigned int flags = 0);
 
+    // Frees the pixel memory (to the pool if it came from there)
     pxError term();
 
+    static pxOffscreenStats stats();
+
+    // Most bytes the pool keeps idle before freeing buffers back to the
+    // system.  Defaults to 64MB.
+    static void setPoolLimit(size_t bytes);
+
+    // Frees everything sitting in the pool
+    static void trimPool();
+
+protected:
+    // Bytes per row for width pixels, see init
+    static int alignedStride(int width);
+
+    // Pixel memory is 64 byte aligned.  capacity is set to the bytes
+    // actually reserved, at least bytes, which have to be passed back to
+    // freePixels.
+    static void* allocPixels(size_t bytes, size_t& capacity, unsigned int flags);
+    static void freePixels(void* p, size_t capacity, unsigned int flags);
+
+    // Counts an init that reused the memory the offscreen already had
+    static void countReuse();
 };
 
 #endif // PXOFFSCREEN_H
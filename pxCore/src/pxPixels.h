@@ -24,7 +24,7 @@ struct pxPixel {
         g = _g;
         a = _a;
     }
-    pxPixel(unsigned long _u)
+    pxPixel(unsigned int _u)
     {
         u = _u;
     }
@@ -53,7 +53,8 @@ struct pxPixel {
             unsigned char b: 8;
 #endif
         };
-        unsigned long u;
+        // Not unsigned long since that is 64 bits on LP64 platforms
+        unsigned int u;
     };
 };
 
@@ -0,0 +1,552 @@
+// pxCore CopyRight 2007 John Robinson
+// Portable Framebuffer and Windowing Library
+// pxScale.cpp
+
+#include "pxScale.h"
+#include "pxCpu.h"
+#include "pxTileRenderer.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(PX_SIMD_X86)
+#include <immintrin.h>
+#endif
+
+// Filter weights are 14 bit fixed point.  The vertical pass keeps 7 bits
+// of fraction so its output (at most 255 << 7) still fits a signed 16 bit
+// lane and the SIMD kernels can use pmaddwd for both passes.
+#define PX_SCALE_WEIGHT_BITS    14
+#define PX_SCALE_ONE            (1 << PX_SCALE_WEIGHT_BITS)
+#define PX_SCALE_ROW_BITS       7
+#define PX_SCALE_FINAL_BITS     (PX_SCALE_WEIGHT_BITS*2 - PX_SCALE_ROW_BITS)
+
+// For each destination pixel (or row) the first source pixel (or row) and
+// taps weights.  taps is the same for every entry, rounded up to even,
+// and unused taps have a weight of 0.  pairs has the weights again laid
+// out for the SIMD kernels, each pair of taps repeated 4 times.
+struct pxScaleTable
+{
+    pxScaleTable(): first(NULL), weights(NULL), pairs(NULL), taps(0) {}
+    ~pxScaleTable()
+    {
+        delete [] first;
+        delete [] weights;
+        delete [] pairs;
+    }
+
+    int* first;
+    short* weights;
+    short* pairs;
+    int taps;
+};
+
+// Kernels fill in pixels from start up to width, so that one can finish
+// off what a wider one leaves over
+typedef void (*verticalFunc)(const unsigned char** rows, const short* weights,
+                             int taps, short* out, int start, int width);
+typedef void (*horizontalFunc)(const short* in, const pxScaleTable* t,
+                               pxPixel* out, int start, int width);
+
+// Table construction
+
+static void buildNearest(pxScaleTable* t, int srcSize, int dstSize)
+{
+    t->first = new int[dstSize];
+    t->taps = 1;
+    for (int i = 0; i < dstSize; i++)
+        t->first[i] = (int)(((long long)(2*i+1) * srcSize) / (2*dstSize));
+}
+
+static void buildFiltered(pxScaleTable* t, int srcSize, int dstSize,
+                          pxScaleFilter filter)
+{
+    double scale = (double)srcSize / dstSize;
+
+    // Box filters cover scale source pixels plus one partial at each end
+    int taps = 2;
+    if (filter == PX_SCALE_BOX)
+        taps = (int)ceil(scale) + 1;
+    taps = (taps + 1) & ~1;
+
+    t->first = new int[dstSize];
+    t->weights = new short[dstSize * taps];
+    t->taps = taps;
+
+    double* w = new double[taps];
+    for (int i = 0; i < dstSize; i++)
+    {
+        int first;
+        for (int j = 0; j < taps; j++)
+            w[j] = 0;
+
+        if (filter == PX_SCALE_BILINEAR)
+        {
+            double center = (i + 0.5) * scale - 0.5;
+            first = (int)floor(center);
+            double f = center - first;
+            if (first < 0)
+            {
+                first = 0;
+                f = 0;
+            }
+            else if (first >= srcSize - 1)
+            {
+                first = srcSize - 1;
+                f = 0;
+            }
+            w[0] = 1 - f;
+            w[1] = f;
+        }
+        else
+        {
+            // The weight of each source pixel is how much of it the
+            // destination pixel covers
+            double start = i * scale;
+            double end = start + scale;
+            first = (int)floor(start);
+            for (int j = 0; j < taps && first + j < srcSize; j++)
+            {
+                double overlap = pxMin<double>(end, first + j + 1) -
+                                 pxMax<double>(start, first + j);
+                if (overlap > 0)
+                    w[j] = overlap / scale;
+            }
+        }
+
+        // Quantize so the weights add up to exactly one, putting any
+        // rounding error on the biggest
+        short* q = t->weights + i * taps;
+        int sum = 0, biggest = 0;
+        for (int j = 0; j < taps; j++)
+        {
+            q[j] = (short)floor(w[j] * PX_SCALE_ONE + 0.5);
+            sum += q[j];
+            if (q[j] > q[biggest])
+                biggest = j;
+        }
+        q[biggest] += PX_SCALE_ONE - sum;
+        t->first[i] = first;
+    }
+    delete [] w;
+
+    t->pairs = new short[dstSize * taps * 4];
+    for (int i = 0; i < dstSize; i++)
+    {
+        for (int j = 0; j < taps; j += 2)
+        {
+            short* p = t->pairs + (i * taps + j) * 4;
+            for (int k = 0; k < 8; k += 2)
+            {
+                p[k] = t->weights[i * taps + j];
+                p[k+1] = t->weights[i * taps + j + 1];
+            }
+        }
+    }
+}
+
+// Scalar kernels
+
+// Weighs taps source rows into a row of 16 bit channels
+static void verticalRow(const unsigned char** rows, const short* weights,
+                        int taps, short* out, int start, int width)
+{
+    for (int i = start * 4; i < width * 4; i++)
+    {
+        int sum = 0;
+        for (int t = 0; t < taps; t++)
+            sum += rows[t][i] * weights[t];
+        out[i] = (short)((sum + (1 << (PX_SCALE_ROW_BITS-1))) >> PX_SCALE_ROW_BITS);
+    }
+}
+
+static void horizontalRow(const short* in, const pxScaleTable* t,
+                          pxPixel* out, int start, int width)
+{
+    for (int x = start; x < width; x++)
+    {
+        const short* s = in + t->first[x] * 4;
+        const short* w = t->weights + x * t->taps;
+        unsigned int p = 0;
+        for (int c = 0; c < 4; c++)
+        {
+            int sum = 0;
+            for (int j = 0; j < t->taps; j++)
+                sum += s[j*4+c] * w[j];
+            p |= (unsigned int)((sum + (1 << (PX_SCALE_FINAL_BITS-1))) >>
+                                PX_SCALE_FINAL_BITS) << (c*8);
+        }
+        out[x].u = p;
+    }
+}
+
+#if defined(PX_SIMD_X86)
+
+// SSE2 kernels
+
+// Two rows of 16 bit channels are interleaved so that one pmaddwd weighs
+// both, giving a 32 bit sum per channel
+PX_TARGET_SSE2 static void verticalRowSSE2(const unsigned char** rows,
+                                           const short* weights, int taps,
+                                           short* out, int start, int width)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i round = _mm_set1_epi32(1 << (PX_SCALE_ROW_BITS-1));
+    int bytes = width * 4;
+
+    int i = start * 4;
+    for (; i + 16 <= bytes; i += 16)
+    {
+        __m128i acc0 = round, acc1 = round, acc2 = round, acc3 = round;
+        for (int t = 0; t < taps; t += 2)
+        {
+            __m128i w = _mm_set1_epi32((weights[t] & 0xffff) | (weights[t+1] << 16));
+            __m128i a = _mm_loadu_si128((const __m128i*)(rows[t]+i));
+            __m128i b = _mm_loadu_si128((const __m128i*)(rows[t+1]+i));
+            __m128i alo = _mm_unpacklo_epi8(a, zero), ahi = _mm_unpackhi_epi8(a, zero);
+            __m128i blo = _mm_unpacklo_epi8(b, zero), bhi = _mm_unpackhi_epi8(b, zero);
+            acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi16(alo, blo), w));
+            acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi16(alo, blo), w));
+            acc2 = _mm_add_epi32(acc2, _mm_madd_epi16(_mm_unpacklo_epi16(ahi, bhi), w));
+            acc3 = _mm_add_epi32(acc3, _mm_madd_epi16(_mm_unpackhi_epi16(ahi, bhi), w));
+        }
+        acc0 = _mm_srai_epi32(acc0, PX_SCALE_ROW_BITS);
+        acc1 = _mm_srai_epi32(acc1, PX_SCALE_ROW_BITS);
+        acc2 = _mm_srai_epi32(acc2, PX_SCALE_ROW_BITS);
+        acc3 = _mm_srai_epi32(acc3, PX_SCALE_ROW_BITS);
+        _mm_storeu_si128((__m128i*)(out+i), _mm_packs_epi32(acc0, acc1));
+        _mm_storeu_si128((__m128i*)(out+i+8), _mm_packs_epi32(acc2, acc3));
+    }
+
+    verticalRow(rows, weights, taps, out, i/4, width);
+}
+
+// Each pair of taps is two neighbouring pixels, interleaved so that one
+// pmaddwd weighs both
+PX_TARGET_SSE2 static void horizontalRowSSE2(const short* in, const pxScaleTable* t,
+                                             pxPixel* out, int start, int width)
+{
+    __m128i round = _mm_set1_epi32(1 << (PX_SCALE_FINAL_BITS-1));
+
+    for (int x = start; x < width; x++)
+    {
+        const short* s = in + t->first[x] * 4;
+        const short* w = t->pairs + x * t->taps * 4;
+        __m128i acc = round;
+        for (int j = 0; j < t->taps; j += 2)
+        {
+            __m128i p = _mm_loadu_si128((const __m128i*)(s + j*4));
+            p = _mm_unpacklo_epi16(p, _mm_srli_si128(p, 8));
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(p,
+                _mm_loadu_si128((const __m128i*)(w + j*4))));
+        }
+        acc = _mm_srai_epi32(acc, PX_SCALE_FINAL_BITS);
+        acc = _mm_packs_epi32(acc, acc);
+        out[x].u = _mm_cvtsi128_si32(_mm_packus_epi16(acc, acc));
+    }
+}
+
+// AVX2 kernels
+
+PX_TARGET_AVX2 static void verticalRowAVX2(const unsigned char** rows,
+                                           const short* weights, int taps,
+                                           short* out, int start, int width)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i round = _mm256_set1_epi32(1 << (PX_SCALE_ROW_BITS-1));
+    int bytes = width * 4;
+
+    int i = start * 4;
+    for (; i + 32 <= bytes; i += 32)
+    {
+        __m256i acc0 = round, acc1 = round, acc2 = round, acc3 = round;
+        for (int t = 0; t < taps; t += 2)
+        {
+            __m256i w = _mm256_set1_epi32((weights[t] & 0xffff) | (weights[t+1] << 16));
+            __m256i a = _mm256_loadu_si256((const __m256i*)(rows[t]+i));
+            __m256i b = _mm256_loadu_si256((const __m256i*)(rows[t+1]+i));
+            __m256i alo = _mm256_unpacklo_epi8(a, zero), ahi = _mm256_unpackhi_epi8(a, zero);
+            __m256i blo = _mm256_unpacklo_epi8(b, zero), bhi = _mm256_unpackhi_epi8(b, zero);
+            acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(_mm256_unpacklo_epi16(alo, blo), w));
+            acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(_mm256_unpackhi_epi16(alo, blo), w));
+            acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(_mm256_unpacklo_epi16(ahi, bhi), w));
+            acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(_mm256_unpackhi_epi16(ahi, bhi), w));
+        }
+        // Unpacking works within 128 bit lanes so these hold pixels
+        // 0 1 | 4 5 and 2 3 | 6 7
+        __m256i lo = _mm256_packs_epi32(_mm256_srai_epi32(acc0, PX_SCALE_ROW_BITS),
+                                        _mm256_srai_epi32(acc1, PX_SCALE_ROW_BITS));
+        __m256i hi = _mm256_packs_epi32(_mm256_srai_epi32(acc2, PX_SCALE_ROW_BITS),
+                                        _mm256_srai_epi32(acc3, PX_SCALE_ROW_BITS));
+        _mm256_storeu_si256((__m256i*)(out+i), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i*)(out+i+16), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+
+    verticalRowSSE2(rows, weights, taps, out, i/4, width);
+}
+
+// Two destination pixels at a time, one per 128 bit lane
+PX_TARGET_AVX2 static void horizontalRowAVX2(const short* in, const pxScaleTable* t,
+                                             pxPixel* out, int start, int width)
+{
+    __m256i round = _mm256_set1_epi32(1 << (PX_SCALE_FINAL_BITS-1));
+
+    int x = start;
+    for (; x + 2 <= width; x += 2)
+    {
+        const short* s0 = in + t->first[x] * 4;
+        const short* s1 = in + t->first[x+1] * 4;
+        const short* w0 = t->pairs + x * t->taps * 4;
+        const short* w1 = w0 + t->taps * 4;
+        __m256i acc = round;
+        for (int j = 0; j < t->taps; j += 2)
+        {
+            __m256i p = _mm256_inserti128_si256(_mm256_castsi128_si256(
+                _mm_loadu_si128((const __m128i*)(s0 + j*4))),
+                _mm_loadu_si128((const __m128i*)(s1 + j*4)), 1);
+            __m256i w = _mm256_inserti128_si256(_mm256_castsi128_si256(
+                _mm_loadu_si128((const __m128i*)(w0 + j*4))),
+                _mm_loadu_si128((const __m128i*)(w1 + j*4)), 1);
+            p = _mm256_unpacklo_epi16(p, _mm256_srli_si256(p, 8));
+            acc = _mm256_add_epi32(acc, _mm256_madd_epi16(p, w));
+        }
+        acc = _mm256_srai_epi32(acc, PX_SCALE_FINAL_BITS);
+        acc = _mm256_packs_epi32(acc, acc);
+        acc = _mm256_packus_epi16(acc, acc);
+        out[x].u = _mm_cvtsi128_si32(_mm256_castsi256_si128(acc));
+        out[x+1].u = _mm_cvtsi128_si32(_mm256_extracti128_si256(acc, 1));
+    }
+
+    horizontalRowSSE2(in, t, out, x, width);
+}
+
+#endif
+
+static verticalFunc pickVertical()
+{
+#if defined(PX_SIMD_X86)
+    unsigned int features = pxCpuFeatures();
+    if (features & PX_CPU_AVX2)
+        return verticalRowAVX2;
+    if (features & PX_CPU_SSE2)
+        return verticalRowSSE2;
+#endif
+    return verticalRow;
+}
+
+static horizontalFunc pickHorizontal()
+{
+#if defined(PX_SIMD_X86)
+    unsigned int features = pxCpuFeatures();
+    if (features & PX_CPU_AVX2)
+        return horizontalRowAVX2;
+    if (features & PX_CPU_SSE2)
+        return horizontalRowSSE2;
+#endif
+    return horizontalRow;
+}
+
+// A band of destination rows scaled by one thread
+struct pxScaleBand
+{
+    const pxBuffer* src;
+    pxBuffer* dst;
+    const pxScaleTable* x;
+    const pxScaleTable* y;
+    pxScaleFilter filter;
+    short* row;
+    int top, bottom;
+    verticalFunc vertical;
+    horizontalFunc horizontal;
+};
+
+static void scaleBand(pxScaleBand* b)
+{
+    const pxBuffer& src = *b->src;
+    pxBuffer& dst = *b->dst;
+
+    if (b->filter == PX_SCALE_NEAREST)
+    {
+        for (int y = b->top; y < b->bottom; y++)
+        {
+            const pxPixel* s = src.scanline(b->y->first[y]);
+            pxPixel* d = dst.scanline(y);
+            for (int x = 0; x < dst.width(); x++)
+                d[x] = s[b->x->first[x]];
+        }
+        return;
+    }
+
+    int taps = b->y->taps;
+    const unsigned char** rows = new const unsigned char*[taps];
+    for (int y = b->top; y < b->bottom; y++)
+    {
+        // Taps past the last row have no weight but still get read
+        for (int t = 0; t < taps; t++)
+        {
+            int r = pxMin<int>(b->y->first[y] + t, src.height() - 1);
+            rows[t] = (const unsigned char*)src.scanline(r);
+        }
+        b->vertical(rows, b->y->weights + y * taps, taps, b->row, 0, src.width());
+        b->horizontal(b->row, b->x, dst.scanline(y), 0, dst.width());
+    }
+    delete [] rows;
+}
+
+// Scales the bands on threads that are kept between calls.  Each band
+// is one tile, so a thread that finishes early can take a whole band
+// that hasn't been started but bands are never split.
+class pxScaleWorkers: public pxTileRenderer
+{
+public:
+    void run(pxBuffer& dst, pxScaleBand* bands, int count)
+    {
+        for (int i = 0; i < count; i++)
+            mBands[i] = pxRect(0, bands[i].top, dst.width(), bands[i].bottom);
+        mScaleBands = bands;
+        render(dst, mBands, count, count);
+    }
+
+protected:
+    void renderTile(pxBuffer& b, const pxRect& tile)
+    {
+        // tile is one of mBands
+        scaleBand(&mScaleBands[&tile - mBands]);
+    }
+
+private:
+    pxRect mBands[64];
+    pxScaleBand* mScaleBands;
+};
+
+pxScaler::pxScaler(): mClock(0), mRows(NULL), mRowCapacity(0), mWorkers(NULL)
+{
+    memset(mCache, 0, sizeof(mCache));
+}
+
+pxScaler::~pxScaler()
+{
+    term();
+}
+
+void pxScaler::term()
+{
+    for (int i = 0; i < PX_SCALE_CACHE_SIZE; i++)
+    {
+        delete mCache[i].x;
+        delete mCache[i].y;
+    }
+    memset(mCache, 0, sizeof(mCache));
+    mClock = 0;
+
+    delete [] mRows;
+    mRows = NULL;
+    mRowCapacity = 0;
+
+    delete mWorkers;
+    mWorkers = NULL;
+}
+
+pxScaler::cacheEntry* pxScaler::prepare(int srcWidth, int srcHeight,
+                                        int dstWidth, int dstHeight,
+                                        pxScaleFilter filter)
+{
+    cacheEntry* e = NULL;
+    for (int i = 0; i < PX_SCALE_CACHE_SIZE; i++)
+    {
+        cacheEntry* c = &mCache[i];
+        if (c->x && c->srcWidth == srcWidth && c->srcHeight == srcHeight &&
+            c->dstWidth == dstWidth && c->dstHeight == dstHeight &&
+            c->filter == filter)
+        {
+            c->lastUsed = ++mClock;
+            return c;
+        }
+        // Empty entries go first, then the one unused for longest
+        if (!e || (e->x && (!c->x || c->lastUsed < e->lastUsed)))
+            e = c;
+    }
+
+    delete e->x;
+    delete e->y;
+    e->x = new pxScaleTable;
+    e->y = new pxScaleTable;
+    if (filter == PX_SCALE_NEAREST)
+    {
+        buildNearest(e->x, srcWidth, dstWidth);
+        buildNearest(e->y, srcHeight, dstHeight);
+    }
+    else
+    {
+        buildFiltered(e->x, srcWidth, dstWidth, filter);
+        buildFiltered(e->y, srcHeight, dstHeight, filter);
+    }
+
+    e->srcWidth = srcWidth;
+    e->srcHeight = srcHeight;
+    e->dstWidth = dstWidth;
+    e->dstHeight = dstHeight;
+    e->filter = filter;
+    e->lastUsed = ++mClock;
+    return e;
+}
+
+pxError pxScaler::scale(const pxBuffer& src, pxBuffer& dst,
+                        pxScaleFilter filter, int threads)
+{
+    if (dst.width() <= 0 || dst.height() <= 0)
+        return PX_OK;
+    if (!src.base() || !dst.base() || src.width() <= 0 || src.height() <= 0)
+        return PX_FAIL;
+
+    if (threads <= 0)
+        threads = pxCpuCount();
+    // Bands much smaller than this cost more to hand out than they save
+    threads = pxClamp<int>(threads, 1, pxMax<int>(1, dst.height() / 16));
+
+    threads = pxMin<int>(threads, 64);
+
+    cacheEntry* e = prepare(src.width(), src.height(), dst.width(), dst.height(),
+                            filter);
+
+    // Room for the taps that run past the end of the row
+    int rowSize = 0;
+    if (filter != PX_SCALE_NEAREST)
+    {
+        rowSize = (src.width() + e->x->taps) * 4;
+        if (rowSize * threads > mRowCapacity)
+        {
+            delete [] mRows;
+            mRowCapacity = rowSize * threads;
+            mRows = new short[mRowCapacity];
+            memset(mRows, 0, mRowCapacity * sizeof(short));
+        }
+    }
+
+    pxScaleBand bands[64];
+    for (int i = 0; i < threads; i++)
+    {
+        pxScaleBand& b = bands[i];
+        b.src = &src;
+        b.dst = &dst;
+        b.x = e->x;
+        b.y = e->y;
+        b.filter = filter;
+        b.row = rowSize?mRows + i * rowSize:NULL;
+        b.top = dst.height() * i / threads;
+        b.bottom = dst.height() * (i+1) / threads;
+        b.vertical = pickVertical();
+        b.horizontal = pickHorizontal();
+    }
+
+    if (threads == 1)
+        scaleBand(&bands[0]);
+    else
+    {
+        if (!mWorkers)
+            mWorkers = new pxScaleWorkers;
+        mWorkers->run(dst, bands, threads);
+    }
+
+    return PX_OK;
+}
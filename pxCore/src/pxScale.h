@@ -0,0 +1,76 @@
+// pxCore CopyRight 2007 John Robinson
+// Portable Framebuffer and Windowing Library
+// pxScale.h
+
+#ifndef PX_SCALE_H
+#define PX_SCALE_H
+
+#include "pxCore.h"
+#include "pxBuffer.h"
+
+struct pxScaleTable;
+class pxScaleWorkers;
+
+// How many pairs of sizes a pxScaler keeps filter tables for
+#define PX_SCALE_CACHE_SIZE 4
+
+enum pxScaleFilter
+{
+    PX_SCALE_NEAREST,       // Fastest, blocky when enlarging and aliases when shrinking
+    PX_SCALE_BILINEAR,      // Smooth enlarging, only good down to about half size
+    PX_SCALE_BOX            // Averages every source pixel covered, best for shrinking
+};
+
+// Resamples a whole pxBuffer into another of any size.  Either buffer can
+// be upside down and have any stride, to scale part of a buffer describe
+// that part with another pxBuffer.
+//
+// Filtering is done in two separable passes, down the columns and then
+// along the rows, with SSE2 or AVX2 kernels where available (see pxCpu.h)
+// that produce exactly the same pixels as the scalar code.  The filter
+// coefficients depend only on the two sizes and are kept between calls
+// for the last PX_SCALE_CACHE_SIZE pairs of sizes used, so reuse a
+// pxScaler for a stream of frames, even if it switches between a few
+// sizes.
+class pxScaler
+{
+public:
+    pxScaler();
+    ~pxScaler();
+
+    // threads splits the destination into bands of rows scaled in
+    // parallel, 0 uses one thread per processor.  The threads are
+    // started by the first call that needs them and kept until term.
+    pxError scale(const pxBuffer& src, pxBuffer& dst,
+                  pxScaleFilter filter, int threads = 1);
+
+    // Frees the coefficient tables and working rows and stops the threads
+    void term();
+
+private:
+    // Filter tables for one pair of sizes
+    struct cacheEntry
+    {
+        int srcWidth, srcHeight;
+        int dstWidth, dstHeight;
+        pxScaleFilter filter;
+        pxScaleTable* x;
+        pxScaleTable* y;
+        unsigned long lastUsed;
+    };
+
+    // Finds or builds the tables, replacing the least recently used
+    cacheEntry* prepare(int srcWidth, int srcHeight, int dstWidth, int dstHeight,
+                        pxScaleFilter filter);
+
+    cacheEntry mCache[PX_SCALE_CACHE_SIZE];
+    unsigned long mClock;
+
+    // One working row per band, only ever grows
+    short* mRows;
+    int mRowCapacity;
+
+    pxScaleWorkers* mWorkers;
+};
+
+#endif
@@ -0,0 +1,402 @@
+// pxCore CopyRight 2007 John Robinson
+// Portable Framebuffer and Windowing Library
+// pxTileRenderer.cpp
+
+#include "pxTileRenderer.h"
+#include "pxAtomic.h"
+#include "pxCpu.h"
+
+#if defined(PX_PLATFORM_WIN)
+#include <process.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#define PX_TILE_MAX_THREADS     64
+
+// The tiles [next, end) of the render's list that one thread still has
+// to do.  The owner takes from the front and thieves from the back.
+// Padded to a cache line so threads don't slow each other down.
+struct pxTileQueue
+{
+    volatile long lock;
+    int next;
+    int end;
+    char pad[64 - sizeof(long) - 2*sizeof(int)];
+};
+
+// Only held for a few instructions so spinning is cheaper than a mutex
+static void lockQueue(pxTileQueue* q)
+{
+    while (!pxAtomicCompareAndSwap(&q->lock, 0, 1))
+    {
+#if defined(PX_PLATFORM_WIN)
+        SwitchToThread();
+#else
+        sched_yield();
+#endif
+    }
+}
+
+static void unlockQueue(pxTileQueue* q)
+{
+    pxMemoryBarrier();
+    q->lock = 0;
+}
+
+struct pxTileWorker
+{
+    pxTileRenderer* renderer;
+    pxTilePool* pool;
+    int index;
+#if defined(PX_PLATFORM_WIN)
+    HANDLE thread;
+    HANDLE start;       // Set for each render the worker takes part in
+#else
+    pthread_t thread;
+    unsigned long seen;     // The last render the worker looked at
+#endif
+
+    static void run(pxTileWorker* w);
+};
+
+// Worker i (from 1) works on run i of every render with more than i
+// threads and waits for the next render otherwise
+struct pxTilePool
+{
+    pxTileWorker workers[PX_TILE_MAX_THREADS];
+    int count;              // Workers started, they are never stopped early
+    int active;             // Workers taking part in the current render
+    volatile long finished;
+    bool quit;
+#if defined(PX_PLATFORM_WIN)
+    HANDLE done;
+#else
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    unsigned long generation;
+#endif
+};
+
+void pxTileWorker::run(pxTileWorker* w)
+{
+    pxTilePool* p = w->pool;
+#if defined(PX_PLATFORM_WIN)
+    for (;;)
+    {
+        WaitForSingleObject(w->start, INFINITE);
+        if (p->quit)
+            break;
+        w->renderer->work(w->index);
+        if (pxAtomicIncrement(&p->finished) == p->active)
+            SetEvent(p->done);
+    }
+#else
+    pthread_mutex_lock(&p->mutex);
+    unsigned long seen = w->seen;
+    for (;;)
+    {
+        while (p->generation == seen && !p->quit)
+            pthread_cond_wait(&p->start, &p->mutex);
+        if (p->quit)
+            break;
+        seen = p->generation;
+        if (w->index > p->active)
+            continue;
+
+        pthread_mutex_unlock(&p->mutex);
+        w->renderer->work(w->index);
+        pthread_mutex_lock(&p->mutex);
+
+        if (++p->finished == p->active)
+            pthread_cond_signal(&p->done);
+    }
+    pthread_mutex_unlock(&p->mutex);
+#endif
+}
+
+#if defined(PX_PLATFORM_WIN)
+static unsigned __stdcall workerThread(void* p)
+{
+    pxTileWorker::run((pxTileWorker*)p);
+    return 0;
+}
+#else
+static void* workerThread(void* p)
+{
+    pxTileWorker::run((pxTileWorker*)p);
+    return NULL;
+}
+#endif
+
+pxTileRenderer::pxTileRenderer(): mTileWidth(64), mTileHeight(64),
+    mPool(NULL), mTiles(NULL), mTileCapacity(0), mBuffer(NULL), mWork(NULL),
+    mQueues(NULL), mThreads(0), mStolen(0)
+{
+}
+
+pxTileRenderer::~pxTileRenderer()
+{
+    if (mPool)
+    {
+        pxTilePool* p = mPool;
+#if defined(PX_PLATFORM_WIN)
+        p->quit = true;
+        for (int i = 1; i <= p->count; i++)
+        {
+            SetEvent(p->workers[i].start);
+            WaitForSingleObject(p->workers[i].thread, INFINITE);
+            CloseHandle(p->workers[i].thread);
+            CloseHandle(p->workers[i].start);
+        }
+        CloseHandle(p->done);
+#else
+        pthread_mutex_lock(&p->mutex);
+        p->quit = true;
+        pthread_cond_broadcast(&p->start);
+        pthread_mutex_unlock(&p->mutex);
+        for (int i = 1; i <= p->count; i++)
+            pthread_join(p->workers[i].thread, NULL);
+        pthread_cond_destroy(&p->start);
+        pthread_cond_destroy(&p->done);
+        pthread_mutex_destroy(&p->mutex);
+#endif
+        delete p;
+    }
+    delete [] mTiles;
+}
+
+void pxTileRenderer::setTileSize(int width, int height)
+{
+    mTileWidth = pxMax<int>(width, 1);
+    mTileHeight = pxMax<int>(height, 1);
+}
+
+pxError pxTileRenderer::render(pxBuffer& b, int threads)
+{
+    if (b.width() <= 0 || b.height() <= 0)
+        return PX_OK;
+
+    if (threads <= 0)
+        threads = pxCpuCount();
+
+    // A single thread has nothing to balance, and renderTile is quicker
+    // given long rows, so it takes the buffer in full width bands
+    int tileWidth = (threads == 1)?b.width():mTileWidth;
+
+    int across = (b.width() + tileWidth - 1) / tileWidth;
+    int down = (b.height() + mTileHeight - 1) / mTileHeight;
+    int count = across * down;
+    if (count > mTileCapacity)
+    {
+        delete [] mTiles;
+        mTiles = new pxRect[count];
+        mTileCapacity = count;
+    }
+
+    // Row major so each thread's first run is a band of the buffer
+    pxRect* t = mTiles;
+    for (int y = 0; y < b.height(); y += mTileHeight)
+    {
+        for (int x = 0; x < b.width(); x += tileWidth)
+        {
+            *t++ = pxRect(x, y, pxMin<int>(x + tileWidth, b.width()),
+                          pxMin<int>(y + mTileHeight, b.height()));
+        }
+    }
+
+    return render(b, mTiles, count, threads);
+}
+
+pxError pxTileRenderer::render(pxBuffer& b, const pxRect* tiles, int count,
+                               int threads)
+{
+    mStolen = 0;
+    if (count <= 0)
+        return PX_OK;
+    if (!b.base())
+        return PX_FAIL;
+
+    if (threads <= 0)
+        threads = pxCpuCount();
+    threads = pxClamp<int>(threads, 1, pxMin<int>(count, PX_TILE_MAX_THREADS));
+
+    // Nobody to balance the load with, so just go through the tiles
+    if (threads == 1)
+    {
+        for (int i = 0; i < count; i++)
+            renderTile(b, tiles[i]);
+        return PX_OK;
+    }
+
+    pxTileQueue queues[PX_TILE_MAX_THREADS];
+    for (int i = 0; i < threads; i++)
+    {
+        queues[i].lock = 0;
+        queues[i].next = count * i / threads;
+        queues[i].end = count * (i+1) / threads;
+    }
+
+    mBuffer = &b;
+    mWork = tiles;
+    mQueues = queues;
+    mThreads = threads;
+
+    runWorkers(threads);
+
+    mBuffer = NULL;
+    mWork = NULL;
+    mQueues = NULL;
+    mThreads = 0;
+
+    return PX_OK;
+}
+
+void pxTileRenderer::runWorkers(int threads)
+{
+    if (threads > 1 && !mPool)
+    {
+        mPool = new pxTilePool;
+        mPool->count = 0;
+        mPool->active = 0;
+        mPool->finished = 0;
+        mPool->quit = false;
+#if defined(PX_PLATFORM_WIN)
+        mPool->done = CreateEvent(NULL, FALSE, FALSE, NULL);
+#else
+        pthread_mutex_init(&mPool->mutex, NULL);
+        pthread_cond_init(&mPool->start, NULL);
+        pthread_cond_init(&mPool->done, NULL);
+        mPool->generation = 0;
+#endif
+    }
+
+    pxTilePool* p = mPool;
+    int active = 0;
+    if (p)
+    {
+        // Start any more workers this render needs
+        while (p->count < threads - 1)
+        {
+            pxTileWorker* w = &p->workers[p->count + 1];
+            w->renderer = this;
+            w->pool = p;
+            w->index = p->count + 1;
+#if defined(PX_PLATFORM_WIN)
+            w->start = CreateEvent(NULL, FALSE, FALSE, NULL);
+            w->thread = (HANDLE)_beginthreadex(NULL, 0, workerThread, w, 0, NULL);
+            if (!w->thread)
+            {
+                CloseHandle(w->start);
+                break;
+            }
+#else
+            // Only this thread changes the generation so the new worker
+            // can be told which render it has already seen
+            w->seen = p->generation;
+            if (pthread_create(&w->thread, NULL, workerThread, w))
+                break;
+#endif
+            p->count++;
+        }
+        active = pxMin<int>(threads - 1, p->count);
+    }
+
+    if (active)
+    {
+#if defined(PX_PLATFORM_WIN)
+        p->active = active;
+        p->finished = 0;
+        for (int i = 1; i <= active; i++)
+            SetEvent(p->workers[i].start);
+#else
+        pthread_mutex_lock(&p->mutex);
+        p->active = active;
+        p->finished = 0;
+        p->generation++;
+        pthread_cond_broadcast(&p->start);
+        pthread_mutex_unlock(&p->mutex);
+#endif
+    }
+
+    // The calling thread works on the first run itself
+    work(0);
+
+    if (active)
+    {
+#if defined(PX_PLATFORM_WIN)
+        WaitForSingleObject(p->done, INFINITE);
+#else
+        pthread_mutex_lock(&p->mutex);
+        while (p->finished < p->active)
+            pthread_cond_wait(&p->done, &p->mutex);
+        pthread_mutex_unlock(&p->mutex);
+#endif
+    }
+}
+
+void pxTileRenderer::work(int index)
+{
+    int tile;
+    while (next(index, tile))
+        renderTile(*mBuffer, mWork[tile]);
+}
+
+bool pxTileRenderer::next(int index, int& tile)
+{
+    pxTileQueue* own = &mQueues[index];
+
+    lockQueue(own);
+    if (own->next < own->end)
+    {
+        tile = own->next++;
+        unlockQueue(own);
+        return true;
+    }
+    unlockQueue(own);
+
+    // Out of work so take the back half of the longest remaining run.
+    // Only this thread adds to its own queue so it stays empty meanwhile.
+    for (;;)
+    {
+        int victim = -1;
+        int most = 0;
+        for (int i = 0; i < mThreads; i++)
+        {
+            int left = mQueues[i].end - mQueues[i].next;
+            if (i != index && left > most)
+            {
+                victim = i;
+                most = left;
+            }
+        }
+        if (victim < 0)
+            return false;
+
+        pxTileQueue* q = &mQueues[victim];
+        lockQueue(q);
+        int left = q->end - q->next;
+        if (left <= 0)
+        {
+            // Someone got there first
+            unlockQueue(q);
+            continue;
+        }
+        int first = q->end - (left + 1) / 2;
+        int end = q->end;
+        q->end = first;
+        unlockQueue(q);
+
+        pxAtomicIncrement(&mStolen);
+
+        lockQueue(own);
+        own->next = first + 1;
+        own->end = end;
+        unlockQueue(own);
+
+        tile = first;
+        return true;
+    }
+}
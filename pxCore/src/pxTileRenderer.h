@@ -0,0 +1,80 @@
+// pxCore CopyRight 2007 John Robinson
+// Portable Framebuffer and Windowing Library
+// pxTileRenderer.h
+
+#ifndef PX_TILE_RENDERER_H
+#define PX_TILE_RENDERER_H
+
+#include "pxCore.h"
+#include "pxBuffer.h"
+#include "pxRect.h"
+
+struct pxTileQueue;
+struct pxTilePool;
+
+// Renders a pxBuffer in parallel by splitting it into tiles.  Each thread
+// starts with its own run of tiles and takes half of another thread's
+// remaining run when it finishes, so the load stays balanced even when
+// some tiles cost far more than others.
+//
+// The worker threads are started by the first render that needs them and
+// wait between renders until the renderer is destroyed, so rendering a
+// frame doesn't pay for creating threads.
+//
+// Derive from it and implement renderTile.
+class pxTileRenderer
+{
+public:
+    pxTileRenderer();
+    virtual ~pxTileRenderer();
+
+    // Tiles are 64x64 pixels by default
+    void setTileSize(int width, int height);
+    int tileWidth() const { return mTileWidth; }
+    int tileHeight() const { return mTileHeight; }
+
+    // Renders all of b.  threads includes the calling thread, 0 uses one
+    // per processor.  Returns once every tile is done.  A single thread
+    // renders bands the full width of b and the tile height.
+    pxError render(pxBuffer& b, int threads = 0);
+
+    // Renders just the given rectangles of b, which mustn't overlap.  They
+    // are handed out in order so put the ones wanted first at the front.
+    // A single thread renders them in order on the calling thread.
+    pxError render(pxBuffer& b, const pxRect* tiles, int count, int threads = 0);
+
+    // How many times during the last render a thread ran out of tiles and
+    // took some from another
+    int steals() const { return mStolen; }
+
+protected:
+    // Renders the part of b inside tile.  Called from several threads at
+    // once, each with a different tile.
+    virtual void renderTile(pxBuffer& b, const pxRect& tile) = 0;
+
+private:
+    friend struct pxTileWorker;
+
+    void work(int index);
+    bool next(int index, int& tile);
+
+    // Has workers 1 to threads-1 work alongside the calling thread and
+    // returns when they are done.  Workers that couldn't be started leave
+    // their runs to be stolen.
+    void runWorkers(int threads);
+
+    int mTileWidth, mTileHeight;
+    pxTilePool* mPool;
+
+    pxRect* mTiles;
+    int mTileCapacity;
+
+    // Valid during a render
+    pxBuffer* mBuffer;
+    const pxRect* mWork;
+    pxTileQueue* mQueues;
+    int mThreads;
+    volatile long mStolen;
+};
+
+#endif
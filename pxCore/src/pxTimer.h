@@ -5,10 +5,25 @@
 #ifndef PX_TIMER_H
 #define PX_TIMER_H
 
+// All of these read the same monotonic clock.  It never jumps when the
+// wall clock is set and only differences between readings mean anything.
 double pxSeconds();
 double pxMilliseconds();
 double pxMicroseconds();
 
+// The clock in whole nanoseconds.  Intervals and deadlines kept in this
+// form add up exactly where doubles slowly lose precision.
+long long pxNanoseconds();
+
+#define PX_NS_PER_SECOND        1000000000LL
+#define PX_NS_PER_MS            1000000LL
+#define PX_NS_PER_US            1000LL
+
 void pxSleepMS(unsigned long msToSleep);
 
+// Sleeps until pxNanoseconds() reaches deadline, returning straight away
+// if it already has.  Sleeping to an absolute deadline doesn't drift the
+// way repeated relative sleeps do.
+void pxSleepUntil(long long deadline);
+
 #endif
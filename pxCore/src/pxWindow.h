@@ -8,6 +8,7 @@
 #include "pxOffscreen.h"
 #include "pxCore.h"
 #include "pxRect.h"
+#include "pxFrameScheduler.h"
 class pxWindow: public pxWindowNative
 {
 public:
@@ -24,6 +25,9 @@ public:
     bool visibility();
     void setVisibility(bool visible);
 
+    // Asks for onDraw to be called for r, or the whole window if NULL.
+    // Invalidations are collected and drawn together when the event
+    // loop is idle.
     void invalidateRect(pxRect* r = NULL);
 
     void setTitle(char* name);
@@ -32,6 +36,14 @@ public:
 	// zero disables
     pxError setAnimationFPS(long fps);
 
+    // What happens to animation frames that come due while the event
+    // loop is busy, dropped by default.  See pxFrameScheduler.h.
+    void setAnimationPolicy(pxFramePolicy policy);
+
+    // How many frames were delivered or dropped and how late they were
+    // since the animation rate was first set.  X11 only at the moment.
+    pxError animationStats(pxFrameStats& stats);
+
     // obtain a pxSurfaceNative to perform platform native
     // drawing to a window outside of the onDraw event
     pxError beginNativeDrawing(pxSurfaceNative& s);
@@ -53,6 +65,13 @@ protected:
 
     virtual void onMouseMove(int x, int y) {}
 
+    // Pointer motion can arrive faster than a window draws so queued
+    // moves are collapsed into one onMouseMove at the latest position.
+    // When more than one was collapsed the positions, oldest first, are
+    // passed here just before that onMouseMove.  Only X11 collapses
+    // motion at the moment.
+    virtual void onMouseMoveBatch(const pxMouseSample* samples, int count) {}
+
 	// See pxWindowNative.h for keycode constants
     // See constants used for flags below
     virtual void onKeyDown(int keycode, unsigned long flags) {}
@@ -66,6 +85,12 @@ protected:
 	// To enable this event call setAnimationFPS defined above
     virtual void onAnimationTimer() {}
 
+    // The same event with the frame number and when it was due and
+    // delivered.  Frames are due at exact multiples of the period so
+    // a late one doesn't push back the rest.  Only X11 calls this, the
+    // default calls onAnimationTimer.
+    virtual void onAnimationFrame(const pxFrameInfo& info) { onAnimationTimer(); }
+
 };
 
 // flags used in onMouseDown and onMouseUp
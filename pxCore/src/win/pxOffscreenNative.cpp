@@ -9,7 +9,9 @@
 #include "../pxOffscreen.h"
 #include "../pxRect.h"
 
-pxError pxOffscreen::init(int width, int height)
+// DIB sections are allocated by GDI with a fixed stride so flags are
+// ignored here and none of this memory shows up in the stats
+pxError pxOffscreen::init(int width, int height, unsigned int /*flags*/)
 {
     // Optimization
     if (bitmap)
@@ -28,6 +28,9 @@ public:
         DeleteDC(dc);
     }
 
+    // Blits have finished with the pixels by the time they return
+    void waitForBlits() {}
+
 protected:
     HBITMAP bitmap;
 
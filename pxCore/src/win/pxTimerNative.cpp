@@ -4,13 +4,23 @@
 
 #include <windows.h>
 
+#include "../pxTimer.h"
+
 static bool gFreqInitialized = false;
 static LARGE_INTEGER gFreq;
 
-double pxSeconds()
+static void initFreq()
 {
     if (!gFreqInitialized)
+    {
         ::QueryPerformanceFrequency(&gFreq);
+        gFreqInitialized = true;
+    }
+}
+
+double pxSeconds()
+{
+    initFreq();
 
     LARGE_INTEGER c;
     ::QueryPerformanceCounter(&c);
@@ -20,8 +30,7 @@ double pxSeconds()
 
 double pxMilliseconds()
 {
-    if (!gFreqInitialized)
-        ::QueryPerformanceFrequency(&gFreq);
+    initFreq();
 
     LARGE_INTEGER c;
     ::QueryPerformanceCounter(&c);
@@ -31,8 +40,7 @@ double pxMilliseconds()
 
 double pxMicroseconds()
 {
-    if (!gFreqInitialized)
-        ::QueryPerformanceFrequency(&gFreq);
+    initFreq();
 
     LARGE_INTEGER c;
     ::QueryPerformanceCounter(&c);
@@ -40,7 +48,37 @@ double pxMicroseconds()
     return (c.QuadPart * 1000000) / (double)gFreq.QuadPart;
 }
 
+long long pxNanoseconds()
+{
+    initFreq();
+
+    LARGE_INTEGER c;
+    ::QueryPerformanceCounter(&c);
+
+    // Whole seconds and the remainder are scaled separately so the
+    // multiply can't overflow
+    long long f = gFreq.QuadPart;
+    return (c.QuadPart / f) * PX_NS_PER_SECOND + 
+        ((c.QuadPart % f) * PX_NS_PER_SECOND) / f;
+}
+
 void pxSleepMS(unsigned long sleepMS)
 {
     Sleep(sleepMS);
+}
+
+void pxSleepUntil(long long deadline)
+{
+    // Sleep only has millisecond granularity, and usually less, so the
+    // last couple of milliseconds are given up a timeslice at a time
+    for (;;)
+    {
+        long long remaining = deadline - pxNanoseconds();
+        if (remaining <= 0)
+            break;
+        if (remaining > 2 * PX_NS_PER_MS)
+            Sleep((DWORD)(remaining / PX_NS_PER_MS) - 1);
+        else
+            SwitchToThread();
+    }
 }
\ No newline at end of file
@@ -6,12 +6,14 @@
 #include "pxOffscreenNative.h"
 #include "pxWindowNative.h"
 #include "../pxWindow.h"
+#include "../pxAtomic.h"
 
 #include <tchar.h>
 #define _ATL_NO_HOSTING
 #include <atlconv.h>
 
 #define WM_DEFERREDCREATE   WM_USER+1000
+#define WM_POSTEDMESSAGE    WM_USER+1001
 
 #ifdef WINCE
 #define MOBILE
@@ -102,6 +104,16 @@ pxError pxWindow::setAnimationFPS(long fps)
     return PX_OK;
 }
 
+void pxWindow::setAnimationPolicy(pxFramePolicy policy)
+{
+    // SetTimer has no notion of deadlines
+}
+
+pxError pxWindow::animationStats(pxFrameStats& stats)
+{
+    return PX_FAIL;
+}
+
 void pxWindow::setTitle(char* title)
 {
 	USES_CONVERSION;
@@ -130,6 +142,101 @@ void pxWindowNative::sendSynchronizedMessage(char* messageName, void *p1)
     ::SendMessage(mWindow, WM_USER, 0, (LPARAM)&m);
 }
 
+// For a keyed message, the payload waiting at its key if there still is one
+static postedMessage* payload(postedMessage* m)
+{
+    if (!m->key)
+        return m;
+
+    postedMessage* p = (postedMessage*)
+        pxAtomicExchangePointer(&m->key->pending, NULL);
+    delete m;
+    return p;
+}
+
+// For a message that won't be delivered
+static void discardMessage(postedMessage* m)
+{
+    if (m->release)
+        m->release(m->messageName, m->p1);
+    delete m;
+}
+
+void pxWindowNative::postMessage(char* messageName, void* p1,
+                                 unsigned long key, pxMessageRelease release)
+{
+    postedMessage* m = new postedMessage;
+    m->messageName = messageName;
+    m->p1 = p1;
+    m->key = NULL;
+    m->release = release;
+
+    pxMessageKey* k = key?findKey(key):NULL;
+    if (k)
+    {
+        // Whoever swaps out a payload owns it.  If one was waiting its
+        // message is still queued and will pick this one up instead.
+        postedMessage* old = (postedMessage*)
+            pxAtomicExchangePointer(&k->pending, m);
+        if (old)
+        {
+            discardMessage(old);
+            return;
+        }
+
+        m = new postedMessage;
+        m->messageName = NULL;
+        m->p1 = NULL;
+        m->key = k;
+        m->release = NULL;
+    }
+
+    if (!::PostMessage(mWindow, WM_POSTEDMESSAGE, 0, (LPARAM)m))
+    {
+        m = payload(m);
+        if (m)
+            discardMessage(m);
+    }
+}
+
+void pxWindowNative::dropMessages()
+{
+    MSG msg;
+    while (::PeekMessage(&msg, mWindow, WM_POSTEDMESSAGE, WM_POSTEDMESSAGE,
+                         PM_REMOVE))
+    {
+        postedMessage* m = payload((postedMessage*)msg.lParam);
+        if (m)
+            discardMessage(m);
+    }
+
+    for (int i = 0; i < PX_MESSAGE_KEYS; i++)
+    {
+        postedMessage* m = (postedMessage*)
+            pxAtomicExchangePointer(&mKeys[i].pending, NULL);
+        if (m)
+            discardMessage(m);
+    }
+}
+
+// Keys are claimed in order and never given back so the first free one
+// ends the search
+pxMessageKey* pxWindowNative::findKey(unsigned long key)
+{
+    long k = (long)key;
+    for (int i = 0; i < PX_MESSAGE_KEYS; i++)
+    {
+        if (mKeys[i].key == k)
+            return &mKeys[i];
+        if (mKeys[i].key == 0 &&
+            (pxAtomicCompareAndSwap(&mKeys[i].key, 0, k) || mKeys[i].key == k))
+            return &mKeys[i];
+    }
+
+    // Out of keys, the message just isn't coalesced
+    return NULL;
+}
+
 LRESULT __stdcall pxWindowNative::windowProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
 {
     int mouseButtonShift = 0;
@@ -182,6 +289,7 @@ LRESULT __stdcall pxWindowNative::windowProc(HWND hWnd, UINT msg, WPARAM wParam,
 
         case WM_DESTROY:
             w->onClose(); 
+            w->dropMessages();
             SetProp(hWnd, _T("wnWindow"), NULL);
             break;
 
@@ -286,6 +394,16 @@ LRESULT __stdcall pxWindowNative::windowProc(HWND hWnd, UINT msg, WPARAM wParam,
                 w->onSynchronizedMessage(m->messageName, m->p1);
             }
             break;
+        case WM_POSTEDMESSAGE:
+            {
+                postedMessage* m = payload((postedMessage*)lParam);
+                if (m)
+                {
+                    w->onSynchronizedMessage(m->messageName, m->p1);
+                    delete m;
+                }
+            }
+            break;
         }
     }
 
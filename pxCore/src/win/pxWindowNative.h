@@ -9,12 +9,40 @@
 #include "../pxRect.h"
 #include "pxOffscreenNative.h"
 
+// A window coalesces posted messages on up to this many different keys
+#define PX_MESSAGE_KEYS 16
+
+// The latest message posted with key that hasn't been delivered yet
+struct pxMessageKey
+{
+    volatile long key;
+    void* volatile pending;
+};
+
 class pxWindowNative
 {
 public:
-    pxWindowNative(): mWindow(NULL), mTimerId(NULL) {}
+    pxWindowNative(): mWindow(NULL), mTimerId(NULL)
+    {
+        for (int i = 0; i < PX_MESSAGE_KEYS; i++)
+        {
+            mKeys[i].key = 0;
+            mKeys[i].pending = NULL;
+        }
+    }
     virtual ~pxWindowNative() {}
 
+    // Returns straight away and has onSynchronizedMessage called on the
+    // window's thread.  A message posted with a non zero key replaces one
+    // with the same key that hasn't been delivered yet.  Once delivered
+    // the handler owns p1, if the message is replaced or the window is
+    // destroyed first release is called with it.  Messages for a window
+    // must stop before the window is destroyed.
+    void postMessage(char* messageName, void* p1, unsigned long key = 0,
+                     pxMessageRelease release = NULL);
+
+    // Waits for onSynchronizedMessage to return.  Don't call this from a
+    // thread the window's thread might be waiting for.
     void sendSynchronizedMessage(char* messageName, void* p1);
 
 protected:
@@ -37,14 +65,20 @@ protected:
 
     virtual void onAnimationTimer() = (0);
 
-    // Windows only for now
+    // Sent and posted messages are delivered here on the window's thread
     virtual void onSynchronizedMessage(char* messageName, void* p1) {}
 
     static LRESULT __stdcall windowProc(HWND hWnd, UINT msg, 
             WPARAM wParam, LPARAM lParam);
 
+    pxMessageKey* findKey(unsigned long key);
+
+    // Frees the posted messages that haven't been delivered
+    void dropMessages();
+
     HWND mWindow;
     UINT_PTR mTimerId;
+    pxMessageKey mKeys[PX_MESSAGE_KEYS];
 };
 
 // Key Codes
@@ -156,4 +190,14 @@ typedef struct synchronizedMessage
     void* p1;
 } synchronizedMessage;
 
+// A message with a key is posted as one pointing at the key, the payload
+// waiting there can be replaced until it is delivered
+typedef struct postedMessage
+{
+    char* messageName;
+    void* p1;
+    pxMessageKey* key;
+    pxMessageRelease release;
+} postedMessage;
+
 #endif
\ No newline at end of file
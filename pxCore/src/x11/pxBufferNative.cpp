@@ -7,12 +7,103 @@
 #include "../pxRect.h"
 
 #include "../pxOffscreen.h"
+#include "../pxScale.h"
+
+#include <pthread.h>
+#include <string.h>
+
+// Bottom-up blits are flipped and sent in bands of about this many pixels
+#define PX_BLIT_BAND_PIXELS 65536
+
+// Each thread that does scaled blits keeps its scaler, so the filter
+// tables are reused while the sizes stay the same, and a scratch buffer
+// that only grows.  The scratch is plain memory rather than a shared
+// memory offscreen since it is only sent once per blit.  Bottom-up blits
+// flip their bands into the same scratch.
+struct pxScaleCache
+{
+    pxScaler scaler;
+    pxPixel* pixels;
+    int size;
+};
+
+static pthread_key_t gScaleKey;
+static pthread_once_t gScaleOnce = PTHREAD_ONCE_INIT;
+
+static void freeScaleCache(void* p)
+{
+    pxScaleCache* c = (pxScaleCache*)p;
+    delete [] c->pixels;
+    delete c;
+}
+
+static void makeScaleKey()
+{
+    pthread_key_create(&gScaleKey, freeScaleCache);
+}
+
+static pxScaleCache* scaleCache(int pixels)
+{
+    pthread_once(&gScaleOnce, makeScaleKey);
+    pxScaleCache* c = (pxScaleCache*)pthread_getspecific(gScaleKey);
+    if (!c)
+    {
+        c = new pxScaleCache;
+        c->pixels = NULL;
+        c->size = 0;
+        pthread_setspecific(gScaleKey, c);
+    }
+
+    if (pixels > c->size)
+    {
+        delete [] c->pixels;
+        c->pixels = new pxPixel[pixels];
+        c->size = pixels;
+    }
+    return c;
+}
 
 void pxBuffer::blit(pxSurfaceNative s, int dstLeft, int dstTop, int dstWidth, int dstHeight, 
     int srcLeft, int srcTop, int srcWidth, int srcHeight)
 {
+    if (srcWidth != dstWidth || srcHeight != dstHeight)
+    {
+	// X can't scale so resample into a scratch buffer of the
+	// destination size and send that
+	pxRect r(srcLeft, srcTop, srcLeft+srcWidth, srcTop+srcHeight);
+	r.intersect(bounds());
+	if (r.width() <= 0 || r.height() <= 0 || dstWidth <= 0 || dstHeight <= 0)
+	    return;
+
+	pxBuffer part;
+	part.setBase(pixel(r.left(), upsideDown()?r.bottom()-1:r.top()));
+	part.setWidth(r.width());
+	part.setHeight(r.height());
+	part.setStride(stride());
+	part.setUpsideDown(upsideDown());
+
+	pxScaleCache* c = scaleCache(dstWidth * dstHeight);
+	pxBuffer scaled;
+	scaled.setBase(c->pixels);
+	scaled.setWidth(dstWidth);
+	scaled.setHeight(dstHeight);
+	scaled.setStride(dstWidth * 4);
+	scaled.setUpsideDown(false);
+
+	bool shrinking = dstWidth < r.width() || dstHeight < r.height();
+	c->scaler.scale(part, scaled, shrinking?PX_SCALE_BOX:PX_SCALE_BILINEAR);
+	scaled.blit(s, dstLeft, dstTop, dstWidth, dstHeight, 0, 0);
+	return;
+    }
+
     if (!upsideDown())
     {
+	// Shared memory offscreens can be handed to the server without
+	// copying the pixels through the X socket
+	if (pxOffscreenNative::putShared(s, base(), srcLeft, srcTop,
+					 dstLeft, dstTop, dstWidth, dstHeight))
+	    return;
+
 	XImage* image = ::XCreateImage(s->display, 
 				       XDefaultVisual(s->display, 
 					   XDefaultScreen(s->display)), 
@@ -32,36 +123,38 @@ void pxBuffer::blit(pxSurfaceNative s, int dstLeft, int dstTop, int dstWidth, in
     }
     else
     {
+	// Bottom-up buffers are flipped a band of rows at a time into a
+	// small scratch strip and sent with one request per band.  That
+	// avoids both a flipped copy of the whole buffer and a request per
+	// scanline.
 	pxRect r(srcLeft, srcTop, srcLeft+srcWidth, srcTop+srcHeight);
 	r.intersect(bounds());
-	
-	pxOffscreen flipped;
-	flipped.init(r.width(), r.height());
-	
-	// flip it
-	
-	for (int y = 0; y < flipped.height(); y++)
-	{
-	    pxPixel *s = pixel(r.left(), r.top()+y);
-	    pxPixel *se = s + r.width();
-	    pxPixel *d = flipped.scanline(y);
-	    while (s < se)
-	    {
-		*d++ = *s++;
-	    }
-	}
-	
+
+	int w = pxMin<int>(dstWidth, r.width());
+	int h = pxMin<int>(dstHeight, r.height());
+
+	if (w <= 0 || h <= 0)
+	    return;
+
+	int bandRows = pxMax<int>(1, pxMin<int>(h, PX_BLIT_BAND_PIXELS / w));
+	pxScaleCache* c = scaleCache(w * bandRows);
+
 	XImage* image = ::XCreateImage(s->display, 
 				       XDefaultVisual(s->display, 
 					   XDefaultScreen(s->display)), 
-				       24,ZPixmap, 0, (char*)flipped.base(), 
-				       flipped.width(), flipped.height(), 32, 
-				       flipped.stride());
+				       24,ZPixmap, 0, (char*)c->pixels, 
+				       w, bandRows, 32, w*4);
         
 	if (image)
 	{
-	    ::XPutImage(s->display, s->drawable, s->gc, image, 0, 0, 
-			dstLeft, dstTop, dstWidth, dstHeight);
+	    for (int y = 0; y < h; y += bandRows)
+	    {
+		int rows = pxMin<int>(bandRows, h-y);
+		for (int i = 0; i < rows; i++)
+		    memcpy((void*)(c->pixels + i*w), pixel(r.left(), r.top()+y+i), w*4);
+		::XPutImage(s->display, s->drawable, s->gc, image, 0, 0, 
+			    dstLeft, dstTop+y, w, rows);
+	    }
 	    
 	    // If we don't NULL this out XDestroyImage will damage
 	    // the heap by trying to free it internally
@@ -70,5 +163,3 @@ void pxBuffer::blit(pxSurfaceNative s, int dstLeft, int dstTop, int dstWidth, in
 	}
     }
 }
-
-
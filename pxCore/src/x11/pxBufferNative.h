@@ -9,6 +9,8 @@
 #include <X11/Xutil.h>
 #include <X11/keysymdef.h>
 
+#include <pthread.h>
+
 #include "../pxCore.h"
 
 // Structure used to describe a window surface under X11
@@ -21,4 +23,79 @@ typedef struct
 
 typedef pxSurfaceNativeDesc* pxSurfaceNative;
 
+// Since the lifetime of the Display should include the lifetime of all windows
+// and eventloop that uses it - refcounting is utilized through this
+// wrapper class.
+//
+// The connection is opened with Xlib's thread support so that native
+// drawing can be done from threads other than the event loop's.  Offscreens
+// take and drop references from any thread so the count and the opening
+// and closing of the connection are done under a lock.
+class displayRef
+{
+public:
+    displayRef()
+    {
+        pthread_mutex_lock(&mLock);
+        if (mRefCount == 0)
+        {
+            XInitThreads();
+            mDisplay = XOpenDisplay(NULL);
+            mConnection++;
+        }
+        mRefCount++;
+        pthread_mutex_unlock(&mLock);
+    }
+    
+    ~displayRef()
+    {
+        pthread_mutex_lock(&mLock);
+        mRefCount--;
+        if (mRefCount == 0)
+        {
+            // Without an X server the open failed and left nothing to close
+            if (mDisplay)
+                XCloseDisplay(mDisplay);
+            mDisplay = NULL;
+        }
+        pthread_mutex_unlock(&mLock);
+    }
+
+    Display* getDisplay() const { return mDisplay; }
+
+    // Counts the connections opened so far, so that what is known about
+    // a connection isn't taken to hold for a later one at the same address
+    unsigned long getConnection() const { return mConnection; }
+
+    // A new reference if some object already holds a connection to the X
+    // server, NULL otherwise.  Used to opportunistically use server side
+    // resources without forcing a connection to be opened.
+    static displayRef* share()
+    {
+        displayRef* d = NULL;
+        pthread_mutex_lock(&mLock);
+        if (mRefCount > 0 && mDisplay != NULL)
+        {
+            mRefCount++;
+            d = new displayRef(true);
+        }
+        pthread_mutex_unlock(&mLock);
+        return d;
+    }
+
+private:
+    // For share, which has already counted the reference
+    displayRef(bool) {}
+
+    static Display* mDisplay;
+    static int mRefCount;
+    static unsigned long mConnection;
+    static pthread_mutex_t mLock;
+};
+
+// A round trip made off the event loop's thread can read the loop's events
+// into Xlib's queue, where its poll() on the connection won't see them.
+// Wakes the loop if that has happened.
+void pxWakeEventLoopIfQueued(Display* display);
+
 #endif
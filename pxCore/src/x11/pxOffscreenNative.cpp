@@ -6,40 +6,364 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
 
-pxError pxOffscreen::init(int width, int height)
+// List of offscreens that are currently backed by a shared segment
+// so that pxBuffer::blit can find the XImage for a given base address
+static pxOffscreenNative* gSharedList = NULL;
+static pthread_mutex_t gSharedListMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// A remote display can report MIT-SHM and still fail to attach our
+// segments, which only shows up as an asynchronous error.  So the first
+// attach on each connection is made with an error handler installed and
+// a round trip, under a lock since the handler is process wide, and the
+// answer is kept for the rest.
+static pthread_mutex_t gShmProbeMutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long gShmProbed = 0;        // Connection probed, 0 for none
+static bool gShmWorks = false;
+static bool gShmAttachFailed = false;
+
+static int shmErrorHandler(Display* display, XErrorEvent* e)
 {
-    term();
+    gShmAttachFailed = true;
+    return 0;
+}
+
+// Returns true with info attached to the server
+static bool attachShared(displayRef* d, XShmSegmentInfo* info)
+{
+    Display* display = d->getDisplay();
 
-    pxError e = PX_FAIL;
+    pthread_mutex_lock(&gShmProbeMutex);
+    if (gShmProbed != d->getConnection())
+    {
+        gShmWorks = false;
+        if (pxOffscreenNative::shmAvailable(display))
+        {
+            XSync(display, False);
+            gShmAttachFailed = false;
+            XErrorHandler oldHandler = XSetErrorHandler(shmErrorHandler);
+            XShmAttach(display, info);
+            XSync(display, False);
+            XSetErrorHandler(oldHandler);
+            pxWakeEventLoopIfQueued(display);
+            gShmWorks = !gShmAttachFailed;
+        }
+        gShmProbed = d->getConnection();
+        bool works = gShmWorks;
+        pthread_mutex_unlock(&gShmProbeMutex);
+        return works;
+    }
+    bool works = gShmWorks;
+    pthread_mutex_unlock(&gShmProbeMutex);
 
-    data = (char*) new unsigned char[width * height * 4];
+    if (works)
+        XShmAttach(display, info);
+    return works;
+}
 
-    if (data)
+pxError pxOffscreen::init(int width, int height, unsigned int flags)
+{
+    if (width < 0 || height < 0)
+    {
+        term();
+        return PX_FAIL;
+    }
+
+    int stride = alignedStride(width);
+    bool shared = (flags & PX_OFFSCREEN_SHARED) != 0;
+
+    // The caller is about to draw into whatever memory it gets
+    waitForBlits();
+
+    // Keep using the memory we have if the new size fits in it
+    if (image && shared && resizeShared(width, height, stride) == PX_OK)
+    {
+        countReuse();
+        return PX_OK;
+    }
+
+    size_t bytes = (size_t)stride * height;
+
+    if (data && flags == allocFlags && bytes <= capacity)
     {
-	setBase(data);
-	setWidth(width);
-	setHeight(height);
-	setStride(width*4);
-	setUpsideDown(false);
-	e = PX_OK;
+        setWidth(width);
+        setHeight(height);
+        setStride(stride);
+        countReuse();
+        return PX_OK;
     }
 
-    return e;
+    term();
+
+    if (shared && initShared(width, height, stride, flags) == PX_OK)
+        return PX_OK;
+
+    data = (char*)allocPixels(bytes, capacity, flags);
+    if (!data)
+        return PX_FAIL;
+
+    allocFlags = flags;
+    setBase(data);
+    setWidth(width);
+    setHeight(height);
+    setStride(stride);
+    setUpsideDown(false);
+
+    return PX_OK;
 }
 
 pxError pxOffscreen::term()
 {
+    if (data)
+    {
+        freePixels(data, capacity, allocFlags);
+        data = NULL;
+        capacity = 0;
+        setBase(NULL);
+    }
+
     return pxOffscreenNative::term();
 }
 
-pxError pxOffscreenNative::term()
+bool pxOffscreenNative::shmAvailable(Display* display)
+{
+    if (!display || getenv("PX_NO_SHM"))
+        return false;
+
+    int major, minor;
+    Bool pixmaps;
+    return XShmQueryVersion(display, &major, &minor, &pixmaps)?true:false;
+}
+
+// The server works out the length of the rows in a shared image from its
+// width, so the padding at the end of each row is made part of the image
+// and the buffer describes just the width asked for.
+pxError pxOffscreenNative::initShared(int width, int height, int stride,
+                                      unsigned int flags)
+{
+    // Only use shared memory if a connection to the server is already
+    // open.  We don't want an offscreen to open a display on its own.
+    if (width <= 0 || height <= 0)
+        return PX_FAIL;
+
+    displayRef* d = displayRef::share();
+    if (!d)
+        return PX_FAIL;
+
+    Display* display = d->getDisplay();
+
+    // Skip the segment if an earlier one has shown it won't attach
+    pthread_mutex_lock(&gShmProbeMutex);
+    bool known = gShmProbed == d->getConnection();
+    bool works = gShmWorks;
+    pthread_mutex_unlock(&gShmProbeMutex);
+    if ((known && !works) || getenv("PX_NO_SHM"))
+    {
+        delete d;
+        return PX_FAIL;
+    }
+
+    XImage* i = XShmCreateImage(display,
+                                XDefaultVisual(display, XDefaultScreen(display)),
+                                24, ZPixmap, NULL, &shmInfo, stride/4, height);
+    if (!i || i->bits_per_pixel != 32 || i->bytes_per_line != stride)
+    {
+        if (i) XDestroyImage(i);
+        delete d;
+        return PX_FAIL;
+    }
+
+    shmSize = (size_t)i->bytes_per_line * i->height;
+    shmInfo.shmid = -1;
+#if defined(SHM_HUGETLB)
+    // Huge page segments have to be a whole number of huge pages
+    if ((flags & PX_OFFSCREEN_HUGEPAGES) && shmSize >= 2*1024*1024)
+    {
+        size_t hugeSize = (shmSize + 2*1024*1024 - 1) & ~(size_t)(2*1024*1024 - 1);
+        shmInfo.shmid = shmget(IPC_PRIVATE, hugeSize, IPC_CREAT|SHM_HUGETLB|0600);
+        if (shmInfo.shmid >= 0)
+            shmSize = hugeSize;
+    }
+#endif
+    if (shmInfo.shmid < 0)
+        shmInfo.shmid = shmget(IPC_PRIVATE, shmSize, IPC_CREAT|0600);
+    if (shmInfo.shmid < 0)
+    {
+        XDestroyImage(i);
+        delete d;
+        return PX_FAIL;
+    }
+
+    shmInfo.shmaddr = i->data = (char*)shmat(shmInfo.shmid, NULL, 0);
+    shmInfo.readOnly = False;
+
+    bool attached = shmInfo.shmaddr != (char*)-1 && attachShared(d, &shmInfo);
+
+    // Marking the segment for removal now guarantees that it is cleaned up
+    // even if we crash; it stays alive until both sides have detached.
+    // Linux lets the server attach it after this too.
+    shmctl(shmInfo.shmid, IPC_RMID, NULL);
+
+    if (!attached)
+    {
+        if (shmInfo.shmaddr != (char*)-1)
+            shmdt(shmInfo.shmaddr);
+        i->data = NULL;
+        XDestroyImage(i);
+        delete d;
+        return PX_FAIL;
+    }
+
+    image = i;
+    shmDisplay = d;
+
+    if (flags & PX_OFFSCREEN_PREFAULT)
+    {
+        for (size_t b = 0; b < shmSize; b += 4096)
+            ((volatile char*)image->data)[b] = 0;
+    }
+
+    setBase(image->data);
+    setWidth(width);
+    setHeight(height);
+    setStride(image->bytes_per_line);
+    setUpsideDown(false);
+
+    pthread_mutex_lock(&gSharedListMutex);
+    shmNext = gSharedList;
+    gSharedList = this;
+    pthread_mutex_unlock(&gSharedListMutex);
+
+    return PX_OK;
+}
+
+pxError pxOffscreenNative::resizeShared(int width, int height, int stride)
 {
-    delete [] data;
-    data = NULL;
-    
+    if (width <= 0 || height <= 0)
+        return PX_FAIL;
+
+    Display* display = shmDisplay->getDisplay();
+    XImage* i = XShmCreateImage(display,
+                                XDefaultVisual(display, XDefaultScreen(display)),
+                                24, ZPixmap, shmInfo.shmaddr, &shmInfo, stride/4, height);
+    if (!i)
+        return PX_FAIL;
+
+    if (i->bits_per_pixel != 32 || i->bytes_per_line != stride ||
+        (size_t)i->bytes_per_line * i->height > shmSize)
+    {
+        i->data = NULL;
+        XDestroyImage(i);
+        return PX_FAIL;
+    }
+
+    // The segment stays attached, only the image describing it changes.
+    // blit looks images up through the list so swap it under the lock.
+    pthread_mutex_lock(&gSharedListMutex);
+    XImage* old = image;
+    image = i;
+    pthread_mutex_unlock(&gSharedListMutex);
+
+    old->data = NULL;
+    XDestroyImage(old);
+
+    setWidth(width);
+    setHeight(height);
+    setStride(image->bytes_per_line);
     return PX_OK;
 }
 
+// The blit asks for a ShmCompletion event.  Whichever thread reads it
+// (normally the event loop's) moves the display's count of requests
+// processed past the blit, which is all waitForBlits looks at.
+bool pxOffscreenNative::putShared(pxSurfaceNative s, void* base, int srcLeft,
+                                  int srcTop, int dstLeft, int dstTop,
+                                  int width, int height)
+{
+    bool found = false;
+
+    // The display is locked first since blits are usually made with it
+    // locked already, inside native drawing.  The list lock stops
+    // resizeShared swapping the image out while it's in use.
+    XLockDisplay(s->display);
+    pthread_mutex_lock(&gSharedListMutex);
+    for (pxOffscreenNative* o = gSharedList; o; o = o->shmNext)
+    {
+        if (o->image->data == base && o->shmDisplay->getDisplay() == s->display)
+        {
+            o->shmSerial = NextRequest(s->display);
+            ::XShmPutImage(s->display, s->drawable, s->gc, o->image, srcLeft, srcTop,
+                           dstLeft, dstTop, width, height, True);
+            found = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&gSharedListMutex);
+    XUnlockDisplay(s->display);
+    return found;
+}
+
+void pxOffscreenNative::waitForBlits()
+{
+    pthread_mutex_lock(&gSharedListMutex);
+    unsigned long serial = shmSerial;
+    shmSerial = 0;
+    pthread_mutex_unlock(&gSharedListMutex);
+
+    if (!serial || !image)
+        return;
 
+    Display* display = shmDisplay->getDisplay();
+    XLockDisplay(display);
+    bool done = (long)(LastKnownRequestProcessed(display) - serial) >= 0;
+    XUnlockDisplay(display);
+    if (done)
+        return;
+
+    XSync(display, False);
+
+    // Nobody else wants the completion events, and without an event loop
+    // reading them they would pile up in the queue
+    XEvent e;
+    int completion = XShmGetEventBase(display) + ShmCompletion;
+    while (XCheckTypedEvent(display, completion, &e)) {}
+    pxWakeEventLoopIfQueued(display);
+}
 
+pxError pxOffscreenNative::term()
+{
+    if (image)
+    {
+        pthread_mutex_lock(&gSharedListMutex);
+        pxOffscreenNative** p = &gSharedList;
+        while (*p && *p != this)
+            p = &(*p)->shmNext;
+        if (*p)
+            *p = shmNext;
+        pthread_mutex_unlock(&gSharedListMutex);
+
+        // The server keeps its own mapping until it has handled the
+        // detach, after any blits still queued, so there is no need to
+        // wait for it
+        Display* display = shmDisplay->getDisplay();
+        XShmDetach(display, &shmInfo);
+        XFlush(display);
+        shmdt(shmInfo.shmaddr);
+        shmSerial = 0;
+
+        image->data = NULL;
+        XDestroyImage(image);
+        image = NULL;
+
+        delete shmDisplay;
+        shmDisplay = NULL;
+
+        shmSize = 0;
+        setBase(NULL);
+    }
+
+    return PX_OK;
+}
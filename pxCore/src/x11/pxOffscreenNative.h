@@ -11,18 +11,56 @@
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/keysymdef.h>
+#include <X11/extensions/XShm.h>
 
 class pxOffscreenNative: public pxBuffer
 {
 public:
-    pxOffscreenNative(): image(NULL), data(NULL) {}
+    pxOffscreenNative(): image(NULL), data(NULL), capacity(0), allocFlags(0),
+        shmDisplay(NULL), shmSize(0), shmSerial(0) {}
     virtual ~pxOffscreenNative() {}
 
     pxError term();
 
+    // Returns true if the pixels for this offscreen live in a MIT-SHM
+    // segment shared with the X server (see PX_OFFSCREEN_SHARED).  Blits
+    // from such an offscreen are done with XShmPutImage and don't go
+    // through the X socket.
+    bool shared() const { return image != NULL; }
+
+    // Waits until the server has read the pixels of the blits made from
+    // this offscreen so far.  Only shared offscreens are blitted without
+    // waiting, and usually the server has caught up by the time anything
+    // is drawn again so this doesn't have to ask it.
+    void waitForBlits();
+
+    // Blits from base with XShmPutImage and returns true if base belongs
+    // to a shared offscreen attached to s's display, returns false
+    // otherwise.  Doesn't wait for the server to read the pixels.
+    static bool putShared(pxSurfaceNative s, void* base, int srcLeft, int srcTop,
+                          int dstLeft, int dstTop, int width, int height);
+
+    // Setting the environment variable PX_NO_SHM disables the shared
+    // memory path which is handy for testing the fallback
+    static bool shmAvailable(Display* display);
+
 protected:
+    // stride is the row length in bytes, a multiple of 4 at least width*4
+    pxError initShared(int width, int height, int stride, unsigned int flags);
+
+    // Points a new image at the existing segment if it is big enough
+    pxError resizeShared(int width, int height, int stride);
+
     XImage* image;
     char* data;
+    size_t capacity;
+    unsigned int allocFlags;
+
+    XShmSegmentInfo shmInfo;
+    displayRef* shmDisplay;
+    size_t shmSize;
+    unsigned long shmSerial;    // Of the last XShmPutImage, 0 if none
+    pxOffscreenNative* shmNext;
 };
 
 #endif
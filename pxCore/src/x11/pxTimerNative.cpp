@@ -4,34 +4,57 @@
 
 #include "../pxTimer.h"
 
-#include <stdlib.h>
-#include <sys/time.h>
+#include <errno.h>
+#include <time.h>
+
+// CLOCK_MONOTONIC is read from the vDSO, normally off the TSC, so it costs
+// about as much as reading the TSC directly and the kernel has already
+// calibrated it and kept it consistent between processors
 
 double  pxSeconds()
 {
-    timeval tv;
-    gettimeofday(&tv, NULL);
-    return tv.tv_sec;
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec/1000000000;
 }
 
 double pxMilliseconds()
 {
-    timeval tv;
-    gettimeofday(&tv, NULL);
-    return ((double)(tv.tv_sec * 1000) + ((double)tv.tv_usec/1000));
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((double)ts.tv_sec * 1000) + ((double)ts.tv_nsec/1000000);
 }
 
 double  pxMicroseconds()
 {
-    timeval tv;
-    gettimeofday(&tv, NULL);
-    return (tv.tv_sec * 1000000) + tv.tv_usec;
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((double)ts.tv_sec * 1000000) + ((double)ts.tv_nsec/1000);
+}
+
+long long pxNanoseconds()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((long long)ts.tv_sec * PX_NS_PER_SECOND) + ts.tv_nsec;
 }
 
 void pxSleepMS(unsigned long msToSleep)
 {
-    timeval tv;
-    tv.tv_sec = 0;
-    tv.tv_usec = 1000 * msToSleep;
-    select(0, NULL, NULL, NULL, &tv);
+    pxSleepUntil(pxNanoseconds() + (long long)msToSleep * PX_NS_PER_MS);
+}
+
+void pxSleepUntil(long long deadline)
+{
+    if (deadline < 0)
+        return;
+
+    timespec ts;
+    ts.tv_sec = (time_t)(deadline / PX_NS_PER_SECOND);
+    ts.tv_nsec = (long)(deadline % PX_NS_PER_SECOND);
+
+    // A signal cuts the sleep short but the deadline doesn't move so
+    // just go back to sleep
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
 }
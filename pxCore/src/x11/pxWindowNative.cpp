@@ -6,12 +6,139 @@
 #include "../pxWindow.h"
 #include "pxWindowNative.h"
 #include "../pxTimer.h"
+#include "../pxAtomic.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <errno.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 
 Display* displayRef::mDisplay = NULL;
 int displayRef::mRefCount = 0;
+unsigned long displayRef::mConnection = 0;
+pthread_mutex_t displayRef::mLock = PTHREAD_MUTEX_INITIALIZER;
 
 bool exitFlag = false;
 
+// The event loop blocks in poll() on the X connection, a timerfd armed
+// for the next animation deadline and an eventfd that other threads can
+// use to wake it up
+static int gTimerFd = -1;
+static int gWakeFd = -1;
+
+// Invalidating from another thread has to wake the loop to draw
+static pthread_t gLoopThread;
+static bool gLoopRunning = false;
+
+static void wakeEventLoop()
+{
+    if (gWakeFd >= 0)
+    {
+        uint64_t one = 1;
+        if (write(gWakeFd, &one, sizeof(one)) < 0) {}
+    }
+}
+
+void pxWakeEventLoopIfQueued(Display* display)
+{
+    if (gLoopRunning && !pthread_equal(pthread_self(), gLoopThread) &&
+        XEventsQueued(display, QueuedAlready))
+        wakeEventLoop();
+}
+
+// A message on its way to the event loop.  A message with a key is queued
+// as a node pointing at the key, the payload waiting there can be replaced
+// until the node is delivered.
+struct pxPostedMessage
+{
+    pxPostedMessage* next;
+    pxWindowNative* window;
+    char* name;
+    void* p1;
+    pxMessageKey* key;
+    pxMessageRelease release;
+    sem_t* done;        // Set by sendSynchronizedMessage, which owns the message
+};
+
+// Pushed by any thread, newest first.  The loop takes the whole list in
+// one go so there is no ABA problem.
+static pxPostedMessage* volatile gPosted = NULL;
+
+// Taken off gPosted and waiting to be delivered, oldest first.  Only the
+// loop thread touches it.
+static pxPostedMessage* gPending = NULL;
+
+// Held while checking the loop is running and queuing a synchronized
+// message so it can't stop in between and leave the sender waiting
+static pthread_mutex_t gSendLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Returns true if the list was empty, in which case the loop needs waking
+static bool pushMessage(pxPostedMessage* m)
+{
+    pxPostedMessage* head;
+    do
+    {
+        head = gPosted;
+        m->next = head;
+    } while (!pxAtomicCompareAndSwapPointer((void* volatile*)&gPosted, head, m));
+    return head == NULL;
+}
+
+// Moves everything posted so far to the end of gPending
+static void takeMessages()
+{
+    pxPostedMessage* m = (pxPostedMessage*)
+        pxAtomicExchangePointer((void* volatile*)&gPosted, NULL);
+
+    pxPostedMessage* oldest = NULL;
+    while (m)
+    {
+        pxPostedMessage* next = m->next;
+        m->next = oldest;
+        oldest = m;
+        m = next;
+    }
+
+    pxPostedMessage** tail = &gPending;
+    while (*tail)
+        tail = &(*tail)->next;
+    *tail = oldest;
+}
+
+// For a keyed node, the payload waiting at its key if there still is one
+static pxPostedMessage* payload(pxPostedMessage* m)
+{
+    if (!m->key)
+        return m;
+
+    pxPostedMessage* p = (pxPostedMessage*)
+        pxAtomicExchangePointer(&m->key->pending, NULL);
+    delete m;
+    return p;
+}
+
+static void finishMessage(pxPostedMessage* m)
+{
+    if (m->done)
+        sem_post(m->done);
+    else
+        delete m;
+}
+
+// For a message that won't be delivered
+static void discardMessage(pxPostedMessage* m)
+{
+    if (m->release)
+        m->release(m->name, m->p1);
+    finishMessage(m);
+}
+
 // pxWindow
 
 pxError pxWindow::init(int left, int top, int width, int height)
@@ -70,6 +197,9 @@ pxError pxWindow::init(int left, int top, int width, int height)
 
 pxError pxWindow::term()
 {
+    mScheduler.remove(this);
+    dropMessages(this);
+    freeGCs();
     XDestroyWindow(mDisplayRef.getDisplay(), win);
     return PX_OK;
 }
@@ -77,35 +207,140 @@ pxError pxWindow::term()
 void pxWindow::invalidateRect(pxRect *r)
 {
     invalidateRectInternal(r);
+
+    if (gLoopRunning && !pthread_equal(pthread_self(), gLoopThread))
+        wakeEventLoop();
+}
+
+// Beyond this many separate rectangles the dirty region is just their
+// bounding box
+#define PX_MAX_DIRTY_RECTS 16
+
+// True if a and b overlap or share part of an edge.  Rectangles that
+// only meet at a corner are left apart.
+static bool touching(const pxRect& a, const pxRect& b)
+{
+    bool x = a.left() <= b.right() && b.left() <= a.right();
+    bool y = a.top() <= b.bottom() && b.top() <= a.bottom();
+    if (!x || !y)
+        return false;
+    return (a.left() < b.right() && b.left() < a.right()) ||
+           (a.top() < b.bottom() && b.top() < a.bottom());
+}
+
+static pxRect unite(const pxRect& a, const pxRect& b)
+{
+    return pxRect(pxMin<int>(a.left(), b.left()), pxMin<int>(a.top(), b.top()),
+                  pxMax<int>(a.right(), b.right()), pxMax<int>(a.bottom(), b.bottom()));
 }
 
-// This can be improved by collecting the dirty regions and painting
-// when the event loop goes idle
 void pxWindowNative::invalidateRectInternal(pxRect *r)
 {
     Display* display = mDisplayRef.getDisplay();
-    GC gc=XCreateGC(display, win, 0, NULL);
+    XLockDisplay(display);
+    addDirty(r);
+    XUnlockDisplay(display);
+}
+
+void pxWindowNative::addDirty(pxRect *r)
+{
+    if (!r)
+    {
+        mDirtyAll = true;
+        mDirty.clear();
+        return;
+    }
+    if (mDirtyAll)
+        return;
+
+    pxRect n = *r;
+    if (lastWidth >= 0)
+        n.intersect(pxRect(0, 0, lastWidth, lastHeight));
+    if (n.width() <= 0 || n.height() <= 0)
+        return;
+
+    // A merged rectangle can reach others so keep going until it
+    // doesn't touch any
+    size_t i = 0;
+    while (i < mDirty.size())
+    {
+        if (touching(mDirty[i], n))
+        {
+            n = unite(mDirty[i], n);
+            mDirty[i] = mDirty.back();
+            mDirty.pop_back();
+            i = 0;
+        }
+        else
+            i++;
+    }
+    mDirty.push_back(n);
+
+    if (mDirty.size() > PX_MAX_DIRTY_RECTS)
+    {
+        pxRect bounds = mDirty[0];
+        for (i = 1; i < mDirty.size(); i++)
+            bounds = unite(bounds, mDirty[i]);
+        mDirty.clear();
+        mDirty.push_back(bounds);
+    }
+}
+
+void pxWindowNative::drawDirty()
+{
+    Display* display = mDisplayRef.getDisplay();
+    XLockDisplay(display);
+
+    if (!mDirtyAll && mDirty.empty())
+    {
+        XUnlockDisplay(display);
+        return;
+    }
+
+    if (!mPaintGC)
+        mPaintGC = XCreateGC(display, win, 0, NULL);
                 
     pxSurfaceNativeDesc d;
     d.display = display;
     d.drawable = win;
-    d.gc = gc;
+    d.gc = mPaintGC;
     
-    if (r)
+    // The GC is reused so the last clip always has to be replaced
+    if (mDirtyAll)
+	XSetClipMask(display, mPaintGC, None);
+    else
     {
 	// Set up clip area
-	XRectangle xr;
-	xr.x = r->left();
-	xr.y = r->top();
-	xr.width = r->width();
-	xr.height = r->height();
-	XSetClipRectangles(display, gc, 0, 0, &xr, 1, Unsorted);
+	XRectangle xr[PX_MAX_DIRTY_RECTS];
+	int count = (int)mDirty.size();
+	for (int i = 0; i < count; i++)
+	{
+	    xr[i].x = mDirty[i].left();
+	    xr[i].y = mDirty[i].top();
+	    xr[i].width = mDirty[i].width();
+	    xr[i].height = mDirty[i].height();
+	}
+	XSetClipRectangles(display, mPaintGC, 0, 0, xr, count, Unsorted);
     }
 
+    // onDraw may invalidate again for the next pass
+    mDirty.clear();
+    mDirtyAll = false;
+    XUnlockDisplay(display);
+
     onDraw(&d);
-    
-    XFreeGC(display, gc);
+}
 
+void pxWindowNative::freeGCs()
+{
+    Display* display = mDisplayRef.getDisplay();
+    XLockDisplay(display);
+    if (mPaintGC)
+        XFreeGC(display, mPaintGC);
+    if (mNativeGC)
+        XFreeGC(display, mNativeGC);
+    mPaintGC = mNativeGC = 0;
+    XUnlockDisplay(display);
 }
 
 bool pxWindow::visibility()
@@ -132,10 +367,28 @@ void pxWindow::setVisibility(bool visible)
 pxError pxWindow::setAnimationFPS(long fps)
 {
     mTimerFPS = fps;
-    mLastAnimationTime = pxMilliseconds();
+    if (fps > 0)
+        mScheduler.schedule(this, fps, mAnimationPolicy);
+    else
+        mScheduler.remove(this);
+
+    // The loop may be sleeping without a deadline
+    wakeEventLoop();
     return PX_OK;
 }
 
+void pxWindow::setAnimationPolicy(pxFramePolicy policy)
+{
+    mAnimationPolicy = policy;
+    if (mTimerFPS > 0)
+        mScheduler.schedule(this, mTimerFPS, policy);
+}
+
+pxError pxWindow::animationStats(pxFrameStats& stats)
+{
+    return mScheduler.stats(this, stats);
+}
+
 void pxWindow::setTitle(char* title)
 {
     Display* d = mDisplayRef.getDisplay();
@@ -151,20 +404,31 @@ void pxWindow::setTitle(char* title)
     XSetIconName(d, win, title);
 }
 
+// The display stays locked until endNativeDrawing so that drawing from
+// another thread (a camera callback for instance) can't interleave its
+// requests with the event loop's
 pxError pxWindow::beginNativeDrawing(pxSurfaceNative& s)
 {
-    s = (pxSurfaceNative)malloc(sizeof(pxSurfaceNativeDesc));
-    s->display = mDisplayRef.getDisplay();
-    s->drawable = win;
-    s->gc = XCreateGC(s->display, win, 0, NULL);
+    Display* display = mDisplayRef.getDisplay();
+    XLockDisplay(display);
+
+    if (!mNativeGC)
+        mNativeGC = XCreateGC(display, win, 0, NULL);
+    else
+        XSetClipMask(display, mNativeGC, None);
+
+    mNativeSurface.display = display;
+    mNativeSurface.drawable = win;
+    mNativeSurface.gc = mNativeGC;
+    s = &mNativeSurface;
 
     return PX_OK;
 }
 
 pxError pxWindow::endNativeDrawing(pxSurfaceNative& s)
 {
-    XFreeGC(s->display, s->gc);
-    free(s);
+    XUnlockDisplay(s->display);
+    pxWakeEventLoopIfQueued(s->display);
     s = NULL;
 
     return PX_OK;
@@ -172,9 +436,355 @@ pxError pxWindow::endNativeDrawing(pxSurfaceNative& s)
 
 // pxWindowNative
 
-void pxWindowNative::onAnimationTimerInternal()
+void pxWindowNative::postMessage(char* messageName, void* p1,
+                                 unsigned long key, pxMessageRelease release)
 {
-    if (mTimerFPS) onAnimationTimer();
+    pxPostedMessage* m = new pxPostedMessage;
+    m->window = this;
+    m->name = messageName;
+    m->p1 = p1;
+    m->key = NULL;
+    m->release = release;
+    m->done = NULL;
+
+    pxMessageKey* k = key?findKey(key):NULL;
+    if (k)
+    {
+        // Whoever swaps out a payload owns it.  If one was waiting its
+        // node is still queued and will pick this one up instead.
+        pxPostedMessage* old = (pxPostedMessage*)
+            pxAtomicExchangePointer(&k->pending, m);
+        if (old)
+        {
+            discardMessage(old);
+            return;
+        }
+
+        m = new pxPostedMessage;
+        m->window = this;
+        m->name = NULL;
+        m->p1 = NULL;
+        m->key = k;
+        m->release = NULL;
+        m->done = NULL;
+    }
+
+    if (pushMessage(m))
+        wakeEventLoop();
+}
+
+void pxWindowNative::sendSynchronizedMessage(char* messageName, void* p1)
+{
+    if (gLoopRunning && pthread_equal(pthread_self(), gLoopThread))
+    {
+        onSynchronizedMessage(messageName, p1);
+        return;
+    }
+
+    sem_t done;
+    sem_init(&done, 0, 0);
+
+    pxPostedMessage m;
+    m.window = this;
+    m.name = messageName;
+    m.p1 = p1;
+    m.key = NULL;
+    m.release = NULL;
+    m.done = &done;
+
+    pthread_mutex_lock(&gSendLock);
+    bool running = gLoopRunning;
+    if (running && pushMessage(&m))
+        wakeEventLoop();
+    pthread_mutex_unlock(&gSendLock);
+
+    if (running)
+    {
+        while (sem_wait(&done) < 0 && errno == EINTR)
+            ;
+    }
+    sem_destroy(&done);
+}
+
+void pxWindowNative::dispatchMessages()
+{
+    takeMessages();
+
+    // Anything posted by the handlers waits for the next pass
+    int count = 0;
+    for (pxPostedMessage* m = gPending; m; m = m->next)
+        count++;
+
+    // A handler can destroy a window, which takes its messages out of
+    // gPending, so each one is unlinked before it is delivered
+    while (count-- > 0 && gPending)
+    {
+        pxPostedMessage* m = gPending;
+        gPending = m->next;
+
+        m = payload(m);
+        if (m)
+        {
+            m->window->onSynchronizedMessage(m->name, m->p1);
+            finishMessage(m);
+        }
+    }
+}
+
+void pxWindowNative::dropMessages(pxWindowNative* w)
+{
+    takeMessages();
+
+    pxPostedMessage** p = &gPending;
+    while (*p)
+    {
+        pxPostedMessage* m = *p;
+        if (m->window == w)
+        {
+            *p = m->next;
+            m = payload(m);
+            if (m)
+                discardMessage(m);
+        }
+        else
+            p = &m->next;
+    }
+
+    for (int i = 0; i < PX_MESSAGE_KEYS; i++)
+    {
+        pxPostedMessage* m = (pxPostedMessage*)
+            pxAtomicExchangePointer(&w->mKeys[i].pending, NULL);
+        if (m)
+            discardMessage(m);
+    }
+}
+
+void pxWindowNative::releaseWaiters()
+{
+    takeMessages();
+
+    pxPostedMessage** p = &gPending;
+    while (*p)
+    {
+        pxPostedMessage* m = *p;
+        if (m->done)
+        {
+            *p = m->next;
+            finishMessage(m);
+        }
+        else
+            p = &m->next;
+    }
+}
+
+// Keys are claimed in order and never given back so the first free one
+// ends the search
+pxMessageKey* pxWindowNative::findKey(unsigned long key)
+{
+    long k = (long)key;
+    for (int i = 0; i < PX_MESSAGE_KEYS; i++)
+    {
+        if (mKeys[i].key == k)
+            return &mKeys[i];
+        if (mKeys[i].key == 0 &&
+            (pxAtomicCompareAndSwap(&mKeys[i].key, 0, k) || mKeys[i].key == k))
+            return &mKeys[i];
+    }
+
+    // Out of keys, the message just isn't coalesced
+    return NULL;
+}
+
+void pxWindowNative::onFrame(const pxFrameInfo& info)
+{
+    onAnimationFrame(info);
+}
+
+// Milliseconds of queued input handled before the loop goes on to
+// resizing, animation and painting, about half a 60Hz frame
+#define PX_INPUT_BUDGET 8
+
+void pxWindowNative::dispatchEvent(XEvent& e)
+{
+    XAnyEvent* ae = (XAnyEvent*)&e;
+
+    pxWindowNative* w = getPXWindowFromX11Window(ae->window);
+    if (w)
+    {
+	switch(ae->type)
+	{
+	case Expose:
+	{
+	    // Exposed areas are collected and drawn together
+	    // once the pending input has been handled
+	    pxRect r(e.xexpose.x, e.xexpose.y,
+		     e.xexpose.x + e.xexpose.width,
+		     e.xexpose.y + e.xexpose.height);
+	    w->invalidateRectInternal(&r);
+	}
+	break;
+
+	case ButtonPress:
+	{
+
+	    XGrabPointer(ae->display, ae->window, true, 
+			 ButtonPressMask|ButtonReleaseMask|
+			 PointerMotionMask,
+			 GrabModeAsync, GrabModeAsync, None, None, 
+			 CurrentTime);
+
+	    XButtonEvent *be = (XButtonEvent*)ae;
+	    unsigned long flags;
+	    switch(be->button)
+	    {
+	    case Button2: flags = PX_MIDDLEBUTTON;
+		break;
+	    case Button3: flags = PX_RIGHTBUTTON;
+		break;
+	    default: flags = PX_LEFTBUTTON;
+		break;
+	    }
+	    flags |= (be->state & ShiftMask)?PX_MOD_SHIFT:0;
+	    flags |= (be->state & ControlMask)?PX_MOD_CONTROL:0;
+	    flags |= (be->state & Mod1Mask)?PX_MOD_ALT:0;
+
+	    w->onMouseDown(be->x, be->y, flags);
+	}
+	break;
+
+	case ButtonRelease:
+	{
+	    XUngrabPointer(ae->display, CurrentTime);
+
+	    XButtonEvent *be = (XButtonEvent*)ae;
+	    unsigned long flags;
+	    switch(be->button)
+	    {
+	    case Button2: flags = PX_MIDDLEBUTTON;
+		break;
+	    case Button3: flags = PX_RIGHTBUTTON;
+		break;
+	    default: flags = PX_LEFTBUTTON;
+		break;
+	    }
+	    flags |= (be->state & ShiftMask)?PX_MOD_SHIFT:0;
+	    flags |= (be->state & ControlMask)?PX_MOD_CONTROL:0;
+	    flags |= (be->state & Mod1Mask)?PX_MOD_ALT:0;
+
+	    w->onMouseUp(be->x, be->y, flags);
+	}
+	break;
+
+	case KeyPress:
+	{		
+	    XKeyEvent* ke = (XKeyEvent*)ae;
+	    KeySym keySym = ::XKeycodeToKeysym(ae->display, 
+					       e.xkey.keycode, 
+					       0);
+	    if (keySym >= 'a' && keySym <= 'z')
+		keySym = (keySym-'a')+'A';
+	    else if (keySym == XK_Shift_R)
+		keySym = XK_Shift_L;
+	    else if (keySym == XK_Control_R)
+		keySym = XK_Control_L;
+	    else if (keySym == XK_Alt_R)
+		keySym = XK_Alt_L;
+
+	    unsigned long flags = 0;
+	    flags |= (ke->state & ShiftMask)?PX_MOD_SHIFT:0;
+	    flags |= (ke->state & ControlMask)?PX_MOD_CONTROL:0;
+	    flags |= (ke->state & Mod1Mask)?PX_MOD_ALT:0;
+	    w->onKeyDown(keySym, flags);
+	}
+	break;
+
+	case MotionNotify:
+	{
+	    // Moves for the same window that are already queued are
+	    // collapsed into one onMouseMove at the latest position
+	    vector<pxMouseSample>& samples = w->mMotion;
+	    samples.clear();
+
+	    XEvent next = e;
+	    for (;;)
+	    {
+		pxMouseSample sample = { next.xmotion.x, next.xmotion.y,
+					 next.xmotion.time };
+		samples.push_back(sample);
+
+		if (XEventsQueued(ae->display, QueuedAlready) == 0)
+		    break;
+		XPeekEvent(ae->display, &next);
+		if (next.type != MotionNotify || 
+		    next.xmotion.window != ae->window)
+		    break;
+		XNextEvent(ae->display, &next);
+	    }
+
+	    pxMouseSample last = samples.back();
+	    if (samples.size() > 1)
+		w->onMouseMoveBatch(&samples[0], (int)samples.size());
+	    w->onMouseMove(last.x, last.y);
+	}
+	break;
+
+	case KeyRelease:
+	{
+	    XKeyEvent* ke = (XKeyEvent*)ae;
+	    KeySym keySym = ::XKeycodeToKeysym(ae->display, 
+					       e.xkey.keycode, 
+					       0);
+
+	    if (keySym >= 'a' && keySym <= 'z')
+		keySym = (keySym-'a')+'A';
+	    else if (keySym == XK_Shift_R)
+		keySym = XK_Shift_L;
+	    else if (keySym == XK_Control_R)
+		keySym = XK_Control_L;
+	    else if (keySym == XK_Alt_R)
+		keySym = XK_Alt_L;
+
+	    unsigned long flags = 0;
+	    flags |= (ke->state & ShiftMask)?PX_MOD_SHIFT:0;
+	    flags |= (ke->state & ControlMask)?PX_MOD_CONTROL:0;
+	    flags |= (ke->state & Mod1Mask)?PX_MOD_ALT:0;
+	    w->onKeyUp(keySym, flags);
+	}
+	break;
+
+	case ConfigureNotify:
+	{
+	    // We defer the onSize message after some
+	    // time
+	    if (w->lastWidth != e.xconfigure.width ||
+		w->lastHeight != e.xconfigure.height)
+	    {
+		w->resizeFlag = true;
+		w->lastWidth = e.xconfigure.width;
+		w->lastHeight = e.xconfigure.height;
+	    }
+	}
+	break;
+
+	case ClientMessage:
+	{
+
+	    if((e.xclient.format == 32) &&
+	       (e.xclient.data.l[0] == int(w->closeatom)))
+	    {
+		w->onCloseRequest();
+	    }
+	}
+	break;
+
+	case DestroyNotify:
+	{
+	    w->onClose();
+	    unregisterWindow(ae->window);
+	}
+	break;
+	}
+    }
 }
 
 void pxWindowNative::runEventLoop()
@@ -182,214 +792,136 @@ void pxWindowNative::runEventLoop()
     displayRef d;
         
     exitFlag = false;
+    gLoopThread = pthread_self();
+    pthread_mutex_lock(&gSendLock);
+    gLoopRunning = true;
+    pthread_mutex_unlock(&gSendLock);
+
+    if (gTimerFd < 0)
+        gTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+    if (gWakeFd < 0)
+        gWakeFd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
 
-    double lastAnimationTime = pxMilliseconds();
     while(!exitFlag)
     {
-	
-        XEvent e;
-        if (XPending(d.getDisplay()))
+        // Input gets a bounded slice of each pass so a stream of events
+        // can't hold off resizing, animation and painting
+        double inputStart = pxMilliseconds();
+        while (!exitFlag && XPending(d.getDisplay()))
         {
-	    XNextEvent(d.getDisplay(), &e);
-	    XAnyEvent* ae = (XAnyEvent*)&e;
-	    
-	    pxWindowNative* w = getPXWindowFromX11Window(ae->window);
-	    if (w)
+            XEvent e;
+            XNextEvent(d.getDisplay(), &e);
+            dispatchEvent(e);
+
+            if (pxMilliseconds() - inputStart >= PX_INPUT_BUDGET)
+                break;
+        }
+
+	// Messages from other threads
+	dispatchMessages();
+
+	vector<windowDesc>::iterator i;
+	for (i = mWindowMap.begin(); i < mWindowMap.end(); i++)
+	{
+	    pxWindowNative* w = (*i).p;
+	    if (w->resizeFlag)
 	    {
-		switch(ae->type)
-		{
-		case Expose:
-		{
-		    if(e.xexpose.count<1)
-		    {
-		    
-			GC gc=XCreateGC(ae->display, ae->window, 0, NULL);
-			
-			pxSurfaceNativeDesc d;
-			d.display = ae->display;
-			d.drawable = ae->window;
-			d.gc = gc;
-			
-			w->onDraw(&d);
-			
-			XFreeGC(ae->display, gc);
-		    }
-		}
-		break;
-		
-		case ButtonPress:
-		{
-		    
-		    XGrabPointer(ae->display, ae->window, true, 
-				 ButtonPressMask|ButtonReleaseMask|
-				 PointerMotionMask,
-				 GrabModeAsync, GrabModeAsync, None, None, 
-				 CurrentTime);
-		    
-		    XButtonEvent *be = (XButtonEvent*)ae;
-		    unsigned long flags;
-		    switch(be->button)
-		    {
-		    case Button2: flags = PX_MIDDLEBUTTON;
-			break;
-		    case Button3: flags = PX_RIGHTBUTTON;
-			break;
-		    default: flags = PX_LEFTBUTTON;
-			break;
-		    }
-		    flags |= (be->state & ShiftMask)?PX_MOD_SHIFT:0;
-		    flags |= (be->state & ControlMask)?PX_MOD_CONTROL:0;
-		    flags |= (be->state & Mod1Mask)?PX_MOD_ALT:0;
-		    
-		    w->onMouseDown(be->x, be->y, flags);
-		}
-		break;
+		w->resizeFlag = false;
+		w->onSize((*i).p->lastWidth, (*i).p->lastHeight);
+		w->invalidateRectInternal(NULL);
+	    }
+	}
 
-		case ButtonRelease:
-		{
-		    XUngrabPointer(ae->display, CurrentTime);
-		    
-		    XButtonEvent *be = (XButtonEvent*)ae;
-		    unsigned long flags;
-		    switch(be->button)
-		    {
-		    case Button2: flags = PX_MIDDLEBUTTON;
-			break;
-		    case Button3: flags = PX_RIGHTBUTTON;
-			break;
-		    default: flags = PX_LEFTBUTTON;
-			break;
-		    }
-		    flags |= (be->state & ShiftMask)?PX_MOD_SHIFT:0;
-		    flags |= (be->state & ControlMask)?PX_MOD_CONTROL:0;
-		    flags |= (be->state & Mod1Mask)?PX_MOD_ALT:0;
-		    
-		    w->onMouseUp(be->x, be->y, flags);
-		}
-		break;
+	// Every window's animation frames that are due
+	mScheduler.run(pxNanoseconds());
 
-		case KeyPress:
-		{		
-		    XKeyEvent* ke = (XKeyEvent*)ae;
-		    KeySym keySym = ::XKeycodeToKeysym(ae->display, 
-						       e.xkey.keycode, 
-						       0);
-		    if (keySym >= 'a' && keySym <= 'z')
-			keySym = (keySym-'a')+'A';
-		    else if (keySym == XK_Shift_R)
-			keySym = XK_Shift_L;
-		    else if (keySym == XK_Control_R)
-			keySym = XK_Control_L;
-		    else if (keySym == XK_Alt_R)
-			keySym = XK_Alt_L;
-		    
-		    unsigned long flags = 0;
-		    flags |= (ke->state & ShiftMask)?PX_MOD_SHIFT:0;
-		    flags |= (ke->state & ControlMask)?PX_MOD_CONTROL:0;
-		    flags |= (ke->state & Mod1Mask)?PX_MOD_ALT:0;
-		    w->onKeyDown(keySym, flags);
-		}
-		break;
+	// Everything invalidated since the last pass is drawn
+	// with a single onDraw
+	for (i = mWindowMap.begin(); i < mWindowMap.end(); i++)
+	    (*i).p->drawDirty();
 
-		case MotionNotify:
-		{
-		    XMotionEvent *me = (XMotionEvent*)ae;
-		    w->onMouseMove(me->x, me->y);
-		}
-		break;
+	waitForEvents(d.getDisplay());
+    }
 
-		case KeyRelease:
-		{
-		    XKeyEvent* ke = (XKeyEvent*)ae;
-		    KeySym keySym = ::XKeycodeToKeysym(ae->display, 
-						       e.xkey.keycode, 
-						       0);
-		    
-		    if (keySym >= 'a' && keySym <= 'z')
-			keySym = (keySym-'a')+'A';
-		    else if (keySym == XK_Shift_R)
-			keySym = XK_Shift_L;
-		    else if (keySym == XK_Control_R)
-			keySym = XK_Control_L;
-		    else if (keySym == XK_Alt_R)
-			keySym = XK_Alt_L;
-		    
-		    unsigned long flags = 0;
-		    flags |= (ke->state & ShiftMask)?PX_MOD_SHIFT:0;
-		    flags |= (ke->state & ControlMask)?PX_MOD_CONTROL:0;
-		    flags |= (ke->state & Mod1Mask)?PX_MOD_ALT:0;
-		    w->onKeyUp(keySym, flags);
-		}
-		break;
+    pthread_mutex_lock(&gSendLock);
+    gLoopRunning = false;
+    pthread_mutex_unlock(&gSendLock);
 
-		case ConfigureNotify:
-		{
-		    // We defer the onSize message after some
-		    // time
-		    if (w->lastWidth != e.xconfigure.width ||
-			w->lastHeight != e.xconfigure.height)
-		    {
-			w->resizeFlag = true;
-			w->lastWidth = e.xconfigure.width;
-			w->lastHeight = e.xconfigure.height;
-		    }
-		}
-		break;
+    // Nothing will deliver them now.  Posted messages stay queued in
+    // case the loop is run again.
+    releaseWaiters();
+}
 
-		case ClientMessage:
-		{
-		    
-		    if((e.xclient.format == 32) &&
-		       (e.xclient.data.l[0] == int(w->closeatom)))
-		    {
-			w->onCloseRequest();
-		    }
-		}
-		break;
+// Sleep until the X connection has something for us, the next
+// animation deadline passes or another thread wakes the loop
+void pxWindowNative::waitForEvents(Display* display)
+{
+    // Anything drawn while idle needs to reach the server before we
+    // block and events may already be sitting in the Xlib queue
+    if (exitFlag || gPending || gPosted || XPending(display))
+        return;
 
-		case DestroyNotify:
-		{
-		    w->onClose();
-		    unregisterWindow(ae->window);
-		}
-		break;
-		}
-	    }
+    vector<windowDesc>::iterator i;
+    for (i = mWindowMap.begin(); i < mWindowMap.end(); i++)
+    {
+        pxWindowNative* w = (*i).p;
+        if (w->resizeFlag)
+            return;
+
+        XLockDisplay(display);
+        bool dirty = w->mDirtyAll || !w->mDirty.empty();
+        XUnlockDisplay(display);
+        if (dirty)
+            return;
+    }
+
+    long long nextDeadline = mScheduler.nextDeadline();
+
+    struct pollfd fds[3];
+    int nfds = 0;
+
+    fds[nfds].fd = ConnectionNumber(display);
+    fds[nfds++].events = POLLIN;
+
+    int timeout = -1;
+    if (nextDeadline >= 0)
+    {
+        if (gTimerFd >= 0)
+        {
+            // pxNanoseconds reads the monotonic clock so the timer is
+            // armed against the same clock with an absolute deadline
+            struct itimerspec ts;
+            memset(&ts, 0, sizeof(ts));
+            ts.it_value.tv_sec = (time_t)(nextDeadline / PX_NS_PER_SECOND);
+            ts.it_value.tv_nsec = (long)(nextDeadline % PX_NS_PER_SECOND);
+            if (ts.it_value.tv_sec == 0 && ts.it_value.tv_nsec == 0)
+                ts.it_value.tv_nsec = 1;
+            timerfd_settime(gTimerFd, TFD_TIMER_ABSTIME, &ts, NULL);
+            fds[nfds].fd = gTimerFd;
+            fds[nfds++].events = POLLIN;
         }
         else
         {
-	    // The animation/resize handling under x11 needs some serious
-	    // rework
-	    
-            double currentAnimationTime = pxMilliseconds();
-	    
-	    vector<windowDesc>::iterator i;
-	    for (i = mWindowMap.begin(); i < mWindowMap.end(); i++)
-	    {
-		pxWindowNative* w = (*i).p;
-
-		double animationDelta = currentAnimationTime-lastAnimationTime;
-		if (w->resizeFlag)
-		{
-		    w->resizeFlag = false;
-		    w->onSize((*i).p->lastWidth, (*i).p->lastHeight);
-		    w->invalidateRectInternal(NULL);
-		}
-		
-		if (w->mTimerFPS)
-		{
-		    animationDelta = currentAnimationTime-
-			w->mLastAnimationTime;
-
-		    if (animationDelta > (1000/w->mTimerFPS))
-		    {
-			w->onAnimationTimerInternal();
-			w->mLastAnimationTime = currentAnimationTime;
-		    }
-		}
-	    }
+            long long delta = nextDeadline - pxNanoseconds();
+            timeout = (delta > 0)?(int)(delta / PX_NS_PER_MS)+1:0;
+        }
+    }
+
+    if (gWakeFd >= 0)
+    {
+        fds[nfds].fd = gWakeFd;
+        fds[nfds++].events = POLLIN;
+    }
 
-	    pxSleepMS(10); // Breath
+    if (poll(fds, nfds, timeout) > 0)
+    {
+        uint64_t count;
+        for (int j = 1; j < nfds; j++)
+        {
+            if (fds[j].revents & POLLIN)
+            {
+                if (read(fds[j].fd, &count, sizeof(count)) < 0) {}
+            }
         }
     }
 }
@@ -397,39 +929,64 @@ void pxWindowNative::runEventLoop()
 void pxWindowNative::exitEventLoop()
 {
     exitFlag = true;
+    wakeEventLoop();
 }
 
 
+static XContext gWindowContext = 0;
+static Window gLastWindow = 0;
+static pxWindowNative* gLastPXWindow = NULL;
+
 void pxWindowNative::registerWindow(Window w, pxWindowNative* p)
 {
-    windowDesc d = {w, p};
-    mWindowMap.push_back(d);
+    displayRef d;
+    if (!gWindowContext)
+        gWindowContext = XUniqueContext();
+    XSaveContext(d.getDisplay(), w, gWindowContext, (XPointer)p);
+
+    windowDesc desc = {w, p};
+    p->mMapIndex = (int)mWindowMap.size();
+    mWindowMap.push_back(desc);
 }
 
 void pxWindowNative::unregisterWindow(Window w)
 {
-    vector<windowDesc>::iterator i;
+    pxWindowNative* p = getPXWindowFromX11Window(w);
+    if (!p)
+        return;
 
-    for (i = mWindowMap.begin(); i < mWindowMap.end(); i++)
+    displayRef d;
+    XDeleteContext(d.getDisplay(), w, gWindowContext);
+    if (gLastWindow == w)
     {
-        if ((*i).w == w) 
-        {
-            mWindowMap.erase(i);
-            return;
-        }
+        gLastWindow = 0;
+        gLastPXWindow = NULL;
     }
+
+    // Move the last window into the hole
+    int i = p->mMapIndex;
+    mWindowMap[i] = mWindowMap.back();
+    mWindowMap[i].p->mMapIndex = i;
+    mWindowMap.pop_back();
+    p->mMapIndex = -1;
 }
 
 pxWindowNative* pxWindowNative::getPXWindowFromX11Window(Window w)
 {
-    vector<windowDesc>::iterator i;
+    if (w == gLastWindow)
+        return gLastPXWindow;
+    if (!gWindowContext)
+        return NULL;
 
-    for (i = mWindowMap.begin(); i < mWindowMap.end(); i++)
-    {
-        if ((*i).w == w) 
-            return (*i).p;
-    }
-    return NULL;
+    displayRef d;
+    XPointer p;
+    if (XFindContext(d.getDisplay(), w, gWindowContext, &p) != 0)
+        return NULL;
+
+    gLastWindow = w;
+    gLastPXWindow = (pxWindowNative*)p;
+    return gLastPXWindow;
 }
 
 vector<pxWindowNative::windowDesc> pxWindowNative::mWindowMap;
+pxFrameScheduler pxWindowNative::mScheduler;
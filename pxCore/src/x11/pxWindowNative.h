@@ -9,47 +9,55 @@
 #include <X11/Xutil.h>
 #include <X11/keysymdef.h>
 #include <X11/Xatom.h>
+#include <X11/Xresource.h>
+
+#include "../pxRect.h"
+#include "../pxFrameScheduler.h"
 
 #include <vector>
 using namespace std;
 
-// Since the lifetime of the Display should include the lifetime of all windows
-// and eventloop that uses it - refcounting is utilized through this
-// wrapper class.
-class displayRef
+// A window coalesces posted messages on up to this many different keys
+#define PX_MESSAGE_KEYS 16
+
+// The latest message posted with key that hasn't been delivered yet
+struct pxMessageKey
+{
+    volatile long key;
+    void* volatile pending;
+};
+
+class pxWindowNative: public pxFrameClient
 {
 public:
-    displayRef()
-    {
-        if (mRefCount == 0)
-        {
-            mDisplay = XOpenDisplay(NULL);
-        }
-        mRefCount++;
-    }
-    
-    ~displayRef()
+pxWindowNative(): win(0), mTimerFPS(0), mAnimationPolicy(PX_FRAME_DROP),
+	lastWidth(-1), lastHeight(-1), 
+	resizeFlag(false), mDirtyAll(false), mPaintGC(0), mNativeGC(0),
+	mMapIndex(-1)
     {
-        mRefCount--;
-        if (mRefCount == 0)
+        for (int i = 0; i < PX_MESSAGE_KEYS; i++)
         {
-            XCloseDisplay(mDisplay);
+            mKeys[i].key = 0;
+            mKeys[i].pending = NULL;
         }
     }
+    virtual ~pxWindowNative() {}
 
-    Display* getDisplay() const { return mDisplay; }
-
-private:
-    static Display* mDisplay;
-    static int mRefCount;
-};
+    // Have onSynchronizedMessage called on the event loop thread, these
+    // can be called from any thread.  Messages for a window must stop
+    // before the window is destroyed, any still queued then are dropped.
+    //
+    // postMessage returns straight away.  A message posted with a non zero
+    // key replaces one with the same key that hasn't been delivered yet,
+    // so a stream of frame ready messages can't pile up.  Once delivered
+    // the handler owns p1, if the message is replaced or dropped instead
+    // release is called with it.
+    void postMessage(char* messageName, void* p1, unsigned long key = 0,
+                     pxMessageRelease release = NULL);
 
-class pxWindowNative
-{
-public:
-pxWindowNative(): win(0), mTimerFPS(0), lastWidth(-1), lastHeight(-1), 
-	resizeFlag(false) {}
-    virtual ~pxWindowNative() {}
+    // Waits for onSynchronizedMessage to return.  If the event loop isn't
+    // running, or stops first, the message is dropped.
+    void sendSynchronizedMessage(char* messageName, void* p1);
 
     // Contract between pxEventLoopNative and this class
     static void runEventLoop();
@@ -67,6 +75,7 @@ protected:
     virtual void onMouseUp(int x, int y, unsigned long flags) = 0;
 
     virtual void onMouseMove(int x, int y) = 0;
+    virtual void onMouseMoveBatch(const pxMouseSample* samples, int count) = 0;
 
     virtual void onKeyDown(int keycode, unsigned long flags) = 0;
     virtual void onKeyUp(int keycode, unsigned long flags) = 0;
@@ -74,15 +83,50 @@ protected:
     virtual void onDraw(pxSurfaceNative surface) = 0;
 
     virtual void onAnimationTimer() = 0;	
+    virtual void onAnimationFrame(const pxFrameInfo& info) = 0;
 
-    void onAnimationTimerInternal();
+    // X11 and Windows only for now
+    virtual void onSynchronizedMessage(char* messageName, void* p1) {}
 
+    // Called by mScheduler
+    void onFrame(const pxFrameInfo& info);
+
+    // Adds r (the whole window if NULL) to the region that gets drawn
+    // when the event loop next goes idle
     void invalidateRectInternal(pxRect *r);
+    void addDirty(pxRect *r);
+
+    // Calls onDraw once, clipped to the dirty region, if there is one
+    void drawDirty();
+
+    // The GCs are created on first use and kept until the window is
+    // destroyed
+    void freeGCs();
+
+    // Handles one event already taken off the queue
+    static void dispatchEvent(XEvent& e);
+
+    static void waitForEvents(Display* display);
+
+    // Delivers the messages that have been posted so far
+    static void dispatchMessages();
+
+    // Frees the undelivered messages for w and lets anyone waiting on
+    // them go
+    static void dropMessages(pxWindowNative* w);
+
+    // Lets everyone waiting in sendSynchronizedMessage go without
+    // delivering their messages
+    static void releaseWaiters();
+
+    pxMessageKey* findKey(unsigned long key);
 
     // X11 to PXWindow mapping stuff
-    // This could go away if there was an easy way to associate an
-    // arbitrary pointer with an Xlib window.
-    // Anyone know how to do this?
+    // Each Xlib window carries a pointer to its pxWindowNative in an
+    // XContext, Xlib's per display hash table, with the last window
+    // looked up remembered since most events are for the same one.
+    // mWindowMap lists the windows for the event loop to walk, windows
+    // know their index in it so removing one is constant time too.
     
     typedef struct
     {
@@ -95,13 +139,37 @@ protected:
     static void unregisterWindow(Window);
     static vector<windowDesc> mWindowMap;
 
+    // Every window's animation timer is in the one scheduler, which the
+    // event loop runs and sleeps until the next deadline of
+    static pxFrameScheduler mScheduler;
+
     Window win;
     displayRef mDisplayRef;
     int mTimerFPS;
+    pxFramePolicy mAnimationPolicy;
     int lastWidth, lastHeight;
     bool resizeFlag;
     Atom closeatom;
-    double mLastAnimationTime;
+
+    // Dirty rectangles, none of which overlap or share an edge.  Guarded
+    // by the display lock since other threads may invalidate.
+    vector<pxRect> mDirty;
+    bool mDirtyAll;
+
+    // onDraw and native drawing get a GC each so a drawing thread
+    // can't change the clip of a paint in progress
+    GC mPaintGC;
+    GC mNativeGC;
+    pxSurfaceNativeDesc mNativeSurface;
+
+    // Where this window is in mWindowMap
+    int mMapIndex;
+
+    // The moves being collapsed by dispatchEvent, kept to save
+    // allocating for each batch
+    vector<pxMouseSample> mMotion;
+
+    pxMessageKey mKeys[PX_MESSAGE_KEYS];
 };
 
 // Key Codes